@@ -1,14 +1,23 @@
 #pragma once
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
 #include <cctype>
+#include <chrono>
 #include <cmath>
 #include <cstdint>
 #include <cstdlib>
 #include <functional>
 #include <limits>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
+#include <functionlangSampling.hpp>
+#include <functionlangTrace.hpp>
+
 namespace functionlang {
 
 const char VERSION[] = "0.4.2";
@@ -17,6 +26,8 @@ const char VERSIONTEXT[] =
     "added euler's number";
 
 const size_t INTERNAL_VARIABLE_START = 256;
+// Coordinates a Q integral may sample.
+const size_t MONTE_CARLO_MAX_DIMENSIONS = 64;
 const char USER_VARIABLE_IDENT = '$';
 const char INTERNAL_VARIABLE_IDENT = '@';
 const char USER_FUNCTION_IDENT = '#';
@@ -58,7 +69,7 @@ enum BINARY_OPS_ENUM {
 };
 enum TERNARY_OPS_ENUM { WHETHER = '?' };
 enum QUATERNARY_OPS_ENUM { SUMMATION = 'A', PRODUCT = 'P' };
-enum PENTARY_OPS_ENUM { INTEGRAL = 'I' };
+enum PENTARY_OPS_ENUM { INTEGRAL = 'I', MONTE_CARLO = 'Q' };
 
 const char CONSTS[] = {CONSTS_ENUM::PI, CONSTS_ENUM::EULER};
 const char UNARY_OPS[] = {UNARY_OPS_ENUM::LOG,   UNARY_OPS_ENUM::LOG2,
@@ -76,17 +87,794 @@ const char BINARY_OPS[] = {
 const char TERNARY_OPS[] = {TERNARY_OPS_ENUM::WHETHER};
 const char QUATERNARY_OPS[] = {QUATERNARY_OPS_ENUM::SUMMATION,
                                QUATERNARY_OPS_ENUM::PRODUCT};
-const char PENTARY_OPS[] = {PENTARY_OPS_ENUM::INTEGRAL};
+const char PENTARY_OPS[] = {PENTARY_OPS_ENUM::INTEGRAL,
+                            PENTARY_OPS_ENUM::MONTE_CARLO};
+
+// Opcodes shared by the compiled backends and expression trees.
+enum class Op : uint8_t {
+  PUSH_V,
+  GET_V,
+  GET_IV,
+  // Unary
+  LOG,
+  LOG2,
+  LOG10,
+  SQRT,
+  CBRT,
+  SIN,
+  COS,
+  ABS,
+  NOT,
+  FACTORIAL,
+  // Binary
+  ADD,
+  SUB,
+  MUL,
+  DIV,
+  POW,
+  MIN,
+  MAX,
+  LOG_N,
+  LT,
+  GT,
+  EQ,
+  NE,
+  L_AND,
+  L_OR,
+  MOD,
+  ROUND,
+  // Ternary
+  WHETHER,
+  // Loops, represented in expression trees but not executed by the VMs
+  SUMMATION,
+  PRODUCT,
+  INTEGRAL,
+  MONTE_CARLO,
+  // Superinstructions, selected by the compiler for common idioms
+  SQUARE,      // ^x,2
+  POW_HALF,    // ^x,0.5
+  POW_INT,     // ^x,n for a small integer n, followed by n
+  MUL_ADD,     // +*a,b,c
+  ADD_MUL,     // *a,+b,c
+  ADD_VAR,     // +x,$n followed by n
+  MUL_VAR,     // *x,$n followed by n
+  ADD_CONST,   // +x,k and _x,k
+  MUL_CONST,   // *x,k
+  ROUND_CONST, // ~x,k with 10^k precomputed
+  HALT
+};
+
+enum class TokenKind : uint8_t {
+  INVALID,
+  NUMBER,
+  CONSTANT,
+  USER_VARIABLE,
+  INTERNAL_VARIABLE,
+  OPERATOR
+};
+
+// Classification of one leading character: what it starts, how many operands
+// an operator takes and the opcode it compiles to.
+struct OperatorInfo {
+  TokenKind kind = TokenKind::INVALID;
+  uint8_t arity = 0;
+  Op opcode = Op::HALT;
+};
+
+constexpr std::array<OperatorInfo, 256> makeOperatorTable() {
+  std::array<OperatorInfo, 256> table{};
+  auto set = [&table](char c, TokenKind kind, uint8_t arity, Op opcode) {
+    table[static_cast<unsigned char>(c)] = {kind, arity, opcode};
+  };
+  for (char c = '0'; c <= '9'; c++)
+    set(c, TokenKind::NUMBER, 0, Op::PUSH_V);
+  set('.', TokenKind::NUMBER, 0, Op::PUSH_V);
+  set('-', TokenKind::NUMBER, 0, Op::PUSH_V);
+  set(CONSTS_ENUM::PI, TokenKind::CONSTANT, 0, Op::PUSH_V);
+  set(CONSTS_ENUM::EULER, TokenKind::CONSTANT, 0, Op::PUSH_V);
+  set(USER_VARIABLE_IDENT, TokenKind::USER_VARIABLE, 0, Op::GET_V);
+  set(INTERNAL_VARIABLE_IDENT, TokenKind::INTERNAL_VARIABLE, 0, Op::GET_IV);
+
+  const TokenKind o = TokenKind::OPERATOR;
+  set(UNARY_OPS_ENUM::LOG, o, 1, Op::LOG);
+  set(UNARY_OPS_ENUM::LOG2, o, 1, Op::LOG2);
+  set(UNARY_OPS_ENUM::LOG10, o, 1, Op::LOG10);
+  set(UNARY_OPS_ENUM::SQRT, o, 1, Op::SQRT);
+  set(UNARY_OPS_ENUM::CBRT, o, 1, Op::CBRT);
+  set(UNARY_OPS_ENUM::SIN, o, 1, Op::SIN);
+  set(UNARY_OPS_ENUM::COS, o, 1, Op::COS);
+  set(UNARY_OPS_ENUM::ABS, o, 1, Op::ABS);
+  set(UNARY_OPS_ENUM::NOT, o, 1, Op::NOT);
+  set(UNARY_OPS_ENUM::FACTORIAL, o, 1, Op::FACTORIAL);
+  set(BINARY_OPS_ENUM::MUL, o, 2, Op::MUL);
+  set(BINARY_OPS_ENUM::DIV, o, 2, Op::DIV);
+  set(BINARY_OPS_ENUM::ADD, o, 2, Op::ADD);
+  set(BINARY_OPS_ENUM::SUB, o, 2, Op::SUB);
+  set(BINARY_OPS_ENUM::POW, o, 2, Op::POW);
+  set(BINARY_OPS_ENUM::MIN, o, 2, Op::MIN);
+  set(BINARY_OPS_ENUM::MAX, o, 2, Op::MAX);
+  set(BINARY_OPS_ENUM::LOG_N, o, 2, Op::LOG_N);
+  set(BINARY_OPS_ENUM::LT, o, 2, Op::LT);
+  set(BINARY_OPS_ENUM::GT, o, 2, Op::GT);
+  set(BINARY_OPS_ENUM::EQ, o, 2, Op::EQ);
+  set(BINARY_OPS_ENUM::NE, o, 2, Op::NE);
+  set(BINARY_OPS_ENUM::L_AND, o, 2, Op::L_AND);
+  set(BINARY_OPS_ENUM::L_OR, o, 2, Op::L_OR);
+  set(BINARY_OPS_ENUM::MOD, o, 2, Op::MOD);
+  set(BINARY_OPS_ENUM::ROUND, o, 2, Op::ROUND);
+  set(TERNARY_OPS_ENUM::WHETHER, o, 3, Op::WHETHER);
+  set(QUATERNARY_OPS_ENUM::SUMMATION, o, 4, Op::SUMMATION);
+  set(QUATERNARY_OPS_ENUM::PRODUCT, o, 4, Op::PRODUCT);
+  set(PENTARY_OPS_ENUM::INTEGRAL, o, 5, Op::INTEGRAL);
+  set(PENTARY_OPS_ENUM::MONTE_CARLO, o, 5, Op::MONTE_CARLO);
+  return table;
+}
+
+inline constexpr std::array<OperatorInfo, 256> OPERATOR_TABLE =
+    makeOperatorTable();
+
+inline const OperatorInfo &operatorInfo(char c) {
+  return OPERATOR_TABLE[static_cast<unsigned char>(c)];
+}
 
 using ExprFuncRet = const std::vector<double> &;
 using ExprFunc = std::function<double(ExprFuncRet)>;
 
-const ExprFunc parseExpression(const char *&ptr) {
+// Cooperative cancellation for the calling thread. The A/P/I loops check the
+// flag on every iteration and return DEFAULT_RESULT once it is set.
+inline thread_local const std::atomic<bool> *cancelToken = nullptr;
+
+inline bool cancelRequested() {
+  return cancelToken != nullptr &&
+         cancelToken->load(std::memory_order_relaxed);
+}
+
+enum class EvalStatus : uint8_t {
+  OK,
+  CANCELLED,
+  ITERATION_LIMIT,
+  INSTRUCTION_LIMIT,
+  DEADLINE,
+  // The static estimate already exceeds the limits; nothing was run.
+  REJECTED
+};
+
+// Limits for one evaluation; zero disables a limit.
+struct EvalLimits {
+  uint64_t maxInstructions = 0;
+  uint64_t maxIterations = 0;
+  std::chrono::nanoseconds timeout{0};
+};
+
+// The clock is read once every this many loop iterations.
+const uint64_t DEADLINE_CHECK_INTERVAL = 1024;
+
+// Usage of one evaluation, charged at loop back-edges. A loop iteration
+// costs one iteration plus the node count of its body.
+struct EvalBudget {
+  EvalLimits limits;
+  std::chrono::steady_clock::time_point deadline;
+  uint64_t instructions = 0;
+  uint64_t iterations = 0;
+  EvalStatus status = EvalStatus::OK;
+
+  EvalBudget(const EvalLimits &l)
+      : limits(l),
+        deadline(l.timeout.count() > 0
+                     ? std::chrono::steady_clock::now() + l.timeout
+                     : std::chrono::steady_clock::time_point::max()) {}
+
+  // Charges `count` iterations of a body of `bodyNodes` nodes.
+  bool step(uint64_t bodyNodes, uint64_t count = 1) {
+    return charge(count, bodyNodes * count);
+  }
+
+  bool charge(uint64_t count, uint64_t work) {
+    uint64_t before = iterations;
+    iterations += count;
+    instructions += work;
+    if (limits.maxIterations && iterations > limits.maxIterations)
+      status = EvalStatus::ITERATION_LIMIT;
+    else if (limits.maxInstructions && instructions > limits.maxInstructions)
+      status = EvalStatus::INSTRUCTION_LIMIT;
+    else if (iterations / DEADLINE_CHECK_INTERVAL !=
+                 before / DEADLINE_CHECK_INTERVAL &&
+             std::chrono::steady_clock::now() > deadline)
+      status = EvalStatus::DEADLINE;
+    return status == EvalStatus::OK;
+  }
+};
+
+inline thread_local EvalBudget *evalBudget = nullptr;
+
+// Called by the A/P/I loops before each iteration, and by Q once for all
+// its samples; true once the loop must stop and return DEFAULT_RESULT.
+inline bool loopInterrupted(uint64_t bodyNodes, uint64_t count = 1) {
+  if (cancelRequested()) {
+    if (evalBudget != nullptr)
+      evalBudget->status = EvalStatus::CANCELLED;
+    return true;
+  }
+  return evalBudget != nullptr && (evalBudget->status != EvalStatus::OK ||
+                                   !evalBudget->step(bodyNodes, count));
+}
+
+// Nodes created by parseExpression on this thread, used to size loop bodies.
+inline thread_local uint64_t parsedNodeCount = 0;
+
+// Hoist loop-invariant subtrees out of A/P/I bodies when parsing on this
+// thread; off gives the plain closures, for comparison.
+inline thread_local bool hoistInvariants = true;
+
+inline const ExprFunc parseExpression(const char *&ptr);
+
+// Worst-case work of an expression, derived from its text without running
+// any loop.
+struct CostEstimate {
+  double iterations = 0;
+  double instructions = 0;
+  // Of the instructions, those calling into libm, which cost several times
+  // more than arithmetic.
+  double mathCalls = 0;
+  // False when a loop bound depends on inputs; the figures then count such
+  // loops as running once.
+  bool bounded = true;
+};
+
+namespace detail {
+struct SubtreeCost {
+  CostEstimate cost;
+  // Loop-free and input-free, so its value can be computed at compile time.
+  bool constant;
+};
+
+inline double constantValue(const char *begin, const char *end) {
+  std::string text(begin, end);
+  const char *ptr = text.c_str();
+  return parseExpression(ptr)({});
+}
+
+// Follows the grammar of parseExpression.
+inline void skipSeparators(const char *&ptr) {
+  while (*ptr == ' ' || *ptr == '\t' || *ptr == '(' || *ptr == ')' ||
+         *ptr == ',')
+    ptr++;
+}
+
+inline bool callsMath(char op) {
+  switch (op) {
+  case UNARY_OPS_ENUM::LOG:
+  case UNARY_OPS_ENUM::LOG2:
+  case UNARY_OPS_ENUM::LOG10:
+  case UNARY_OPS_ENUM::CBRT:
+  case UNARY_OPS_ENUM::SIN:
+  case UNARY_OPS_ENUM::COS:
+  case UNARY_OPS_ENUM::FACTORIAL:
+  case BINARY_OPS_ENUM::POW:
+  case BINARY_OPS_ENUM::LOG_N:
+  case BINARY_OPS_ENUM::MOD:
+  case BINARY_OPS_ENUM::ROUND:
+    return true;
+  default:
+    return false;
+  }
+}
+
+inline SubtreeCost estimateSubtree(const char *&ptr) {
+  skipSeparators(ptr);
+  if (*ptr == '\0')
+    return {{0, 1, 0, true}, true};
+  char op = *ptr++;
+
+  if (op == USER_VARIABLE_IDENT || op == INTERNAL_VARIABLE_IDENT) {
+    std::strtol(ptr, const_cast<char **>(&ptr), 10);
+    return {{0, 1, 0, true}, false};
+  }
+  if (std::isdigit(op) || op == '.' || op == '-') {
+    ptr--;
+    std::strtod(ptr, const_cast<char **>(&ptr));
+    return {{0, 1, 0, true}, true};
+  }
+  const OperatorInfo &info = operatorInfo(op);
+  if (info.kind == TokenKind::CONSTANT)
+    return {{0, 1, 0, true}, true};
+
+  size_t arity = info.arity ? info.arity : 1;
+  const char *starts[5];
+  SubtreeCost children[5];
+  for (size_t i = 0; i < arity; i++) {
+    skipSeparators(ptr);
+    starts[i] = ptr;
+    children[i] = estimateSubtree(ptr);
+  }
+
+  SubtreeCost result{{0, 1, callsMath(op) ? 1.0 : 0.0, true}, true};
+  size_t loopArgs = arity > 3 ? arity - 1 : arity;
+  for (size_t i = 0; i < loopArgs; i++) {
+    result.cost.iterations += children[i].cost.iterations;
+    result.cost.instructions += children[i].cost.instructions;
+    result.cost.mathCalls += children[i].cost.mathCalls;
+    result.cost.bounded &= children[i].cost.bounded;
+    result.constant &= children[i].constant;
+  }
+  if (arity <= 3)
+    return result;
+
+  // Trip count from the bounds, when they are known.
+  double trips = 1;
+  bool known = false;
+  bool sampled = op == PENTARY_OPS_ENUM::INTEGRAL ||
+                 op == PENTARY_OPS_ENUM::MONTE_CARLO;
+  if (sampled && children[2].constant) {
+    trips = std::max(0.0, std::trunc(constantValue(starts[2], starts[3])));
+    known = true;
+  } else if (!sampled && children[0].constant &&
+             children[1].constant) {
+    double lo = constantValue(starts[0], starts[1]);
+    double hi = constantValue(starts[1], starts[2]);
+    trips = hi >= lo ? std::floor(hi - lo) + 1 : 0;
+    known = true;
+  }
+
+  const CostEstimate &body = children[arity - 1].cost;
+  result.cost.iterations += trips * (1 + body.iterations);
+  result.cost.instructions += trips * body.instructions;
+  result.cost.mathCalls += trips * body.mathCalls;
+  result.cost.bounded &= known && body.bounded;
+  result.constant = false;
+  return result;
+}
+} // namespace detail
+
+inline CostEstimate estimateCost(const char *expr) {
+  if (expr == nullptr)
+    return {};
+  return detail::estimateSubtree(expr).cost;
+}
+
+// Internal slots of the running loops. A loop binds its slot in a
+// thread-local frame instead of copying `args`, and every node reads slots
+// from 256 up through that frame first, so nested loops share the caller's
+// vector and allocate nothing.
+namespace detail {
+// Internal slots held in the frame; explicit slot numbers from here up are
+// bound in a list instead.
+const size_t FRAME_SLOTS = 256;
+
+struct SlotFrame {
+  std::array<double, FRAME_SLOTS> values;
+  std::array<uint64_t, FRAME_SLOTS / 64> bound;
+};
+inline thread_local SlotFrame slotFrame{};
+
+struct SlotBinding {
+  size_t index;
+  double value;
+};
+inline thread_local std::vector<SlotBinding> farSlots;
+
+// Internal slots the automatic slot search of a loop looks at.
+const size_t AUTOMATIC_SLOTS = 10;
+// Q keeps its coordinates in the frame.
+static_assert(AUTOMATIC_SLOTS + MONTE_CARLO_MAX_DIMENSIONS <= FRAME_SLOTS);
+
+// The value `args[index]` would hold had the running loops written their
+// slots into a copy of it.
+inline double readSlot(ExprFuncRet args, size_t index) {
+  size_t k = index - INTERNAL_VARIABLE_START;
+  if (k < FRAME_SLOTS) {
+    if ((slotFrame.bound[k / 64] >> (k % 64)) & 1)
+      return slotFrame.values[k];
+  } else if (index >= INTERNAL_VARIABLE_START) {
+    for (size_t b = farSlots.size(); b-- > 0;)
+      if (farSlots[b].index == index)
+        return farSlots[b].value;
+  }
+  return index < args.size() ? args[index] : DEFAULT_RESULT;
+}
+
+// Binds `index` to `value` until the enclosing frame is restored.
+inline void bindSlot(size_t index, double value) {
+  size_t k = index - INTERNAL_VARIABLE_START;
+  if (k < FRAME_SLOTS) {
+    slotFrame.values[k] = value;
+    slotFrame.bound[k / 64] |= 1ull << (k % 64);
+  } else {
+    farSlots.push_back({index, value});
+  }
+}
+
+// The internal slot a loop asking for `requested` runs in: that one, or
+// for a negative request the first free one of the automatic slots.
+inline size_t loopSlot(ExprFuncRet args, int requested) {
+  if (requested >= 0)
+    return INTERNAL_VARIABLE_START + requested;
+  size_t slot = 0;
+  while (slot < AUTOMATIC_SLOTS &&
+         readSlot(args, INTERNAL_VARIABLE_START + slot) != DEFAULT_RESULT)
+    slot++;
+  return INTERNAL_VARIABLE_START + slot;
+}
+
+// Binds the slot of one loop while in scope, restoring what it shadowed.
+class SlotScope {
+private:
+  size_t k;
+  double shadowed = 0;
+  bool wasBound = false;
+
+public:
+  SlotScope(size_t index, double value) : k(index - INTERNAL_VARIABLE_START) {
+    if (k < FRAME_SLOTS) {
+      shadowed = slotFrame.values[k];
+      wasBound = (slotFrame.bound[k / 64] >> (k % 64)) & 1;
+    }
+    bindSlot(index, value);
+  }
+  ~SlotScope() {
+    if (k >= FRAME_SLOTS) {
+      farSlots.pop_back();
+      return;
+    }
+    slotFrame.values[k] = shadowed;
+    if (!wasBound)
+      slotFrame.bound[k / 64] &= ~(1ull << (k % 64));
+  }
+  SlotScope(const SlotScope &) = delete;
+  SlotScope &operator=(const SlotScope &) = delete;
+
+  // Inner scopes have ended by the time their loop steps.
+  void set(double value) {
+    if (k < FRAME_SLOTS)
+      slotFrame.values[k] = value;
+    else
+      farSlots.back().value = value;
+  }
+};
+} // namespace detail
+
+// Loop-invariant code motion. Every subtree carries the set of internal
+// slots it reads. A subtree of an A/P/I body that can be cheaper than its
+// parent, because it misses one of the parent's slots, becomes a candidate
+// of that loop. On entry the loop evaluates each candidate that does not read
+// its own slot into a frame, and the body reads the frame on every
+// iteration. Nested loops keep their own candidates, so a subtree is
+// hoisted out of the innermost loop it is invariant in, and a whole inner
+// loop out of the outer one. ? evaluates both branches, so they hoist like
+// any operand; Q bodies, which run on other threads, do not.
+namespace detail {
+// At most this many candidates per loop; the rest are left in place.
+const size_t MAX_HOISTED = 64;
+
+// Internal slots read by the subtree parseExpression last returned, one bit
+// per slot, the last bit standing for every slot from 63 up.
+inline thread_local uint64_t parsedSlots = 0;
+
+inline uint64_t slotBit(size_t index) {
+  if (index < INTERNAL_VARIABLE_START)
+    return 0;
+  return 1ull << std::min<size_t>(index - INTERNAL_VARIABLE_START, 63);
+}
+
+struct Operand {
+  ExprFunc func;
+  uint64_t slots;
+  uint64_t nodes;
+};
+
+inline Operand parseOperand(const char *&ptr) {
+  uint64_t start = parsedNodeCount;
+  ExprFunc func = parseExpression(ptr);
+  return {std::move(func), parsedSlots, parsedNodeCount - start};
+}
+
+struct HoistCandidate {
+  std::shared_ptr<const ExprFunc> func;
+  uint64_t slots;
+};
+
+// Candidates of the body being parsed; inactive levels collect none.
+struct HoistLevel {
+  std::vector<HoistCandidate> candidates;
+  bool active;
+};
+inline thread_local std::vector<HoistLevel> hoistLevels;
+
+// Values of the running loops' candidates, innermost frame last.
+struct HoistFrame {
+  size_t base;
+  uint64_t hoisted;
+};
+inline thread_local std::vector<HoistFrame> hoistFrames;
+inline thread_local std::vector<double> hoistValues;
+
+// Registers `operand` with the body being parsed if it can be hoisted where
+// its parent, reading `parentSlots`, cannot.
+inline ExprFunc hoistable(const Operand &operand, uint64_t parentSlots) {
+  if (!hoistInvariants || hoistLevels.empty() || !hoistLevels.back().active ||
+      operand.nodes < 2 || (parentSlots & ~operand.slots) == 0 ||
+      hoistLevels.back().candidates.size() >= MAX_HOISTED)
+    return operand.func;
+  std::vector<HoistCandidate> &candidates = hoistLevels.back().candidates;
+  size_t k = candidates.size();
+  auto func = std::make_shared<const ExprFunc>(operand.func);
+  candidates.push_back({func, operand.slots});
+  return [func, k](ExprFuncRet args) {
+    const HoistFrame &frame = hoistFrames.back();
+    return (frame.hoisted >> k) & 1 ? hoistValues[frame.base + k]
+                                    : (*func)(args);
+  };
+}
+
+// Parses a loop body as a level of its own.
+inline Operand parseLevel(const char *&ptr, bool active,
+                          std::vector<HoistCandidate> *candidates = nullptr) {
+  hoistLevels.push_back({{}, active});
+  Operand operand = parseOperand(ptr);
+  operand.func = hoistable(operand, ~0ull);
+  if (candidates != nullptr)
+    *candidates = std::move(hoistLevels.back().candidates);
+  hoistLevels.pop_back();
+  return operand;
+}
+
+// Fills a frame with the candidates that do not read the loop's slot, for as
+// long as the loop runs. `args` must already hold a value in that slot, so
+// nested automatic slots resolve as they do inside the body.
+class HoistScope {
+private:
+  bool pushed = false;
+
+public:
+  HoistScope(const std::vector<HoistCandidate> &candidates,
+             size_t internalIndex, ExprFuncRet args) {
+    if (candidates.empty())
+      return;
+    uint64_t bit = slotBit(internalIndex);
+    size_t base = hoistValues.size();
+    hoistValues.resize(base + candidates.size());
+    hoistFrames.push_back({base, 0});
+    pushed = true;
+    for (size_t k = 0; k < candidates.size(); k++) {
+      if (candidates[k].slots & bit)
+        continue;
+      double value = (*candidates[k].func)(args);
+      hoistValues[base + k] = value;
+      hoistFrames.back().hoisted |= 1ull << k;
+    }
+  }
+  ~HoistScope() {
+    if (!pushed)
+      return;
+    hoistValues.resize(hoistFrames.back().base);
+    hoistFrames.pop_back();
+  }
+  HoistScope(const HoistScope &) = delete;
+  HoistScope &operator=(const HoistScope &) = delete;
+};
+} // namespace detail
+
+// Caching of expensive subtrees across evaluations. A top-level A/P/I/Q
+// loop whose estimate reaches the threshold keeps a small cache of its
+// results, keyed on the exact bits of every slot its text reads, including
+// the internal slots its automatic slot search looks at. Loops inside loop
+// bodies are left alone: their keys change every iteration, and the
+// invariant ones are hoisted instead.
+struct MemoOptions {
+  // Applies to expressions parsed on this thread while set.
+  bool enabled = true;
+  // Loops estimated below this many instructions run uncached.
+  double minInstructions = 1000;
+  // Trips a loop whose bounds depend on inputs is assumed to run at least,
+  // so only those with costly bodies are cached.
+  double assumedTrips = 100;
+  // Results kept per loop, evicted by CLOCK.
+  size_t capacity = 64;
+};
+
+inline thread_local MemoOptions memoOptions;
+
+// Process-wide cache activity, readable while evaluations run.
+struct MemoCounters {
+  std::atomic<uint64_t> caches{0};
+  std::atomic<uint64_t> hits{0};
+  std::atomic<uint64_t> misses{0};
+  std::atomic<uint64_t> evictions{0};
+
+  double hitRate() const {
+    uint64_t h = hits, total = h + misses;
+    return total ? static_cast<double>(h) / total : 0.0;
+  }
+};
+
+inline MemoCounters memoCounters;
+
+namespace detail {
+// Loop bodies around the subtree being parsed.
+inline thread_local size_t loopBodyDepth = 0;
+
+// True if the loop whose text starts at `start` should be cached. Runs
+// before its operands are parsed, since the estimate parses constant
+// bounds itself.
+inline bool worthMemoizing(const char *start) {
+  if (!memoOptions.enabled || memoOptions.capacity == 0 || loopBodyDepth > 0)
+    return false;
+  uint64_t nodes = parsedNodeCount;
+  hoistLevels.push_back({{}, false});
+  CostEstimate cost = estimateCost(start);
+  hoistLevels.pop_back();
+  parsedNodeCount = nodes;
+  double instructions = cost.bounded
+                            ? cost.instructions
+                            : cost.instructions * memoOptions.assumedTrips;
+  return instructions >= memoOptions.minInstructions;
+}
+
+// The slots read by the text in [begin, end), resolved as the $ and @
+// nodes resolve them.
+inline std::vector<size_t> memoInputs(const char *begin, const char *end) {
+  std::vector<size_t> inputs;
+  for (size_t s = 0; s < AUTOMATIC_SLOTS; s++)
+    inputs.push_back(INTERNAL_VARIABLE_START + s);
+  for (const char *p = begin; p < end; p++) {
+    if (*p != USER_VARIABLE_IDENT && *p != INTERNAL_VARIABLE_IDENT)
+      continue;
+    int n = static_cast<int>(std::strtol(p + 1, nullptr, 10));
+    if (*p == INTERNAL_VARIABLE_IDENT)
+      inputs.push_back(INTERNAL_VARIABLE_START + n);
+    else if (n >= 0)
+      inputs.push_back(static_cast<size_t>(n));
+  }
+  std::sort(inputs.begin(), inputs.end());
+  inputs.erase(std::unique(inputs.begin(), inputs.end()), inputs.end());
+  return inputs;
+}
+
+// Results of one loop, shared by the copies of its closure and by every
+// thread evaluating them.
+class MemoCache {
+private:
+  // Recorded when the result was computed under a budget, so hits can
+  // charge the same usage; otherwise only unbudgeted evaluations use it.
+  struct Usage {
+    uint64_t iterations;
+    uint64_t instructions;
+    bool known;
+  };
+
+  std::vector<size_t> inputs;
+  size_t capacity;
+  std::mutex mutex;
+  size_t size = 0;
+  size_t hand = 0;
+  std::vector<uint64_t> hashes;
+  // `inputs.size()` words per entry.
+  std::vector<uint64_t> keys;
+  std::vector<double> values;
+  std::vector<Usage> usage;
+  std::vector<bool> referenced;
+
+  static std::vector<uint64_t> &scratch() {
+    static thread_local std::vector<uint64_t> key;
+    return key;
+  }
+
+  uint64_t makeKey(ExprFuncRet args, std::vector<uint64_t> &key) const {
+    key.resize(inputs.size());
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < inputs.size(); i++) {
+      key[i] = std::bit_cast<uint64_t>(readSlot(args, inputs[i]));
+      hash = (hash ^ key[i]) * 0x100000001b3ull;
+      hash ^= hash >> 29;
+    }
+    return hash;
+  }
+
+  // Index of the entry holding `key`, or `size` if there is none.
+  size_t find(uint64_t hash, const std::vector<uint64_t> &key) const {
+    for (size_t e = 0; e < size; e++)
+      if (hashes[e] == hash &&
+          std::equal(key.begin(), key.end(),
+                     keys.begin() + e * inputs.size()))
+        return e;
+    return size;
+  }
+
+  void store(uint64_t hash, const std::vector<uint64_t> &key, double value,
+             const Usage &used) {
+    size_t e = find(hash, key);
+    if (e == size) {
+      if (size < capacity) {
+        size++;
+      } else {
+        while (referenced[hand]) {
+          referenced[hand] = false;
+          hand = (hand + 1) % capacity;
+        }
+        e = hand;
+        hand = (hand + 1) % capacity;
+        memoCounters.evictions++;
+      }
+    }
+    hashes[e] = hash;
+    std::copy(key.begin(), key.end(), keys.begin() + e * inputs.size());
+    values[e] = value;
+    usage[e] = used;
+    referenced[e] = false;
+  }
+
+public:
+  MemoCache(std::vector<size_t> in, size_t cap)
+      : inputs(std::move(in)), capacity(cap), hashes(cap),
+        keys(cap * inputs.size()), values(cap), usage(cap), referenced(cap) {
+    memoCounters.caches++;
+  }
+
+  double eval(const ExprFunc &func, ExprFuncRet args) {
+    // Interrupted evaluations run the loop, which stops at once.
+    if (cancelRequested() ||
+        (evalBudget != nullptr && evalBudget->status != EvalStatus::OK))
+      return func(args);
+
+    std::vector<uint64_t> &key = scratch();
+    uint64_t hash = makeKey(args, key);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      size_t e = find(hash, key);
+      if (e < size && (evalBudget == nullptr || usage[e].known)) {
+        referenced[e] = true;
+        double value = values[e];
+        Usage used = usage[e];
+        memoCounters.hits++;
+        if (evalBudget != nullptr &&
+            !evalBudget->charge(used.iterations, used.instructions))
+          return DEFAULT_RESULT;
+        return value;
+      }
+    }
+    memoCounters.misses++;
+
+    EvalBudget *budget = evalBudget;
+    Usage used{0, 0, budget != nullptr};
+    if (budget != nullptr) {
+      used.iterations = budget->iterations;
+      used.instructions = budget->instructions;
+    }
+    double value = func(args);
+    if (cancelRequested() ||
+        (budget != nullptr && budget->status != EvalStatus::OK))
+      return value;
+    if (budget != nullptr) {
+      used.iterations = budget->iterations - used.iterations;
+      used.instructions = budget->instructions - used.instructions;
+    }
+    // The loop may have evaluated other cached loops into `key`.
+    hash = makeKey(args, key);
+    std::lock_guard<std::mutex> lock(mutex);
+    store(hash, key, value, used);
+    return value;
+  }
+};
+
+inline ExprFunc memoized(ExprFunc func, const char *begin, const char *end) {
+  auto cache = std::make_shared<MemoCache>(memoInputs(begin, end),
+                                           memoOptions.capacity);
+  return [func = std::move(func), cache](ExprFuncRet args) {
+    return cache->eval(func, args);
+  };
+}
+} // namespace detail
+
+inline const ExprFunc parseExpression(const char *&ptr) {
+  FUNCTIONLANG_TRACE_OUTER_SPAN(span, "parseExpression", "compile");
+  parsedNodeCount++;
+  detail::parsedSlots = 0;
   if (ptr == nullptr || *ptr == '\0') {
     return [](ExprFuncRet) { return 0.0f; };
   }
   while (ptr && (*ptr == ' ' || *ptr == '\t' || *ptr == '(' || *ptr == ')'))
     ptr++;
+  const char *start = ptr;
   char op = *ptr++;
 
   if (op == USER_VARIABLE_IDENT) {
@@ -96,6 +884,12 @@ const ExprFunc parseExpression(const char *&ptr) {
 
     // Move the global pointer forward to after the number
     ptr = endPtr;
+    if (index >= 0)
+      detail::parsedSlots = detail::slotBit(static_cast<size_t>(index));
+    if (index >= static_cast<int>(INTERNAL_VARIABLE_START))
+      return [index](ExprFuncRet args) {
+        return detail::readSlot(args, static_cast<size_t>(index));
+      };
 
     return [index](ExprFuncRet args) {
       if (index >= 0 && static_cast<size_t>(index) < args.size()) {
@@ -108,21 +902,21 @@ const ExprFunc parseExpression(const char *&ptr) {
     char *endPtr;
     int depth = static_cast<int>(std::strtol(ptr, &endPtr, 10));
     ptr = endPtr;
+    detail::parsedSlots = detail::slotBit(INTERNAL_VARIABLE_START + depth);
 
     return [depth](ExprFuncRet args) {
-      size_t internalIndex = INTERNAL_VARIABLE_START + depth;
-      return (internalIndex < args.size()) ? args[internalIndex]
-                                           : DEFAULT_RESULT;
+      return detail::readSlot(args, INTERNAL_VARIABLE_START + depth);
     };
   }
 
   if (std::isdigit(op) || op == '.' || op == '-') {
     ptr--;
-    float val = strtof(ptr, const_cast<char **>(&ptr));
+    double val = std::strtod(ptr, const_cast<char **>(&ptr));
     return [val](ExprFuncRet) { return val; };
   }
 
-  if (std::ranges::contains(CONSTS, op)) {
+  const OperatorInfo &info = operatorInfo(op);
+  if (info.kind == TokenKind::CONSTANT) {
     return [op](ExprFuncRet _) {
       switch (op) {
       case CONSTS_ENUM::PI:
@@ -135,10 +929,11 @@ const ExprFunc parseExpression(const char *&ptr) {
     };
   }
 
-  auto arg1 = parseExpression(ptr);
+  bool memoize = info.arity >= 4 && detail::worthMemoizing(start);
+  detail::Operand operand1 = detail::parseOperand(ptr);
 
-  if (std::ranges::contains(UNARY_OPS, op)) {
-    return [arg1, op](ExprFuncRet args) {
+  if (info.arity == 1) {
+    return [arg1 = operand1.func, op](ExprFuncRet args) {
       auto v1 = arg1(args);
       switch (op) {
       case UNARY_OPS_ENUM::LOG:
@@ -167,10 +962,14 @@ const ExprFunc parseExpression(const char *&ptr) {
         return DEFAULT_RESULT;
       };
     };
-  } else if (std::ranges::contains(BINARY_OPS, op)) {
+  } else if (info.arity == 2) {
     if (*ptr == ',')
       ptr++;
-    auto arg2 = parseExpression(ptr);
+    detail::Operand operand2 = detail::parseOperand(ptr);
+    uint64_t slots = operand1.slots | operand2.slots;
+    auto arg1 = detail::hoistable(operand1, slots);
+    auto arg2 = detail::hoistable(operand2, slots);
+    detail::parsedSlots = slots;
     return [arg1, arg2, op](ExprFuncRet args) {
       auto v1 = arg1(args);
       auto v2 = arg2(args);
@@ -215,13 +1014,18 @@ const ExprFunc parseExpression(const char *&ptr) {
         return DEFAULT_RESULT;
       };
     };
-  } else if (std::ranges::contains(TERNARY_OPS, op)) {
+  } else if (info.arity == 3) {
     if (*ptr == ',')
       ptr++;
-    auto arg2 = parseExpression(ptr);
+    detail::Operand operand2 = detail::parseOperand(ptr);
     if (*ptr == ',')
       ptr++;
-    auto arg3 = parseExpression(ptr);
+    detail::Operand operand3 = detail::parseOperand(ptr);
+    uint64_t slots = operand1.slots | operand2.slots | operand3.slots;
+    auto arg1 = detail::hoistable(operand1, slots);
+    auto arg2 = detail::hoistable(operand2, slots);
+    auto arg3 = detail::hoistable(operand3, slots);
+    detail::parsedSlots = slots;
     return [arg1, arg2, arg3, op](ExprFuncRet args) {
       auto v1 = arg1(args);
       auto v2 = arg2(args);
@@ -233,18 +1037,30 @@ const ExprFunc parseExpression(const char *&ptr) {
         return DEFAULT_RESULT;
       };
     };
-  } else if (std::ranges::contains(QUATERNARY_OPS, op)) {
+  } else if (info.arity == 4) {
     if (*ptr == ',')
       ptr++;
-    auto arg2 = parseExpression(ptr);
+    detail::Operand operand2 = detail::parseOperand(ptr);
     if (*ptr == ',')
       ptr++;
-    auto arg3 = parseExpression(ptr);
+    detail::Operand operand3 = detail::parseOperand(ptr);
     if (*ptr == ',')
       ptr++;
-    auto arg4 = parseExpression(ptr);
+    std::vector<detail::HoistCandidate> hoisted;
+    detail::loopBodyDepth++;
+    detail::Operand body = detail::parseLevel(ptr, true, &hoisted);
+    detail::loopBodyDepth--;
+    uint64_t bodyNodes = body.nodes;
+    uint64_t slots =
+        operand1.slots | operand2.slots | operand3.slots | body.slots;
+    auto arg1 = detail::hoistable(operand1, slots);
+    auto arg2 = detail::hoistable(operand2, slots);
+    auto arg3 = detail::hoistable(operand3, slots);
+    auto arg4 = body.func;
+    detail::parsedSlots = slots;
 
-    return [arg1, arg2, arg3, arg4, op](ExprFuncRet args) {
+    ExprFunc loop = [arg1, arg2, arg3, arg4, op, bodyNodes,
+                     hoisted](ExprFuncRet args) {
       auto v1 = arg1(args);
       auto v2 = arg2(args);
       auto v3 = arg3(args);
@@ -253,36 +1069,25 @@ const ExprFunc parseExpression(const char *&ptr) {
       case QUATERNARY_OPS_ENUM::PRODUCT: {
         double total = (op == QUATERNARY_OPS_ENUM::SUMMATION) ? 0.0 : 1.0;
 
-        std::vector<double> localArgs = args;
-
-        // Sutomatic Slot Detection
         // If v3 is negative, find the first unused slot, else use the user
         // provided slot
-        int slot = static_cast<int>(v3);
-        if (slot < 0) {
-          slot = 0;
-          // Ensure space for at least 10 internal slots
-          if (localArgs.size() < INTERNAL_VARIABLE_START + 10)
-            localArgs.resize(INTERNAL_VARIABLE_START + 10,
-                             -std::numeric_limits<double>::max());
-
-          while (slot < 10 && localArgs[INTERNAL_VARIABLE_START + slot] !=
-                                  -std::numeric_limits<double>::max()) {
-            slot++;
-          }
-        }
-
-        size_t internalIndex = INTERNAL_VARIABLE_START + slot;
-        if (localArgs.size() <= internalIndex)
-          localArgs.resize(internalIndex + 1,
-                           -std::numeric_limits<double>::max());
-
+        size_t internalIndex = detail::loopSlot(args, static_cast<int>(v3));
+        if (!(v1 <= v2))
+          return total;
+        FUNCTIONLANG_TRACE_SPAN(
+            span, op == QUATERNARY_OPS_ENUM::SUMMATION ? "A" : "P", "eval");
+        FUNCTIONLANG_TRACE_ARG(
+            span, "trips", static_cast<uint64_t>(std::min(v2 - v1, 1e18)) + 1);
+        detail::SlotScope counter(internalIndex, v1);
+        detail::HoistScope invariants(hoisted, internalIndex, args);
         for (double i = v1; i <= v2; ++i) {
-          localArgs[internalIndex] = i;
+          if (loopInterrupted(bodyNodes))
+            return DEFAULT_RESULT;
+          counter.set(i);
           if (op == QUATERNARY_OPS_ENUM::SUMMATION)
-            total += arg4(localArgs);
+            total += arg4(args);
           else
-            total *= arg4(localArgs);
+            total *= arg4(args);
         }
         return total;
       }
@@ -290,21 +1095,37 @@ const ExprFunc parseExpression(const char *&ptr) {
         return DEFAULT_RESULT;
       };
     };
-  } else if (std::ranges::contains(PENTARY_OPS, op)) {
+    return memoize ? detail::memoized(std::move(loop), start, ptr) : loop;
+  } else if (info.arity == 5) {
     if (*ptr == ',')
       ptr++;
-    auto arg2 = parseExpression(ptr);
+    detail::Operand operand2 = detail::parseOperand(ptr);
     if (*ptr == ',')
       ptr++;
-    auto arg3 = parseExpression(ptr);
+    detail::Operand operand3 = detail::parseOperand(ptr);
     if (*ptr == ',')
       ptr++;
-    auto arg4 = parseExpression(ptr);
+    detail::Operand operand4 = detail::parseOperand(ptr);
     if (*ptr == ',')
       ptr++;
-    auto arg5 = parseExpression(ptr);
+    // Q bodies run on other threads and keep their subtrees in place.
+    std::vector<detail::HoistCandidate> hoisted;
+    detail::loopBodyDepth++;
+    detail::Operand body = detail::parseLevel(
+        ptr, op == PENTARY_OPS_ENUM::INTEGRAL, &hoisted);
+    detail::loopBodyDepth--;
+    uint64_t bodyNodes = body.nodes;
+    uint64_t slots = operand1.slots | operand2.slots | operand3.slots |
+                     operand4.slots | body.slots;
+    auto arg1 = detail::hoistable(operand1, slots);
+    auto arg2 = detail::hoistable(operand2, slots);
+    auto arg3 = detail::hoistable(operand3, slots);
+    auto arg4 = detail::hoistable(operand4, slots);
+    auto arg5 = body.func;
+    detail::parsedSlots = slots;
 
-    return [arg1, arg2, arg3, arg4, arg5, op](ExprFuncRet args) {
+    ExprFunc loop = [arg1, arg2, arg3, arg4, arg5, op, bodyNodes,
+                     hoisted](ExprFuncRet args) {
       double v1 = arg1(args);
       double v2 = arg2(args);
       double v3 = arg3(args);
@@ -320,45 +1141,119 @@ const ExprFunc parseExpression(const char *&ptr) {
         if (n <= 0)
           return 0.0;
 
-        std::vector<double> localArgs = args;
-
-        int slot = requestedSlot;
-        if (slot < 0) {
-          slot = 0;
-
-          if (localArgs.size() < INTERNAL_VARIABLE_START + 10)
-            localArgs.resize(INTERNAL_VARIABLE_START + 10,
-                             -std::numeric_limits<double>::max());
-
-          while (slot < 10 && localArgs[INTERNAL_VARIABLE_START + slot] !=
-                                  -std::numeric_limits<double>::max()) {
-            slot++;
-          }
-        }
-        size_t internalIndex = INTERNAL_VARIABLE_START + slot;
-        if (localArgs.size() <= internalIndex)
-          localArgs.resize(internalIndex + 1,
-                           -std::numeric_limits<double>::max());
-
+        FUNCTIONLANG_TRACE_SPAN(span, "I", "eval");
+        FUNCTIONLANG_TRACE_ARG(span, "steps", static_cast<uint64_t>(n));
+        size_t internalIndex = detail::loopSlot(args, requestedSlot);
         double total = 0.0;
         double dx = (b - a) / n;
 
+        detail::SlotScope x(internalIndex, a + 0.5 * dx);
+        detail::HoistScope invariants(hoisted, internalIndex, args);
         for (int i = 0; i < n; ++i) {
+          if (loopInterrupted(bodyNodes))
+            return DEFAULT_RESULT;
           // midpoint: x = a + (i + 0.5) * dx
-          localArgs[internalIndex] = a + (i + 0.5) * dx;
-          total += arg5(localArgs);
+          x.set(a + (i + 0.5) * dx);
+          total += arg5(args);
         }
         return total * dx;
       }
+      case PENTARY_OPS_ENUM::MONTE_CARLO: {
+        // Q lo,hi,n,d,body: n samples of the cube [lo, hi]^d, with the
+        // coordinates in the d internal slots from the first free one.
+        if (v3 < 1 || v4 < 1 || v4 > MONTE_CARLO_MAX_DIMENSIONS)
+          return 0.0;
+        uint64_t samples = static_cast<uint64_t>(v3);
+        size_t dims = static_cast<size_t>(v4);
+        if (loopInterrupted(bodyNodes, samples))
+          return DEFAULT_RESULT;
+        FUNCTIONLANG_TRACE_SPAN(span, "Q", "eval");
+        FUNCTIONLANG_TRACE_ARG(span, "samples", samples);
+
+        size_t first = detail::loopSlot(args, -1);
+
+        // Workers share the caller's cancellation and the slots of the
+        // loops around Q; the samples were charged to its budget above.
+        const std::atomic<bool> *token = cancelToken;
+        const detail::SlotFrame outer = detail::slotFrame;
+        const std::vector<detail::SlotBinding> outerFar = detail::farSlots;
+        auto makeEvaluator = [&] {
+          return [&args, &outer, &outerFar, &arg5, first, dims,
+                  token](const double *points, size_t count, double *values) {
+            const std::atomic<bool> *savedToken = cancelToken;
+            EvalBudget *savedBudget = evalBudget;
+            detail::SlotFrame savedFrame = detail::slotFrame;
+            std::vector<detail::SlotBinding> savedFar =
+                std::move(detail::farSlots);
+            cancelToken = token;
+            evalBudget = nullptr;
+            detail::slotFrame = outer;
+            detail::farSlots = outerFar;
+            for (size_t d = 0; d < dims; d++)
+              detail::bindSlot(first + d, 0.0);
+            double *coordinates =
+                &detail::slotFrame.values[first - INTERNAL_VARIABLE_START];
+            for (size_t p = 0; p < count; p++) {
+              std::copy(points + p * dims, points + (p + 1) * dims,
+                        coordinates);
+              values[p] = arg5(args);
+            }
+            detail::slotFrame = savedFrame;
+            detail::farSlots = std::move(savedFar);
+            cancelToken = savedToken;
+            evalBudget = savedBudget;
+          };
+        };
+        IntegrationResult result = integrateBox(
+            std::vector<double>(dims, v1), std::vector<double>(dims, v2),
+            samples, {}, makeEvaluator, token);
+        return result.complete && !cancelRequested() ? result.value
+                                                     : DEFAULT_RESULT;
+      }
       default:
         return DEFAULT_RESULT;
       }
     };
+    return memoize ? detail::memoized(std::move(loop), start, ptr) : loop;
   }
 
   return [](ExprFuncRet) { return DEFAULT_RESULT; };
 }
 
+// True if a bounded estimate shows the limits cannot be met.
+inline bool exceedsLimits(const CostEstimate &cost, const EvalLimits &limits) {
+  return cost.bounded &&
+         ((limits.maxIterations && cost.iterations > limits.maxIterations) ||
+          (limits.maxInstructions &&
+           cost.instructions > limits.maxInstructions));
+}
+
+// Runs a compiled expression under `limits`. On any status but OK the result
+// is DEFAULT_RESULT and must not be used.
+inline EvalStatus evaluateBounded(const ExprFunc &func, ExprFuncRet args,
+                                  const EvalLimits &limits, double &result) {
+  FUNCTIONLANG_TRACE_SPAN(span, "evaluateBounded", "eval");
+  EvalBudget budget(limits);
+  EvalBudget *outer = evalBudget;
+  evalBudget = &budget;
+  result = func(args);
+  evalBudget = outer;
+  if (budget.status == EvalStatus::OK && cancelRequested())
+    budget.status = EvalStatus::CANCELLED;
+  return budget.status;
+}
+
+// Estimates, compiles and runs `expr`, rejecting it up front when the
+// estimate shows it cannot finish within `limits`.
+inline EvalStatus evaluateBounded(const char *expr, ExprFuncRet args,
+                                  const EvalLimits &limits, double &result) {
+  if (exceedsLimits(estimateCost(expr), limits)) {
+    result = DEFAULT_RESULT;
+    return EvalStatus::REJECTED;
+  }
+  return evaluateBounded(parseExpression(expr), args, limits, result);
+}
+
 // !!! V2 !!!
 
 } // namespace functionlang
@@ -0,0 +1,566 @@
+#pragma once
+#include <functionlang.hpp>
+
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Evaluation daemon speaking a compact binary protocol over a Unix socket.
+//
+// Every frame starts with a u32 length covering the rest of the frame, a u8
+// message type and a u32 tag echoed back in the response. Responses add a u8
+// status before their body. Integers and doubles use host byte order, as
+// both ends share a machine.
+//
+//   REGISTER    body: expression bytes            -> u32 handle
+//   EVAL        body: u32 handle, u32 n, n f64    -> f64 result
+//   EVAL_BATCH  body: u32 handle, u32 rows, u32 cols, rows*cols f64
+//                                                 -> u32 rows, rows f64
+//
+// A client may send any number of frames before reading; responses on one
+// connection come back in request order. REGISTER answers REJECTED when the
+// expression's static cost exceeds the server's limits, and evaluations
+// that hit a limit at runtime answer LIMIT_EXCEEDED. The server keeps a
+// bounded number of programs; evaluating one it has evicted answers EVICTED.
+namespace functionlang::daemon {
+
+enum class MessageType : uint8_t { REGISTER = 1, EVAL = 2, EVAL_BATCH = 3 };
+enum class Status : uint8_t {
+  OK = 0,
+  BAD_REQUEST = 1,
+  UNKNOWN_HANDLE = 2,
+  REJECTED = 3,
+  LIMIT_EXCEEDED = 4,
+  // The handle's program was evicted from the cache; register it again.
+  EVICTED = 5
+};
+
+const uint32_t MAX_FRAME = 64u << 20;
+const size_t REQUEST_HEADER = 9;
+const size_t RESPONSE_HEADER = 10;
+
+template <typename T> void put(std::string &buf, T v) {
+  buf.append(reinterpret_cast<const char *>(&v), sizeof v);
+}
+
+template <typename T> T get(const char *p) {
+  T v;
+  std::memcpy(&v, p, sizeof v);
+  return v;
+}
+
+inline std::string encodeEval(uint32_t handle,
+                              const std::vector<double> &args) {
+  std::string body;
+  put(body, handle);
+  put(body, static_cast<uint32_t>(args.size()));
+  body.append(reinterpret_cast<const char *>(args.data()),
+              args.size() * sizeof(double));
+  return body;
+}
+
+inline std::string encodeBatch(uint32_t handle, uint32_t cols,
+                               const std::vector<double> &rows) {
+  std::string body;
+  put(body, handle);
+  put(body, static_cast<uint32_t>(cols ? rows.size() / cols : 0));
+  put(body, cols);
+  body.append(reinterpret_cast<const char *>(rows.data()),
+              rows.size() * sizeof(double));
+  return body;
+}
+
+// Programs a server keeps compiled unless told otherwise.
+const size_t DEFAULT_PROGRAM_CAPACITY = 4096;
+
+// Compiled programs shared by every worker, keyed on the expression text so
+// identical registrations from different clients get the same handle. At
+// most `capacity` programs are kept; past that, registering evicts one not
+// used since the CLOCK hand last passed it, and its handle answers EVICTED.
+// Handles are never reused.
+class ProgramCache {
+private:
+  struct Entry {
+    uint32_t handle;
+    std::string expr;
+    std::shared_ptr<const ExprFunc> func;
+    std::atomic<bool> referenced{true};
+  };
+
+  std::shared_mutex mutex;
+  size_t capacity;
+  std::vector<std::unique_ptr<Entry>> entries;
+  std::unordered_map<std::string, size_t> bySource;
+  std::unordered_map<uint32_t, size_t> byHandle;
+  size_t hand = 0;
+  uint32_t nextHandle = 0;
+
+  // The entry a new program replaces; called with the lock held exclusively.
+  size_t victim() {
+    while (entries[hand]->referenced.exchange(false, std::memory_order_relaxed))
+      hand = (hand + 1) % entries.size();
+    size_t slot = hand;
+    hand = (hand + 1) % entries.size();
+    return slot;
+  }
+
+public:
+  explicit ProgramCache(size_t maxPrograms = DEFAULT_PROGRAM_CAPACITY)
+      : capacity(std::max<size_t>(1, maxPrograms)) {}
+
+  uint32_t add(const std::string &expr) {
+    {
+      std::shared_lock lock(mutex);
+      if (auto it = bySource.find(expr); it != bySource.end()) {
+        entries[it->second]->referenced.store(true,
+                                              std::memory_order_relaxed);
+        return entries[it->second]->handle;
+      }
+    }
+    const char *ptr = expr.c_str();
+    auto func = std::make_shared<const ExprFunc>(parseExpression(ptr));
+
+    std::unique_lock lock(mutex);
+    if (auto it = bySource.find(expr); it != bySource.end())
+      return entries[it->second]->handle;
+    size_t slot = entries.size();
+    if (entries.size() < capacity) {
+      entries.push_back(std::make_unique<Entry>());
+    } else {
+      slot = victim();
+      bySource.erase(entries[slot]->expr);
+      byHandle.erase(entries[slot]->handle);
+    }
+    Entry &entry = *entries[slot];
+    entry.handle = nextHandle++;
+    entry.expr = expr;
+    entry.func = std::move(func);
+    entry.referenced.store(true, std::memory_order_relaxed);
+    bySource.emplace(expr, slot);
+    byHandle.emplace(entry.handle, slot);
+    return entry.handle;
+  }
+
+  // The program of `handle`, kept alive while the caller evaluates it even
+  // if it is evicted meanwhile; null if unknown or evicted.
+  std::shared_ptr<const ExprFunc> find(uint32_t handle) {
+    std::shared_lock lock(mutex);
+    auto it = byHandle.find(handle);
+    if (it == byHandle.end())
+      return nullptr;
+    Entry &entry = *entries[it->second];
+    entry.referenced.store(true, std::memory_order_relaxed);
+    return entry.func;
+  }
+
+  // True if `handle` was handed out, whether or not it is still kept.
+  bool issued(uint32_t handle) {
+    std::shared_lock lock(mutex);
+    return handle < nextHandle;
+  }
+
+  size_t size() {
+    std::shared_lock lock(mutex);
+    return entries.size();
+  }
+};
+
+class Server {
+private:
+  struct Connection {
+    int fd;
+    std::string in;
+    std::string out;
+    size_t outPos = 0;
+    bool wantWrite = false;
+    std::vector<double> args;
+  };
+
+  std::string path;
+  size_t workerCount;
+  int listenFd = -1;
+  int stopFd = -1;
+  std::atomic<bool> running = false;
+  std::vector<std::thread> workers;
+  ProgramCache cache;
+  EvalLimits limits;
+
+  Status missing(uint32_t handle) {
+    return cache.issued(handle) ? Status::EVICTED : Status::UNKNOWN_HANDLE;
+  }
+
+  void respond(Connection &conn, MessageType type, uint32_t tag,
+               Status status, const std::string &body = {}) {
+    put(conn.out, static_cast<uint32_t>(RESPONSE_HEADER - 4 + body.size()));
+    put(conn.out, static_cast<uint8_t>(type));
+    put(conn.out, tag);
+    put(conn.out, static_cast<uint8_t>(status));
+    conn.out += body;
+  }
+
+  void handleFrame(Connection &conn, MessageType type, uint32_t tag,
+                   const char *body, size_t size) {
+    std::string reply;
+    switch (type) {
+    case MessageType::REGISTER: {
+      std::string expr(body, size);
+      if (exceedsLimits(estimateCost(expr.c_str()), limits))
+        return respond(conn, type, tag, Status::REJECTED);
+      put(reply, cache.add(expr));
+      return respond(conn, type, tag, Status::OK, reply);
+    }
+    case MessageType::EVAL: {
+      if (size < 8)
+        break;
+      uint32_t n = get<uint32_t>(body + 4);
+      if (size != 8 + static_cast<size_t>(n) * sizeof(double))
+        break;
+      uint32_t handle = get<uint32_t>(body);
+      std::shared_ptr<const ExprFunc> func = cache.find(handle);
+      if (func == nullptr)
+        return respond(conn, type, tag, missing(handle));
+      conn.args.resize(n);
+      std::memcpy(conn.args.data(), body + 8, n * sizeof(double));
+      double result;
+      if (evaluateBounded(*func, conn.args, limits, result) != EvalStatus::OK)
+        return respond(conn, type, tag, Status::LIMIT_EXCEEDED);
+      put(reply, result);
+      return respond(conn, type, tag, Status::OK, reply);
+    }
+    case MessageType::EVAL_BATCH: {
+      if (size < 12)
+        break;
+      uint64_t rows = get<uint32_t>(body + 4);
+      uint64_t cols = get<uint32_t>(body + 8);
+      // Bounds rows first so the size product cannot overflow and the reply
+      // stays within one frame.
+      if (rows > MAX_FRAME / sizeof(double) ||
+          size != 12 + rows * cols * sizeof(double))
+        break;
+      uint32_t handle = get<uint32_t>(body);
+      std::shared_ptr<const ExprFunc> func = cache.find(handle);
+      if (func == nullptr)
+        return respond(conn, type, tag, missing(handle));
+      put(reply, static_cast<uint32_t>(rows));
+      conn.args.resize(cols);
+      for (uint64_t r = 0; r < rows; r++) {
+        std::memcpy(conn.args.data(), body + 12 + r * cols * sizeof(double),
+                    cols * sizeof(double));
+        double result;
+        if (evaluateBounded(*func, conn.args, limits, result) !=
+            EvalStatus::OK)
+          return respond(conn, type, tag, Status::LIMIT_EXCEEDED);
+        put(reply, result);
+      }
+      return respond(conn, type, tag, Status::OK, reply);
+    }
+    }
+    respond(conn, type, tag, Status::BAD_REQUEST);
+  }
+
+  // Answers every complete frame in the read buffer; returns false when the
+  // peer sent a frame that cannot be valid.
+  bool processFrames(Connection &conn) {
+    size_t pos = 0;
+    while (conn.in.size() - pos >= 4) {
+      uint32_t length = get<uint32_t>(conn.in.data() + pos);
+      if (length < REQUEST_HEADER - 4 || length > MAX_FRAME)
+        return false;
+      if (conn.in.size() - pos < 4 + static_cast<size_t>(length))
+        break;
+      const char *frame = conn.in.data() + pos;
+      handleFrame(conn, static_cast<MessageType>(get<uint8_t>(frame + 4)),
+                  get<uint32_t>(frame + 5), frame + REQUEST_HEADER,
+                  length - (REQUEST_HEADER - 4));
+      pos += 4 + length;
+    }
+    conn.in.erase(0, pos);
+    return true;
+  }
+
+  bool flush(int epfd, Connection &conn) {
+    while (conn.outPos < conn.out.size()) {
+      ssize_t n = ::send(conn.fd, conn.out.data() + conn.outPos,
+                         conn.out.size() - conn.outPos, MSG_NOSIGNAL);
+      if (n < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+          break;
+        if (errno == EINTR)
+          continue;
+        return false;
+      }
+      conn.outPos += static_cast<size_t>(n);
+    }
+    if (conn.outPos == conn.out.size()) {
+      conn.out.clear();
+      conn.outPos = 0;
+    }
+    bool wantWrite = !conn.out.empty();
+    if (wantWrite != conn.wantWrite) {
+      epoll_event ev{};
+      ev.events = EPOLLIN | EPOLLRDHUP;
+      if (wantWrite)
+        ev.events |= EPOLLOUT;
+      ev.data.fd = conn.fd;
+      epoll_ctl(epfd, EPOLL_CTL_MOD, conn.fd, &ev);
+      conn.wantWrite = wantWrite;
+    }
+    return true;
+  }
+
+  bool readAll(Connection &conn) {
+    char buf[16384];
+    while (true) {
+      ssize_t n = ::recv(conn.fd, buf, sizeof buf, 0);
+      if (n > 0) {
+        conn.in.append(buf, static_cast<size_t>(n));
+        continue;
+      }
+      if (n == 0)
+        return false;
+      if (errno == EINTR)
+        continue;
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+  }
+
+  void acceptAll(int epfd, std::unordered_map<int, Connection> &conns) {
+    while (true) {
+      int fd = accept4(listenFd, nullptr, nullptr,
+                       SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if (fd < 0)
+        return;
+      epoll_event ev{};
+      ev.events = EPOLLIN | EPOLLRDHUP;
+      ev.data.fd = fd;
+      if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        close(fd);
+        continue;
+      }
+      conns.emplace(fd, Connection{fd, {}, {}, 0, false, {}});
+    }
+  }
+
+  void workerLoop() {
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0)
+      return;
+    epoll_event ev{};
+    // EPOLLEXCLUSIVE wakes one worker per incoming connection.
+    ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+    ev.data.fd = listenFd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, listenFd, &ev);
+    ev.events = EPOLLIN;
+    ev.data.fd = stopFd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, stopFd, &ev);
+
+    std::unordered_map<int, Connection> conns;
+    epoll_event events[64];
+    while (running) {
+      int count = epoll_wait(epfd, events, 64, -1);
+      for (int i = 0; i < count; i++) {
+        int fd = events[i].data.fd;
+        if (fd == stopFd)
+          continue;
+        if (fd == listenFd) {
+          acceptAll(epfd, conns);
+          continue;
+        }
+        auto it = conns.find(fd);
+        if (it == conns.end())
+          continue;
+        Connection &conn = it->second;
+        bool alive = !(events[i].events & EPOLLERR);
+        if (alive && (events[i].events & (EPOLLIN | EPOLLRDHUP))) {
+          // Answer frames that arrived before end of stream, then close.
+          bool open = readAll(conn);
+          alive = processFrames(conn) && open;
+        }
+        if (!flush(epfd, conn) || !alive) {
+          close(fd);
+          conns.erase(it);
+        }
+      }
+    }
+    for (auto &[fd, conn] : conns)
+      close(fd);
+    close(epfd);
+  }
+
+public:
+  // Every evaluation runs under `evalLimits`, applied per row in batches.
+  // At most `maxPrograms` compiled programs are kept.
+  Server(std::string socketPath, size_t workers = 0,
+         const EvalLimits &evalLimits = {},
+         size_t maxPrograms = DEFAULT_PROGRAM_CAPACITY)
+      : path(std::move(socketPath)),
+        workerCount(workers ? workers
+                            : std::max(1u, std::thread::hardware_concurrency())),
+        cache(maxPrograms), limits(evalLimits) {}
+
+  ~Server() { stop(); }
+
+  bool start() {
+    sockaddr_un addr{};
+    if (path.size() >= sizeof addr.sun_path)
+      return false;
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd < 0)
+      return false;
+    unlink(path.c_str());
+    if (bind(listenFd, reinterpret_cast<sockaddr *>(&addr), sizeof addr) < 0 ||
+        listen(listenFd, SOMAXCONN) < 0) {
+      close(listenFd);
+      listenFd = -1;
+      return false;
+    }
+    stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    running = true;
+    for (size_t i = 0; i < workerCount; i++)
+      workers.emplace_back(&Server::workerLoop, this);
+    return true;
+  }
+
+  void stop() {
+    if (!running.exchange(false))
+      return;
+    uint64_t one = 1;
+    [[maybe_unused]] ssize_t n = write(stopFd, &one, sizeof one);
+    for (auto &worker : workers)
+      worker.join();
+    workers.clear();
+    close(listenFd);
+    close(stopFd);
+    listenFd = stopFd = -1;
+    unlink(path.c_str());
+  }
+
+  ProgramCache &programs() { return cache; }
+};
+
+struct Response {
+  MessageType type;
+  uint32_t tag;
+  Status status;
+  std::string body;
+};
+
+// Blocking client. send() may be called repeatedly before receive() to
+// pipeline requests.
+class Client {
+private:
+  int fd = -1;
+  uint32_t nextTag = 0;
+  std::string in;
+
+public:
+  Client() = default;
+  Client(const Client &) = delete;
+  Client &operator=(const Client &) = delete;
+  ~Client() {
+    if (fd >= 0)
+      close(fd);
+  }
+
+  bool connect(const std::string &path) {
+    sockaddr_un addr{};
+    if (path.size() >= sizeof addr.sun_path)
+      return false;
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    return fd >= 0 &&
+           ::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof addr) == 0;
+  }
+
+  // Returns the tag of the queued request.
+  uint32_t send(MessageType type, const std::string &body) {
+    std::string frame;
+    uint32_t tag = nextTag++;
+    put(frame, static_cast<uint32_t>(REQUEST_HEADER - 4 + body.size()));
+    put(frame, static_cast<uint8_t>(type));
+    put(frame, tag);
+    frame += body;
+    size_t pos = 0;
+    while (pos < frame.size()) {
+      ssize_t n = ::send(fd, frame.data() + pos, frame.size() - pos,
+                         MSG_NOSIGNAL);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        break;
+      pos += static_cast<size_t>(n);
+    }
+    return tag;
+  }
+
+  bool receive(Response &response) {
+    char buf[16384];
+    while (in.size() < 4 || in.size() < 4 + get<uint32_t>(in.data())) {
+      ssize_t n = ::recv(fd, buf, sizeof buf, 0);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        return false;
+      in.append(buf, static_cast<size_t>(n));
+    }
+    uint32_t length = get<uint32_t>(in.data());
+    response.type = static_cast<MessageType>(get<uint8_t>(in.data() + 4));
+    response.tag = get<uint32_t>(in.data() + 5);
+    response.status = static_cast<Status>(get<uint8_t>(in.data() + 9));
+    response.body.assign(in.data() + RESPONSE_HEADER,
+                         length + 4 - RESPONSE_HEADER);
+    in.erase(0, 4 + length);
+    return true;
+  }
+
+  bool registerExpression(const std::string &expr, uint32_t &handle) {
+    Response r;
+    send(MessageType::REGISTER, expr);
+    if (!receive(r) || r.status != Status::OK || r.body.size() != 4)
+      return false;
+    handle = get<uint32_t>(r.body.data());
+    return true;
+  }
+
+  bool eval(uint32_t handle, const std::vector<double> &args,
+            double &result) {
+    Response r;
+    send(MessageType::EVAL, encodeEval(handle, args));
+    if (!receive(r) || r.status != Status::OK || r.body.size() != 8)
+      return false;
+    result = get<double>(r.body.data());
+    return true;
+  }
+
+  bool evalBatch(uint32_t handle, uint32_t cols,
+                 const std::vector<double> &rows,
+                 std::vector<double> &results) {
+    Response r;
+    send(MessageType::EVAL_BATCH, encodeBatch(handle, cols, rows));
+    if (!receive(r) || r.status != Status::OK || r.body.size() < 4)
+      return false;
+    uint32_t count = get<uint32_t>(r.body.data());
+    if (r.body.size() != 4 + count * sizeof(double))
+      return false;
+    results.resize(count);
+    std::memcpy(results.data(), r.body.data() + 4, count * sizeof(double));
+    return true;
+  }
+};
+} // namespace functionlang::daemon
@@ -0,0 +1,84 @@
+#pragma once
+#include <functionlangRegister.hpp>
+#include <string>
+
+namespace functionlang {
+
+// Three-address instruction over the kernel's slot file. Leaves store the
+// variable index in src1.
+struct KernelInstr {
+  Op op;
+  uint32_t dst;
+  uint32_t src1;
+  uint32_t src2;
+  uint32_t src3;
+
+  uint32_t immediate() const { return src1; }
+};
+
+// Compiles several expressions into one program with one output each.
+// Identical subtrees, including variable reads, are computed once no matter
+// how many outputs use them. Like the VMs, a kernel evaluates into its own
+// slots and is used by one thread at a time.
+class FunctionKernel {
+private:
+  std::vector<KernelInstr> program;
+  // One slot per distinct node; constant slots are filled at compile time,
+  // so the program holds no PUSH_V.
+  std::vector<double> slots;
+  std::vector<uint32_t> outputs;
+  size_t parsedNodes = 0;
+  bool supported = true;
+
+public:
+  FunctionKernel(const std::vector<std::string> &equations) {
+    FUNCTIONLANG_TRACE_SPAN(span, "FunctionKernel", "compile");
+    ExprTree tree(true);
+    for (const std::string &eq : equations) {
+      const char *ptr = eq.c_str();
+      outputs.push_back(tree.parse(ptr));
+    }
+    supported = !tree.hasError() && !tree.hasLoops;
+    parsedNodes = tree.parsedNodes;
+
+    slots.assign(tree.nodes.size(), 0.0);
+    for (uint32_t n = 0; n < tree.nodes.size(); n++) {
+      const ExprNode &node = tree.nodes[n];
+      if (node.op == Op::PUSH_V)
+        slots[n] = tree.constants[node.operand];
+      else
+        program.push_back({node.op, n,
+                           node.arity ? node.children[0] : node.operand,
+                           node.children[1], node.children[2]});
+    }
+    FUNCTIONLANG_TRACE_ARG(span, "instructions", program.size());
+  }
+
+  // Writes outputCount() results to out, DEFAULT_RESULT for all of them
+  // when the kernel is not supported.
+  void eval(const std::vector<double> &args, double *out) {
+    if (!supported) {
+      std::fill(out, out + outputs.size(), DEFAULT_RESULT);
+      return;
+    }
+    runThreeAddress(program, slots.data(), {}, args);
+    for (size_t i = 0; i < outputs.size(); i++)
+      out[i] = slots[outputs[i]];
+  }
+
+  std::vector<double> eval(const std::vector<double> &args) {
+    std::vector<double> out(outputs.size());
+    eval(args, out.data());
+    return out;
+  }
+
+  size_t outputCount() const { return outputs.size(); }
+  size_t instructionCount() const { return program.size(); }
+  // Distinct nodes after sharing, and nodes across all expressions before.
+  size_t sharedNodeCount() const { return slots.size(); }
+  size_t parsedNodeCount() const { return parsedNodes; }
+  // False when an expression failed to parse or used the A/P/I loops, whose
+  // value the kernel cannot produce.
+  bool isSupported() const { return supported; }
+};
+} // namespace functionlang
@@ -0,0 +1,81 @@
+#pragma once
+#include <functionlangV2.hpp>
+
+#include <memory>
+#include <string>
+
+namespace functionlang {
+
+// Integrates `body` over the box [lo, hi], reading coordinate d from @d and
+// every $n from `args`. The same sampling as the Q operator, but with
+// per-coordinate bounds and an error estimate, and the body compiled once
+// per thread for the lane VM so each batch of points is evaluated in
+// groups of LANES. Bodies the VM cannot run (loops) are evaluated with V1.
+class MonteCarloIntegrator {
+public:
+  static constexpr size_t LANES = 4;
+  using LaneVM = BasicFunctionParserV2<Lanes<double, LANES>>;
+
+private:
+  std::string body;
+  bool vectorised;
+  ExprFunc fallback;
+
+public:
+  MonteCarloIntegrator(std::string expr) : body(std::move(expr)) {
+    vectorised = LaneVM(body.c_str()).isSupported();
+    if (!vectorised) {
+      const char *ptr = body.c_str();
+      fallback = parseExpression(ptr);
+    }
+  }
+
+  IntegrationResult integrate(const std::vector<double> &lo,
+                              const std::vector<double> &hi, uint64_t samples,
+                              std::vector<double> args = {},
+                              IntegrationOptions options = {}) const {
+    size_t dims = lo.size();
+    if (dims > MONTE_CARLO_MAX_DIMENSIONS)
+      return {};
+    args.resize(INTERNAL_VARIABLE_START + dims, DEFAULT_RESULT);
+    const std::atomic<bool> *token = cancelToken;
+
+    if (!vectorised) {
+      auto makeEvaluator = [&] {
+        return [this, local = args, dims, token](const double *points,
+                                                 size_t count,
+                                                 double *values) mutable {
+          cancelToken = token;
+          for (size_t p = 0; p < count; p++) {
+            std::copy(points + p * dims, points + (p + 1) * dims,
+                      local.begin() + INTERNAL_VARIABLE_START);
+            values[p] = fallback(local);
+          }
+        };
+      };
+      return integrateBox(lo, hi, samples, options, makeEvaluator, token);
+    }
+
+    auto makeEvaluator = [&] {
+      auto vm = std::make_shared<LaneVM>(body.c_str());
+      std::vector<Lanes<double, LANES>> laneArgs(args.begin(), args.end());
+      return [vm, laneArgs, dims](const double *points, size_t count,
+                                  double *values) mutable {
+        for (size_t p = 0; p < count; p += LANES) {
+          size_t n = std::min(LANES, count - p);
+          for (size_t d = 0; d < dims; d++)
+            for (size_t l = 0; l < LANES; l++)
+              laneArgs[INTERNAL_VARIABLE_START + d][l] =
+                  points[(p + std::min(l, n - 1)) * dims + d];
+          Lanes<double, LANES> out = vm->eval(laneArgs);
+          for (size_t l = 0; l < n; l++)
+            values[p + l] = out[l];
+        }
+      };
+    };
+    return integrateBox(lo, hi, samples, options, makeEvaluator, token);
+  }
+
+  bool usesVM() const { return vectorised; }
+};
+} // namespace functionlang
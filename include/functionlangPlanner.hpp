@@ -0,0 +1,811 @@
+#pragma once
+#include <functionlangRegister.hpp>
+#include <functionlangV2.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace functionlang {
+
+// Ways a plan can run an expression. LANES evaluates rows four at a time on
+// the V2 VM.
+enum class Engine : uint8_t { CLOSURE, BYTECODE, REGISTER, LANES };
+const size_t ENGINE_COUNT = 4;
+
+inline const char *engineName(Engine engine) {
+  switch (engine) {
+  case Engine::CLOSURE:
+    return "closure";
+  case Engine::BYTECODE:
+    return "bytecode";
+  case Engine::REGISTER:
+    return "register";
+  default:
+    return "lanes";
+  }
+}
+
+// Nanoseconds one engine spends on the work counted by estimateCost().
+struct EngineCost {
+  // Per node, or for V1 per node of every subtree, as each closure copies
+  // its children.
+  double compilePerNode = 0;
+  double perCall = 0;
+  double perInstruction = 0;
+  // On top of perInstruction, for each instruction calling into libm.
+  double perMathCall = 0;
+  // Per loop iteration; only V1 runs loops.
+  double perIteration = 0;
+};
+
+struct CostModel {
+  // Indexed by Engine; LANES costs are per row, not per call of four.
+  std::array<EngineCost, ENGINE_COUNT> engines;
+  // Starting and joining one worker thread.
+  double threadStart = 0;
+
+  const EngineCost &operator[](Engine engine) const {
+    return engines[static_cast<size_t>(engine)];
+  }
+  EngineCost &operator[](Engine engine) {
+    return engines[static_cast<size_t>(engine)];
+  }
+};
+
+// Fitted by calibrate() on the calibration suite; plannertest prints a fresh
+// fit in this form.
+inline CostModel costModel = {{{{87.2, 29.0, 5.00, 16.0, 9.67},
+                                {62.4, 0, 4.96, 10.6, 0},
+                                {98.1, 0, 5.03, 4.68, 0},
+                                {44.2, 8.99, 0.991, 12.3, 0}}},
+                              17800};
+
+struct Workload {
+  // Rows of arguments evaluated with the same plan.
+  uint64_t rows = 1;
+  // 0 allows every hardware thread.
+  size_t maxThreads = 0;
+};
+
+// What the planner knows of an expression before running it.
+struct ExpressionProfile {
+  // Parse error; the expression then runs on V1 as it would unplanned.
+  std::string error;
+  size_t nodes = 0;
+  // Sum of the sizes of all subtrees.
+  size_t subtreeNodes = 0;
+  bool loops = false;
+  // The register VM compiles it: loop-free, with every constant index
+  // within its 16-bit immediate.
+  bool registers = false;
+  // One evaluation; loops whose bounds depend on inputs count once.
+  CostEstimate cost;
+  // Set when the expression is a single A/P/I with known bounds, whose
+  // iterations can be split between threads.
+  bool splittable = false;
+  char loopOp = 0;
+  double trips = 0;
+  // The loop's operand texts, body last.
+  std::vector<std::string> operands;
+  size_t bodyNodes = 0;
+  bool bodyLoopFree = false;
+  CostEstimate bodyCost;
+};
+
+inline ExpressionProfile profileExpression(const std::string &expr) {
+  ExpressionProfile profile;
+  ExprTree tree;
+  const char *ptr = expr.c_str();
+  tree.parse(ptr);
+  if (tree.hasError()) {
+    profile.error = tree.error.message;
+    return profile;
+  }
+  profile.nodes = tree.parsedNodes;
+  profile.loops = tree.hasLoops;
+  profile.registers = !tree.hasLoops && tree.constants.size() <= 0x10000;
+  std::vector<size_t> sizes(tree.nodes.size(), 1);
+  for (size_t n = 0; n < tree.nodes.size(); n++) {
+    for (uint8_t c = 0; c < tree.nodes[n].arity; c++)
+      sizes[n] += sizes[tree.nodes[n].children[c]];
+    profile.subtreeNodes += sizes[n];
+  }
+  profile.cost = estimateCost(expr.c_str());
+
+  ptr = expr.c_str();
+  detail::skipSeparators(ptr);
+  char op = *ptr;
+  if (op != QUATERNARY_OPS_ENUM::SUMMATION &&
+      op != QUATERNARY_OPS_ENUM::PRODUCT &&
+      op != PENTARY_OPS_ENUM::INTEGRAL)
+    return profile;
+  ptr++;
+  size_t arity = operatorInfo(op).arity;
+  std::vector<bool> constant;
+  for (size_t i = 0; i < arity; i++) {
+    detail::skipSeparators(ptr);
+    const char *start = ptr;
+    constant.push_back(detail::estimateSubtree(ptr).constant);
+    profile.operands.emplace_back(start, ptr);
+  }
+  auto value = [&](size_t i) {
+    const std::string &text = profile.operands[i];
+    return detail::constantValue(text.data(), text.data() + text.size());
+  };
+  if (op == PENTARY_OPS_ENUM::INTEGRAL && constant[2]) {
+    profile.trips = std::max(0.0, std::trunc(value(2)));
+  } else if (op != PENTARY_OPS_ENUM::INTEGRAL && constant[0] &&
+             constant[1]) {
+    double lo = value(0), hi = value(1);
+    profile.trips = hi >= lo ? std::floor(hi - lo) + 1 : 0;
+  } else {
+    return profile;
+  }
+
+  const std::string &body = profile.operands.back();
+  ExprTree bodyTree;
+  ptr = body.c_str();
+  bodyTree.parse(ptr);
+  profile.splittable = true;
+  profile.loopOp = op;
+  profile.bodyNodes = bodyTree.parsedNodes;
+  profile.bodyLoopFree = !bodyTree.hasLoops;
+  profile.bodyCost = estimateCost(body.c_str());
+  return profile;
+}
+
+struct PlanOption {
+  Engine engine = Engine::CLOSURE;
+  size_t threads = 1;
+  // The root loop runs in chunks of iterations across the threads, its
+  // body on the lane VM when loop-free. Sums may round differently from
+  // V1's running total.
+  bool splitLoop = false;
+  double compileSeconds = 0;
+  double runSeconds = 0;
+
+  double seconds() const { return compileSeconds + runSeconds; }
+};
+
+struct Plan {
+  ExpressionProfile profile;
+  Workload workload;
+  PlanOption chosen;
+  // Every option considered, cheapest first.
+  std::vector<PlanOption> options;
+};
+
+namespace detail {
+inline double rowNanos(const EngineCost &c, const CostEstimate &work) {
+  return c.perCall + c.perInstruction * work.instructions +
+         c.perMathCall * work.mathCalls + c.perIteration * work.iterations;
+}
+
+inline uint64_t ceilDiv(uint64_t a, uint64_t b) { return (a + b - 1) / b; }
+
+inline double compileNanos(Engine engine, const EngineCost &c,
+                           const ExpressionProfile &p) {
+  return c.compilePerNode *
+         (engine == Engine::CLOSURE ? p.subtreeNodes : p.nodes);
+}
+} // namespace detail
+
+// A model under which only `engine` is chosen, on as many threads as the
+// workload allows; for tests and comparisons.
+inline CostModel engineOnlyModel(Engine engine) {
+  CostModel model;
+  for (EngineCost &c : model.engines)
+    c = {1e9, 1e9, 1e9, 1e9, 1e9};
+  model[engine] = {0, 1, 0, 0, 0};
+  return model;
+}
+
+// Iterations per task of a split loop; partial results are combined in task
+// order, so they do not depend on the thread count.
+const uint64_t SPLIT_LOOP_CHUNK = 4096;
+
+// Estimates every engine and thread count that can run `expr` under
+// `workload`, and picks the cheapest in total, compilation included.
+inline Plan makePlan(const std::string &expr, Workload workload = {},
+                     const CostModel &model = costModel) {
+  FUNCTIONLANG_TRACE_SPAN(span, "makePlan", "compile");
+  Plan plan;
+  plan.profile = profileExpression(expr);
+  plan.workload = workload;
+  const ExpressionProfile &p = plan.profile;
+  if (!p.error.empty()) {
+    plan.options.push_back(plan.chosen);
+    return plan;
+  }
+
+  size_t available =
+      workload.maxThreads ? workload.maxThreads
+                          : std::max(1u, std::thread::hardware_concurrency());
+  std::vector<size_t> threadCounts;
+  for (size_t t = 1; t < available; t *= 2)
+    threadCounts.push_back(t);
+  threadCounts.push_back(available);
+  uint64_t rows = std::max<uint64_t>(1, workload.rows);
+
+  auto add = [&](Engine engine, size_t threads, bool split, double compile,
+                 double run) {
+    plan.options.push_back(
+        {engine, threads, split, compile * 1e-9, run * 1e-9});
+  };
+
+  for (size_t e = 0; e < ENGINE_COUNT; e++) {
+    Engine engine = static_cast<Engine>(e);
+    if ((engine != Engine::CLOSURE && p.loops) ||
+        (engine == Engine::REGISTER && !p.registers) ||
+        (engine == Engine::LANES && rows < 4))
+      continue;
+    const EngineCost &c = model[engine];
+    double row = detail::rowNanos(c, p.cost);
+    for (size_t threads : threadCounts) {
+      uint64_t perThread = detail::ceilDiv(rows, threads);
+      if (perThread * (threads - 1) >= rows && threads > 1)
+        continue;
+      if (engine == Engine::LANES)
+        perThread = detail::ceilDiv(perThread, 4) * 4;
+      // Workers compile their own VM side by side.
+      add(engine, threads, false, detail::compileNanos(engine, c, p),
+          perThread * row + model.threadStart * (threads - 1));
+    }
+  }
+
+  if (p.splittable) {
+    Engine body = p.bodyLoopFree ? Engine::LANES : Engine::CLOSURE;
+    const EngineCost &closure = model[Engine::CLOSURE];
+    const EngineCost &c = model[body];
+    double iteration = detail::rowNanos(c, p.bodyCost);
+    uint64_t trips = static_cast<uint64_t>(p.trips);
+    uint64_t chunks = std::max<uint64_t>(1, detail::ceilDiv(trips,
+                                                            SPLIT_LOOP_CHUNK));
+    ExpressionProfile bodyProfile = profileExpression(p.operands.back());
+    double compile =
+        detail::compileNanos(Engine::CLOSURE, closure, p) +
+        detail::compileNanos(body, c, bodyProfile);
+    for (size_t threads : threadCounts) {
+      if (threads > chunks)
+        break;
+      uint64_t perThread = detail::ceilDiv(chunks, threads) * SPLIT_LOOP_CHUNK;
+      perThread = std::min(perThread, trips);
+      double run = closure.perCall * 4 + perThread * iteration +
+                   model.threadStart * (threads - 1);
+      add(body, threads, true, compile, rows * run);
+    }
+  }
+
+  std::stable_sort(plan.options.begin(), plan.options.end(),
+                   [](const PlanOption &a, const PlanOption &b) {
+                     return a.seconds() < b.seconds();
+                   });
+  plan.chosen = plan.options.front();
+  return plan;
+}
+
+namespace detail {
+inline std::string formatSeconds(double seconds) {
+  std::ostringstream out;
+  out << std::setprecision(3);
+  if (seconds < 1e-6)
+    out << seconds * 1e9 << " ns";
+  else if (seconds < 1e-3)
+    out << seconds * 1e6 << " us";
+  else if (seconds < 1)
+    out << seconds * 1e3 << " ms";
+  else
+    out << seconds << " s";
+  return out.str();
+}
+
+inline std::string describe(const PlanOption &option) {
+  std::string text = option.splitLoop ? std::string("split loop, body on ") +
+                                            engineName(option.engine)
+                                      : engineName(option.engine);
+  if (option.threads > 1)
+    text += ", " + std::to_string(option.threads) + " threads";
+  return text;
+}
+} // namespace detail
+
+// The chosen plan, the estimates behind it and the options it beat.
+inline std::string explain(const Plan &plan, size_t maxOptions = 8) {
+  const ExpressionProfile &p = plan.profile;
+  std::ostringstream out;
+  out << std::setprecision(3);
+  if (!p.error.empty()) {
+    out << "plan: closure (parse error: " << p.error << ")";
+    return out.str();
+  }
+  out << "plan: " << detail::describe(plan.chosen) << ", estimated "
+      << detail::formatSeconds(plan.chosen.seconds()) << " for "
+      << plan.workload.rows << (plan.workload.rows == 1 ? " row" : " rows")
+      << "\n";
+  out << "work: " << p.nodes << " nodes, " << p.cost.instructions
+      << " instructions, " << p.cost.mathCalls << " libm calls, "
+      << p.cost.iterations << " iterations"
+      << (p.cost.bounded ? "" : " (input-dependent loops counted once)");
+  if (p.splittable)
+    out << "\nroot loop: " << p.loopOp << " over " << p.trips
+        << " iterations, body of " << p.bodyNodes << " nodes"
+        << (p.bodyLoopFree ? "" : " with loops");
+  size_t shown = std::min(maxOptions, plan.options.size());
+  for (size_t i = 0; i < shown; i++) {
+    const PlanOption &o = plan.options[i];
+    out << "\n  " << std::left << std::setw(34) << detail::describe(o)
+        << " compile " << std::setw(10) << detail::formatSeconds(
+                                               o.compileSeconds)
+        << " run " << std::setw(10) << detail::formatSeconds(o.runSeconds)
+        << " total " << detail::formatSeconds(o.seconds());
+  }
+  if (shown < plan.options.size())
+    out << "\n  ... " << plan.options.size() - shown << " more";
+  return out.str();
+}
+
+// Runs an expression the way its plan says. Like the VMs, a function is
+// used by one thread at a time; the threads it starts are its own.
+class PlannedFunction {
+public:
+  static constexpr size_t LANES = 4;
+  using LaneVM = BasicFunctionParserV2<Lanes<double, LANES>>;
+
+private:
+  std::shared_ptr<const std::string> expression;
+  Plan chosenPlan;
+  // Only the plan's engines are built. CLOSURE plans share one V1 closure
+  // between threads.
+  ExprFunc closure;
+  // The plan's engine for the calling thread, unset for split loops; LANES
+  // plans evaluate single rows in every lane.
+  ExprFunc scalar;
+  std::shared_ptr<LaneVM> lanes;
+  // Split loops: the bounds on V1, the body on V1 or the lane VM.
+  std::vector<ExprFunc> bounds;
+  std::shared_ptr<const std::string> body;
+  ExprFunc bodyClosure;
+
+  ExprFunc makeScalar() const {
+    Engine engine = chosenPlan.chosen.engine;
+    if (engine == Engine::CLOSURE)
+      return closure;
+    if (engine == Engine::REGISTER) {
+      auto vm = std::make_shared<FunctionParserReg>(expression->c_str());
+      return [vm, source = expression](ExprFuncRet args) {
+        return vm->eval(args);
+      };
+    }
+    auto vm = std::make_shared<FunctionParserV2>(expression->c_str());
+    return [vm, source = expression](ExprFuncRet args) {
+      return vm->eval(args);
+    };
+  }
+
+  // Evaluates rows [first, last) of `rows` into `out`, on the calling
+  // thread's engines or, for a worker, on engines of its own.
+  void evalBlock(const std::vector<std::vector<double>> &rows, size_t first,
+                 size_t last, std::vector<double> &out, bool worker) const {
+    if (chosenPlan.chosen.engine != Engine::LANES) {
+      ExprFunc run = worker ? makeScalar() : scalar;
+      for (size_t r = first; r < last; r++)
+        out[r] = run(rows[r]);
+      return;
+    }
+    std::shared_ptr<LaneVM> vm =
+        worker ? std::make_shared<LaneVM>(expression->c_str()) : lanes;
+    std::vector<Lanes<double, LANES>> laneArgs;
+    for (size_t r = first; r < last; r += LANES) {
+      size_t n = std::min(LANES, last - r);
+      size_t width = 0;
+      for (size_t l = 0; l < n; l++)
+        width = std::max(width, rows[r + l].size());
+      laneArgs.assign(width, Lanes<double, LANES>(DEFAULT_RESULT));
+      for (size_t l = 0; l < LANES; l++) {
+        const std::vector<double> &row = rows[r + std::min(l, n - 1)];
+        for (size_t k = 0; k < row.size(); k++)
+          laneArgs[k][l] = row[k];
+      }
+      Lanes<double, LANES> values = vm->eval(laneArgs);
+      for (size_t l = 0; l < n; l++)
+        out[r + l] = values[l];
+    }
+  }
+
+  // V1's A/P/I, with the iterations split into fixed chunks and the chunks
+  // shared between threads.
+  double evalSplitLoop(ExprFuncRet args) const {
+    const ExpressionProfile &p = chosenPlan.profile;
+    bool integral = p.loopOp == PENTARY_OPS_ENUM::INTEGRAL;
+    bool product = p.loopOp == QUATERNARY_OPS_ENUM::PRODUCT;
+    double v1 = bounds[0](args), v2 = bounds[1](args), v3 = bounds[2](args);
+    double first = v1, step = 1, requested = v3;
+    uint64_t trips;
+    if (integral) {
+      int n = static_cast<int>(v3);
+      if (n <= 0)
+        return 0.0;
+      step = (v2 - v1) / n;
+      first = v1 + 0.5 * step;
+      requested = bounds[3](args);
+      trips = static_cast<uint64_t>(n);
+    } else {
+      if (!(v1 <= v2))
+        return product ? 1.0 : 0.0;
+      trips = static_cast<uint64_t>(std::floor(v2 - v1)) + 1;
+    }
+
+    size_t internalIndex = detail::loopSlot(args, static_cast<int>(requested));
+
+    // Charged up front, as Q does; workers share the caller's cancellation.
+    if (loopInterrupted(p.bodyNodes, trips))
+      return DEFAULT_RESULT;
+    FUNCTIONLANG_TRACE_SPAN(span, "split loop", "eval");
+    FUNCTIONLANG_TRACE_ARG(span, "trips", trips);
+    const std::atomic<bool> *token = cancelToken;
+    uint64_t chunks = detail::ceilDiv(trips, SPLIT_LOOP_CHUNK);
+    std::vector<double> partials(chunks, product ? 1.0 : 0.0);
+    std::atomic<uint64_t> nextChunk{0};
+    std::atomic<bool> stopped{false};
+
+    // Closure workers start from the caller's slots and bind the loop's in
+    // their own frame; the lane VM reads them from a copy of `args`.
+    const detail::SlotFrame outer = detail::slotFrame;
+    const std::vector<detail::SlotBinding> outerFar = detail::farSlots;
+    std::vector<double> laneBase;
+    if (!bodyClosure) {
+      laneBase = args;
+      if (laneBase.size() <= internalIndex)
+        laneBase.resize(internalIndex + 1, DEFAULT_RESULT);
+      for (size_t k = INTERNAL_VARIABLE_START; k < laneBase.size(); k++)
+        laneBase[k] = detail::readSlot(args, k);
+    }
+
+    auto work = [&] {
+      const std::atomic<bool> *savedToken = cancelToken;
+      EvalBudget *savedBudget = evalBudget;
+      detail::SlotFrame savedFrame = detail::slotFrame;
+      std::vector<detail::SlotBinding> savedFar = std::move(detail::farSlots);
+      cancelToken = token;
+      evalBudget = nullptr;
+      detail::slotFrame = outer;
+      detail::farSlots = outerFar;
+      std::optional<detail::SlotScope> counter;
+      std::unique_ptr<LaneVM> vm;
+      std::vector<Lanes<double, LANES>> laneArgs;
+      if (bodyClosure)
+        counter.emplace(internalIndex, first);
+      else {
+        vm = std::make_unique<LaneVM>(body->c_str());
+        laneArgs.assign(laneBase.begin(), laneBase.end());
+      }
+
+      for (uint64_t chunk; (chunk = nextChunk++) < chunks;) {
+        if (cancelRequested()) {
+          stopped = true;
+          break;
+        }
+        uint64_t begin = chunk * SPLIT_LOOP_CHUNK;
+        uint64_t end = std::min(trips, begin + SPLIT_LOOP_CHUNK);
+        double total = product ? 1.0 : 0.0;
+        if (bodyClosure) {
+          for (uint64_t i = begin; i < end; i++) {
+            counter->set(integral ? v1 + (i + 0.5) * step : first + i);
+            double value = bodyClosure(args);
+            total = product ? total * value : total + value;
+          }
+        } else {
+          for (uint64_t i = begin; i < end; i += LANES) {
+            size_t n = static_cast<size_t>(std::min<uint64_t>(LANES,
+                                                              end - i));
+            for (size_t l = 0; l < LANES; l++) {
+              uint64_t k = i + std::min(l, n - 1);
+              laneArgs[internalIndex][l] =
+                  integral ? v1 + (k + 0.5) * step : first + k;
+            }
+            Lanes<double, LANES> values = vm->eval(laneArgs);
+            for (size_t l = 0; l < n; l++)
+              total = product ? total * values[l] : total + values[l];
+          }
+        }
+        partials[chunk] = total;
+      }
+      counter.reset();
+      detail::slotFrame = savedFrame;
+      detail::farSlots = std::move(savedFar);
+      cancelToken = savedToken;
+      evalBudget = savedBudget;
+    };
+
+    size_t threads = static_cast<size_t>(
+        std::min<uint64_t>(chosenPlan.chosen.threads, chunks));
+    {
+      std::vector<std::jthread> pool;
+      for (size_t t = 1; t < threads; t++)
+        pool.emplace_back(work);
+      work();
+    }
+    if (stopped || cancelRequested())
+      return DEFAULT_RESULT;
+
+    double total = product ? 1.0 : 0.0;
+    for (double partial : partials)
+      total = product ? total * partial : total + partial;
+    return integral ? total * step : total;
+  }
+
+public:
+  PlannedFunction(std::string expr, Workload workload = {},
+                  const CostModel &model = costModel)
+      : expression(std::make_shared<const std::string>(std::move(expr))),
+        chosenPlan(makePlan(*expression, workload, model)) {
+    const char *ptr;
+    if (chosenPlan.chosen.splitLoop) {
+      const std::vector<std::string> &operands = chosenPlan.profile.operands;
+      for (size_t i = 0; i + 1 < operands.size(); i++) {
+        ptr = operands[i].c_str();
+        bounds.push_back(parseExpression(ptr));
+      }
+      body = std::make_shared<const std::string>(operands.back());
+      if (chosenPlan.chosen.engine == Engine::CLOSURE) {
+        ptr = body->c_str();
+        bodyClosure = parseExpression(ptr);
+      }
+    } else if (chosenPlan.chosen.engine == Engine::LANES) {
+      lanes = std::make_shared<LaneVM>(expression->c_str());
+      scalar = [vm = lanes, source = expression](ExprFuncRet args) {
+        std::vector<Lanes<double, LANES>> laneArgs(args.begin(), args.end());
+        return vm->eval(laneArgs)[0];
+      };
+    } else {
+      if (chosenPlan.chosen.engine == Engine::CLOSURE) {
+        ptr = expression->c_str();
+        closure = parseExpression(ptr);
+      }
+      scalar = makeScalar();
+    }
+  }
+
+  double eval(const std::vector<double> &args) const {
+    return chosenPlan.chosen.splitLoop ? evalSplitLoop(args) : scalar(args);
+  }
+
+  double operator()(const std::vector<double> &args) const {
+    return eval(args);
+  }
+
+  // Evaluates every row, splitting the rows between the plan's threads.
+  std::vector<double>
+  evalRows(const std::vector<std::vector<double>> &rows) const {
+    FUNCTIONLANG_TRACE_SPAN(span, "evalRows", "eval");
+    FUNCTIONLANG_TRACE_ARG(span, "rows", rows.size());
+    std::vector<double> out(rows.size());
+    if (chosenPlan.chosen.splitLoop) {
+      for (size_t r = 0; r < rows.size(); r++)
+        out[r] = evalSplitLoop(rows[r]);
+      return out;
+    }
+    size_t threads = std::max<size_t>(
+        1, std::min<size_t>(chosenPlan.chosen.threads, rows.size()));
+    size_t block = detail::ceilDiv(rows.size(), threads);
+    {
+      std::vector<std::jthread> pool;
+      for (size_t t = 1; t < threads; t++)
+        pool.emplace_back([&, t] {
+          evalBlock(rows, std::min(rows.size(), t * block),
+                    std::min(rows.size(), (t + 1) * block), out, true);
+        });
+      evalBlock(rows, 0, std::min(rows.size(), block), out, false);
+    }
+    return out;
+  }
+
+  const Plan &plan() const { return chosenPlan; }
+  const std::string &source() const { return *expression; }
+};
+
+// Expressions in the shapes of the benchmarks under src/tests: the ternary
+// of v2benchmark, the chains and trees of regbenchmark, libm mixes, and
+// loops for V1.
+inline std::vector<std::string> calibrationSuite() {
+  auto rightDeep = [](int depth) {
+    std::string eq;
+    for (int i = 0; i < depth; ++i)
+      eq += (i % 2 ? "*$" : "+$") + std::to_string(i % 3) + ",";
+    return eq + "1";
+  };
+  auto leftDeep = [](int depth) {
+    std::string eq(depth, '+');
+    eq += "$0";
+    for (int i = 0; i < depth; ++i)
+      eq += ",s$" + std::to_string(i % 3);
+    return eq;
+  };
+  auto balanced = [](int depth) {
+    std::string eq = "$1";
+    for (int d = 1; d <= depth; d++)
+      eq = (d % 2 ? "+" : "*") + eq + "," + eq;
+    return eq;
+  };
+  return {"? > $0 0 + $0 * $1 $2 _ $0 1",
+          "+$0,$1",
+          "*s$0,l$1",
+          "^+$0,1,2.5",
+          "+%*$0,10,3,~$1,2",
+          rightDeep(8),
+          rightDeep(32),
+          rightDeep(64),
+          leftDeep(16),
+          leftDeep(64),
+          balanced(4),
+          balanced(6),
+          balanced(8),
+          "A1,100,-1,*@0,$0",
+          "A1,1000,-1,+@0,$1",
+          "A1,200,-1,s*@0,$0",
+          "I0,1,500,-1,^@0,2",
+          "P1,50,-1,+1,/$0,@0",
+          "A1,30,-1,A1,30,-1,*@0,@1"};
+}
+
+namespace detail {
+// Least squares over the columns in `use`, refitted without the most
+// negative coefficient until none is negative.
+inline std::array<double, 4>
+fitNonNegative(const std::vector<std::array<double, 4>> &x,
+               const std::vector<double> &y, std::array<bool, 4> use) {
+  std::array<double, 4> beta{};
+  for (size_t round = 0; round < 4; round++) {
+    std::vector<size_t> cols;
+    for (size_t c = 0; c < 4; c++)
+      if (use[c])
+        cols.push_back(c);
+    size_t k = cols.size();
+    if (k == 0)
+      return beta;
+    // Normal equations, solved by Gaussian elimination.
+    std::vector<std::vector<double>> a(k, std::vector<double>(k + 1, 0.0));
+    for (size_t r = 0; r < x.size(); r++)
+      for (size_t i = 0; i < k; i++) {
+        for (size_t j = 0; j < k; j++)
+          a[i][j] += x[r][cols[i]] * x[r][cols[j]];
+        a[i][k] += x[r][cols[i]] * y[r];
+      }
+    for (size_t i = 0; i < k; i++) {
+      size_t pivot = i;
+      for (size_t r = i + 1; r < k; r++)
+        if (std::abs(a[r][i]) > std::abs(a[pivot][i]))
+          pivot = r;
+      std::swap(a[i], a[pivot]);
+      if (a[i][i] == 0)
+        continue;
+      for (size_t r = 0; r < k; r++) {
+        if (r == i)
+          continue;
+        double f = a[r][i] / a[i][i];
+        for (size_t c = i; c <= k; c++)
+          a[r][c] -= f * a[i][c];
+      }
+    }
+    beta = {};
+    size_t worst = k;
+    for (size_t i = 0; i < k; i++) {
+      beta[cols[i]] = a[i][i] == 0 ? 0 : a[i][k] / a[i][i];
+      if (beta[cols[i]] < 0 &&
+          (worst == k || beta[cols[i]] < beta[cols[worst]]))
+        worst = i;
+    }
+    if (worst == k)
+      return beta;
+    use[cols[worst]] = false;
+  }
+  beta = {};
+  return beta;
+}
+
+// Nanoseconds per call of `f`, repeated for at least `budget`.
+template <typename F>
+double timePerCall(F &&f, std::chrono::duration<double> budget) {
+  uint64_t runs = 0;
+  auto start = std::chrono::steady_clock::now();
+  std::chrono::duration<double> elapsed{0};
+  for (uint64_t batch = 1; elapsed < budget; batch *= 2) {
+    for (uint64_t i = 0; i < batch; i++)
+      f();
+    runs += batch;
+    elapsed = std::chrono::steady_clock::now() - start;
+  }
+  return elapsed.count() * 1e9 / runs;
+}
+
+inline volatile double calibrationSink = 0;
+} // namespace detail
+
+// Times each engine on every expression of `suite` it can run, the way
+// evalRows() runs it, and fits its EngineCost by non-negative least squares.
+// `budget` is spent per expression and engine.
+inline CostModel
+calibrate(const std::vector<std::string> &suite = calibrationSuite(),
+          std::chrono::duration<double> budget =
+              std::chrono::milliseconds(20)) {
+  FUNCTIONLANG_TRACE_SPAN(span, "calibrate", "compile");
+  const size_t ROWS = 64;
+  std::vector<std::vector<double>> rows(ROWS);
+  for (size_t r = 0; r < ROWS; r++)
+    rows[r] = {0.7 + r * 1e-3, 1.3 - r * 1e-3, 2.1};
+  CostModel model;
+
+  for (size_t e = 0; e < ENGINE_COUNT; e++) {
+    Engine engine = static_cast<Engine>(e);
+    std::vector<std::array<double, 4>> features;
+    std::vector<double> times;
+    double compileTime = 0, compiledNodes = 0;
+    for (const std::string &expr : suite) {
+      ExpressionProfile p = profileExpression(expr);
+      if (!p.error.empty() || (engine != Engine::CLOSURE && p.loops) ||
+          (engine == Engine::REGISTER && !p.registers))
+        continue;
+      const char *eq = expr.c_str();
+      switch (engine) {
+      case Engine::CLOSURE:
+        compileTime += detail::timePerCall(
+            [&] {
+              const char *ptr = eq;
+              ExprFunc f = parseExpression(ptr);
+            },
+            budget / 4);
+        break;
+      case Engine::BYTECODE:
+        compileTime += detail::timePerCall([&] { FunctionParserV2 vm(eq); },
+                                           budget / 4);
+        break;
+      case Engine::REGISTER:
+        compileTime += detail::timePerCall([&] { FunctionParserReg vm(eq); },
+                                           budget / 4);
+        break;
+      case Engine::LANES:
+        compileTime += detail::timePerCall(
+            [&] { PlannedFunction::LaneVM vm(eq); }, budget / 4);
+        break;
+      }
+      compiledNodes += engine == Engine::CLOSURE ? p.subtreeNodes : p.nodes;
+
+      // Repeated rows would otherwise time the memo cache of a loop.
+      MemoOptions memo = memoOptions;
+      memoOptions.enabled = false;
+      PlannedFunction f(expr, {ROWS, 1}, engineOnlyModel(engine));
+      memoOptions = memo;
+      double run =
+          detail::timePerCall(
+              [&] { detail::calibrationSink = f.evalRows(rows)[0]; },
+              budget) /
+          ROWS;
+      features.push_back({1, p.cost.instructions, p.cost.mathCalls,
+                          p.cost.iterations});
+      times.push_back(run);
+    }
+
+    std::array<double, 4> beta = detail::fitNonNegative(
+        features, times, {true, true, true, engine == Engine::CLOSURE});
+    EngineCost &c = model[engine];
+    c.compilePerNode = compiledNodes > 0 ? compileTime / compiledNodes : 0;
+    c.perCall = beta[0];
+    c.perInstruction = beta[1];
+    c.perMathCall = beta[2];
+    c.perIteration = beta[3];
+  }
+
+  model.threadStart = detail::timePerCall(
+      [] { std::jthread([] {}).join(); }, budget);
+  return model;
+}
+} // namespace functionlang
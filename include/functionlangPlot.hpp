@@ -0,0 +1,283 @@
+#pragma once
+#include <functionlangV2.hpp>
+#include <unordered_map>
+#include <algorithm>
+#include <memory>
+#include <string>
+
+namespace functionlang {
+
+// Samples that can be drawn; DEFAULT_RESULT marks a failed evaluation.
+inline bool isPlottable(double y) {
+  return std::isfinite(y) && y != DEFAULT_RESULT;
+}
+
+struct PlotPoint {
+  double x;
+  double y;
+};
+
+struct SampleStats {
+  // Points computed by the last sample() call, and points it found cached.
+  size_t evaluated = 0;
+  size_t reused = 0;
+  // Deepest subdivision level reached.
+  int depth = 0;
+};
+
+struct SamplerOptions {
+  size_t initialIntervals = 512;
+  int maxDepth = 8;
+  // An interval is split when its midpoint is further than this fraction of
+  // the visible y-range from the chord through its ends.
+  double tolerance = 1e-3;
+  // Cached samples beyond which those outside the view are dropped.
+  size_t maxCached = 1'000'000;
+};
+
+// Samples an expression as a function of one $n over a range, refining
+// where the curve bends. Sample positions lie on a dyadic lattice, so after
+// a pan or zoom most positions coincide with ones already computed and are
+// served from the cache.
+class AdaptiveSampler {
+public:
+  static constexpr size_t LANES = 4;
+  using LaneVM = BasicFunctionParserV2<Lanes<double, LANES>>;
+
+private:
+  SamplerOptions options;
+  std::string expression;
+  std::vector<double> args;
+  size_t variable = 0;
+  std::unique_ptr<LaneVM> vm;
+  std::vector<Lanes<double, LANES>> laneArgs;
+  // Loops are outside the VM's operator set; those expressions use V1.
+  ExprFunc fallback;
+  std::unordered_map<double, double> cache;
+  double tolerance = 0;
+  // Lattice and result of the last fully refined view.
+  double lastStep = 0, lastFirst = 0, lastLast = 0;
+  std::vector<PlotPoint> lastPoints;
+
+  struct Interval {
+    double a, b;
+    double ya, yb;
+  };
+  SampleStats lastStats;
+
+  // Returns the value at each position, computing the ones not cached yet
+  // LANES at a time when the VM supports the expression. Stops early once
+  // cancellation is requested, leaving the remaining values unset.
+  std::vector<double> evaluate(const std::vector<double> &xs) {
+    std::vector<double> ys(xs.size());
+    std::vector<size_t> missing;
+    for (size_t i = 0; i < xs.size(); i++) {
+      auto it = cache.find(xs[i]);
+      if (it == cache.end())
+        missing.push_back(i);
+      else
+        ys[i] = it->second;
+    }
+    lastStats.reused += xs.size() - missing.size();
+    lastStats.evaluated += missing.size();
+
+    if (vm) {
+      for (size_t i = 0; i < missing.size(); i += LANES) {
+        size_t n = std::min(LANES, missing.size() - i);
+        for (size_t l = 0; l < LANES; l++)
+          laneArgs[variable][l] = xs[missing[i + std::min(l, n - 1)]];
+        Lanes<double, LANES> lanes = vm->eval(laneArgs);
+        for (size_t l = 0; l < n; l++) {
+          ys[missing[i + l]] = lanes[l];
+          cache.emplace(xs[missing[i + l]], lanes[l]);
+        }
+      }
+    } else {
+      std::vector<double> local = args;
+      for (size_t idx : missing) {
+        local[variable] = xs[idx];
+        double y = fallback(local);
+        // A cancelled loop returns DEFAULT_RESULT, which must not be cached.
+        if (cancelRequested())
+          break;
+        ys[idx] = y;
+        cache.emplace(xs[idx], y);
+      }
+    }
+    return ys;
+  }
+
+  void evict(double xmin, double xmax) {
+    if (cache.size() > options.maxCached)
+      std::erase_if(cache, [&](const auto &entry) {
+        return entry.first < xmin || entry.first > xmax;
+      });
+  }
+
+  // True when the curve bends too much over [a, b] to draw it as a chord.
+  bool needsSplit(double ya, double yb, double ym) const {
+    if (isPlottable(ya) && isPlottable(yb) && isPlottable(ym))
+      return std::abs(ym - (ya + yb) / 2) > tolerance;
+    // Narrow down where the curve starts or stops.
+    return isPlottable(ya) != isPlottable(yb);
+  }
+
+public:
+  AdaptiveSampler(SamplerOptions opts = {}) : options(opts) {}
+
+  // Switches to a new expression, inputs or sampled $n, dropping the cache.
+  // Does nothing if all three are unchanged.
+  void setExpression(const std::string &expr, const std::vector<double> &in,
+                     size_t var) {
+    if (expr == expression && in == args && var == variable &&
+        (vm || fallback))
+      return;
+    expression = expr;
+    args = in;
+    variable = var;
+    if (args.size() <= variable)
+      args.resize(variable + 1, DEFAULT_RESULT);
+    cache.clear();
+    lastStep = 0;
+    lastPoints.clear();
+
+    vm = std::make_unique<LaneVM>(expression.c_str());
+    if (vm->isSupported()) {
+      laneArgs.assign(args.begin(), args.end());
+      fallback = nullptr;
+    } else {
+      vm.reset();
+      const char *ptr = expression.c_str();
+      fallback = parseExpression(ptr);
+    }
+  }
+
+  // Returns the samples covering [xmin, xmax] in increasing x, including
+  // the lattice points just outside so the curve reaches both edges. Stops
+  // refining early, returning what it has, once cancellation is requested.
+  std::vector<PlotPoint> sample(double xmin, double xmax) {
+    lastStats = {};
+    if (!(xmax > xmin) || (!vm && !fallback))
+      return {};
+
+    double step = std::exp2(std::ceil(std::log2(
+        (xmax - xmin) / static_cast<double>(options.initialIntervals))));
+    double first = std::floor(xmin / step) * step;
+    double last = std::ceil(xmax / step) * step;
+    // Redraws of an unchanged view are served from the last result.
+    if (step == lastStep && first == lastFirst && last == lastLast) {
+      lastStats.reused = lastPoints.size();
+      return lastPoints;
+    }
+
+    std::vector<double> grid;
+    // Multiples of a power of two, so they are exact and repeat across views.
+    for (double k = first / step; k * step <= last; k++)
+      grid.push_back(k * step);
+    std::vector<double> ys = evaluate(grid);
+    if (cancelRequested())
+      return {};
+
+    // The visible y-range sets the scale of the tolerance.
+    double ylo = std::numeric_limits<double>::infinity(), yhi = -ylo;
+    for (double y : ys) {
+      if (isPlottable(y)) {
+        ylo = std::min(ylo, y);
+        yhi = std::max(yhi, y);
+      }
+    }
+    tolerance = options.tolerance *
+                (yhi > ylo ? yhi - ylo : std::max(1.0, std::abs(yhi)));
+
+    std::vector<PlotPoint> points;
+    std::vector<Interval> intervals;
+    for (size_t i = 0; i < grid.size(); i++) {
+      points.push_back({grid[i], ys[i]});
+      if (i + 1 < grid.size())
+        intervals.push_back({grid[i], grid[i + 1], ys[i], ys[i + 1]});
+    }
+
+    // Refine level by level, so each level's midpoints form one batch.
+    bool complete = true;
+    for (int depth = 1; depth <= options.maxDepth && !intervals.empty();
+         depth++) {
+      std::vector<double> mids;
+      for (const Interval &iv : intervals)
+        mids.push_back((iv.a + iv.b) / 2);
+      std::vector<double> midYs = evaluate(mids);
+      if (cancelRequested()) {
+        complete = false;
+        break;
+      }
+      lastStats.depth = depth;
+
+      std::vector<Interval> next;
+      for (size_t i = 0; i < intervals.size(); i++) {
+        const Interval &iv = intervals[i];
+        points.push_back({mids[i], midYs[i]});
+        if (needsSplit(iv.ya, iv.yb, midYs[i])) {
+          next.push_back({iv.a, mids[i], iv.ya, midYs[i]});
+          next.push_back({mids[i], iv.b, midYs[i], iv.yb});
+        }
+      }
+      intervals = std::move(next);
+    }
+
+    evict(first, last);
+    std::sort(points.begin(), points.end(),
+              [](const PlotPoint &a, const PlotPoint &b) { return a.x < b.x; });
+    if (complete) {
+      lastStep = step;
+      lastFirst = first;
+      lastLast = last;
+      lastPoints = points;
+    }
+    return points;
+  }
+
+  const SampleStats &stats() const { return lastStats; }
+  size_t cachedCount() const { return cache.size(); }
+  bool usesVM() const { return vm != nullptr; }
+};
+
+// Reduces sorted samples to at most four per pixel column (first, lowest,
+// highest, last), which draws the same polyline. A column holding an
+// unplottable value yields a single NaN point, so renderers break the line.
+inline std::vector<PlotPoint> decimate(const std::vector<PlotPoint> &points,
+                                       double xmin, double xmax,
+                                       size_t columns) {
+  std::vector<PlotPoint> out;
+  if (columns == 0 || !(xmax > xmin))
+    return out;
+  double scale = columns / (xmax - xmin);
+  size_t i = 0;
+  while (i < points.size()) {
+    double column = std::floor((points[i].x - xmin) * scale);
+    PlotPoint firstPt = points[i], lo = points[i], hi = points[i],
+              lastPt = points[i];
+    bool broken = !isPlottable(points[i].y);
+    for (i++; i < points.size() &&
+              std::floor((points[i].x - xmin) * scale) == column;
+         i++) {
+      const PlotPoint &p = points[i];
+      broken |= !isPlottable(p.y);
+      if (p.y < lo.y)
+        lo = p;
+      if (p.y > hi.y)
+        hi = p;
+      lastPt = p;
+    }
+    if (broken) {
+      out.push_back({firstPt.x, std::numeric_limits<double>::quiet_NaN()});
+      continue;
+    }
+    PlotPoint keep[4] = {firstPt, lo, hi, lastPt};
+    std::sort(keep, keep + 4,
+              [](const PlotPoint &a, const PlotPoint &b) { return a.x < b.x; });
+    for (const PlotPoint &p : keep)
+      if (out.empty() || out.back().x != p.x)
+        out.push_back(p);
+  }
+  return out;
+}
+} // namespace functionlang
@@ -0,0 +1,174 @@
+#pragma once
+#include <functionlangTiered.hpp>
+
+#include <string>
+#include <thread>
+
+namespace functionlang {
+
+// Spreadsheet-style store where each $n is either a plain value or bound to
+// an expression over other $n. Changing a slot recomputes only its
+// transitive dependents, level by level in topological order, running the
+// slots within one level in parallel.
+class ReactiveStore {
+private:
+  struct Cell {
+    std::string expr;
+    // Tiered, as a bound slot is re-evaluated on every change upstream.
+    std::unique_ptr<TieredFunction> func;
+    std::vector<size_t> deps;
+    bool bound = false;
+  };
+
+  std::vector<double> &values;
+  std::vector<Cell> cells;
+  std::vector<std::vector<size_t>> dependents;
+
+  // The $n slots an expression reads, in the same way the parser reads them.
+  std::vector<size_t> scanDeps(const std::string &expr) const {
+    std::vector<size_t> deps;
+    for (size_t i = 0; i < expr.size(); i++) {
+      if (expr[i] != USER_VARIABLE_IDENT)
+        continue;
+      char *endPtr;
+      long idx = std::strtol(expr.c_str() + i + 1, &endPtr, 10);
+      if (idx >= 0 && static_cast<size_t>(idx) < values.size() &&
+          !std::ranges::contains(deps, static_cast<size_t>(idx)))
+        deps.push_back(static_cast<size_t>(idx));
+    }
+    return deps;
+  }
+
+  // True if `target` is reachable from `from` along dependency edges.
+  bool reaches(size_t from, size_t target) const {
+    std::vector<size_t> pending = {from};
+    std::vector<bool> seen(cells.size(), false);
+    while (!pending.empty()) {
+      size_t n = pending.back();
+      pending.pop_back();
+      if (n == target)
+        return true;
+      if (seen[n])
+        continue;
+      seen[n] = true;
+      for (size_t d : cells[n].deps)
+        pending.push_back(d);
+    }
+    return false;
+  }
+
+  void setDeps(size_t idx, std::vector<size_t> deps) {
+    for (size_t d : cells[idx].deps)
+      std::erase(dependents[d], idx);
+    for (size_t d : deps)
+      dependents[d].push_back(idx);
+    cells[idx].deps = std::move(deps);
+  }
+
+  // Evaluates one topological level against a snapshot, so workers never
+  // read a slot another worker is writing.
+  void evalLevel(const std::vector<size_t> &level) {
+    std::vector<double> snapshot = values;
+    std::vector<double> results(level.size());
+    size_t threads = std::min<size_t>(
+        level.size(), std::max(1u, std::thread::hardware_concurrency()));
+
+    auto work = [&](size_t first) {
+      for (size_t i = first; i < level.size(); i += threads)
+        results[i] = cells[level[i]].func->eval(snapshot);
+    };
+    if (threads <= 1) {
+      work(0);
+    } else {
+      std::vector<std::jthread> pool;
+      for (size_t t = 0; t < threads; t++)
+        pool.emplace_back(work, t);
+    }
+    for (size_t i = 0; i < level.size(); i++)
+      values[level[i]] = results[i];
+  }
+
+public:
+  ReactiveStore(std::vector<double> &store)
+      : values(store), cells(store.size()), dependents(store.size()) {}
+
+  // Recomputes every bound slot depending on `changed`, directly or not.
+  // Returns the recomputed slots in the order they were updated.
+  std::vector<size_t> propagate(size_t changed) {
+    // Collect the affected subgraph and each slot's in-degree within it.
+    std::vector<size_t> affected;
+    std::vector<int> indegree(cells.size(), -1);
+    std::vector<size_t> pending = dependents[changed];
+    while (!pending.empty()) {
+      size_t n = pending.back();
+      pending.pop_back();
+      if (indegree[n] >= 0)
+        continue;
+      indegree[n] = 0;
+      affected.push_back(n);
+      for (size_t d : dependents[n])
+        pending.push_back(d);
+    }
+    for (size_t n : affected)
+      for (size_t d : dependents[n])
+        indegree[d]++;
+
+    // Kahn's algorithm, one level at a time.
+    std::vector<size_t> order;
+    std::vector<size_t> level;
+    for (size_t n : affected)
+      if (indegree[n] == 0)
+        level.push_back(n);
+    while (!level.empty()) {
+      evalLevel(level);
+      std::vector<size_t> next;
+      for (size_t n : level) {
+        order.push_back(n);
+        for (size_t d : dependents[n])
+          if (--indegree[d] == 0)
+            next.push_back(d);
+      }
+      level = std::move(next);
+    }
+    return order;
+  }
+
+  // Binds $idx to `expr` and recomputes it and its dependents. Fails without
+  // changing anything if the binding would create a cycle.
+  bool bind(size_t idx, const std::string &expr, std::vector<size_t> &updated,
+            std::string &error) {
+    std::vector<size_t> deps = scanDeps(expr);
+    for (size_t d : deps) {
+      if (reaches(d, idx)) {
+        error = "$" + std::to_string(idx) + " would depend on itself via $" +
+                std::to_string(d);
+        return false;
+      }
+    }
+    cells[idx].func = std::make_unique<TieredFunction>(expr);
+    cells[idx].expr = expr;
+    cells[idx].bound = true;
+    setDeps(idx, std::move(deps));
+
+    evalLevel({idx});
+    updated = {idx};
+    std::vector<size_t> rest = propagate(idx);
+    updated.insert(updated.end(), rest.begin(), rest.end());
+    return true;
+  }
+
+  // Stores a plain value in $idx, dropping any binding, and recomputes its
+  // dependents.
+  std::vector<size_t> set(size_t idx, double value) {
+    cells[idx].bound = false;
+    cells[idx].expr.clear();
+    cells[idx].func.reset();
+    setDeps(idx, {});
+    values[idx] = value;
+    return propagate(idx);
+  }
+
+  bool isBound(size_t idx) const { return cells[idx].bound; }
+  const std::string &expression(size_t idx) const { return cells[idx].expr; }
+};
+} // namespace functionlang
@@ -0,0 +1,243 @@
+#pragma once
+#include <array>
+#include <functionlangTree.hpp>
+
+namespace functionlang {
+
+// Size of the fixed register file. Registers are allocated with Sethi-Ullman
+// numbering, so an expression needs at most log2(nodes) + 1 of them.
+const size_t REGISTER_COUNT = 32;
+
+// Three-address instruction: regs[dst] = op(regs[src1], regs[src2],
+// regs[src3]). PUSH_V stores the constant index in src1 | src2 << 8, GET_V
+// and GET_IV store the variable index in src1.
+struct RegInstr {
+  Op op;
+  uint8_t dst;
+  uint8_t src1;
+  uint8_t src2;
+  uint8_t src3;
+
+  uint32_t immediate() const { return src1 | (src2 << 8); }
+};
+
+// Dispatch loop shared by the three-address backends. Instr provides op,
+// dst, src1..src3 and immediate() for leaf operands.
+template <typename Instr>
+void runThreeAddress(const std::vector<Instr> &program, double *regs,
+                     const std::vector<double> &constants,
+                     const std::vector<double> &args) {
+  for (const Instr &in : program) {
+    double &dst = regs[in.dst];
+    switch (in.op) {
+    case Op::PUSH_V:
+      dst = constants[in.immediate()];
+      break;
+    case Op::GET_V: {
+      uint32_t vidx = in.immediate();
+      dst = vidx < args.size() ? args[vidx] : DEFAULT_RESULT;
+      break;
+    }
+    case Op::GET_IV: {
+      size_t internalIndex = INTERNAL_VARIABLE_START + in.immediate();
+      dst = internalIndex < args.size() ? args[internalIndex] : DEFAULT_RESULT;
+      break;
+    }
+    // --- Unary Logic ---
+    case Op::SIN:
+      dst = std::sin(regs[in.src1]);
+      break;
+    case Op::COS:
+      dst = std::cos(regs[in.src1]);
+      break;
+    case Op::ABS:
+      dst = std::abs(regs[in.src1]);
+      break;
+    case Op::LOG:
+      dst = std::log(regs[in.src1]);
+      break;
+    case Op::LOG2:
+      dst = std::log2(regs[in.src1]);
+      break;
+    case Op::LOG10:
+      dst = std::log10(regs[in.src1]);
+      break;
+    case Op::SQRT:
+      dst = std::sqrt(regs[in.src1]);
+      break;
+    case Op::CBRT:
+      dst = std::cbrt(regs[in.src1]);
+      break;
+    case Op::NOT:
+      dst = (regs[in.src1] <= 0.0 ? 1.0 : -1.0);
+      break;
+    case Op::FACTORIAL: {
+      double a = regs[in.src1];
+      dst = (a < 0.0              ? 0.0
+             : a >= FACTORIAL_MAX ? std::numeric_limits<double>::max()
+                                  : std::tgamma(a + 1.0));
+      break;
+    }
+    // --- Binary Logic ---
+    case Op::ADD:
+      dst = regs[in.src1] + regs[in.src2];
+      break;
+    case Op::SUB:
+      dst = regs[in.src1] - regs[in.src2];
+      break;
+    case Op::MUL:
+      dst = regs[in.src1] * regs[in.src2];
+      break;
+    case Op::DIV: {
+      double b = regs[in.src2];
+      dst = (b == 0.0 ? 0.0 : regs[in.src1] / b);
+      break;
+    }
+    case Op::POW:
+      dst = std::pow(regs[in.src1], regs[in.src2]);
+      break;
+    case Op::MIN:
+      dst = std::min(regs[in.src1], regs[in.src2]);
+      break;
+    case Op::MAX:
+      dst = std::max(regs[in.src1], regs[in.src2]);
+      break;
+    case Op::MOD: {
+      double b = regs[in.src2];
+      dst = (b == 0.0 ? 0.0 : std::fmod(regs[in.src1], b));
+      break;
+    }
+    case Op::LOG_N: {
+      double a = regs[in.src1], b = regs[in.src2];
+      dst = (b <= 0.0 || a <= 0.0 || a == 1.0) ? 0.0
+                                               : std::log(b) / std::log(a);
+      break;
+    }
+    case Op::LT:
+      dst = (regs[in.src1] < regs[in.src2] ? 1.0 : -1.0);
+      break;
+    case Op::GT:
+      dst = (regs[in.src1] > regs[in.src2] ? 1.0 : -1.0);
+      break;
+    case Op::EQ:
+      dst = (std::abs(regs[in.src1] - regs[in.src2]) < 0.00001 ? 1.0 : -1.0);
+      break;
+    case Op::NE:
+      dst = (std::abs(regs[in.src1] - regs[in.src2]) > 0.00001 ? 1.0 : -1.0);
+      break;
+    case Op::L_AND:
+      dst = (regs[in.src1] > 0.0 && regs[in.src2] > 0.0 ? 1.0 : -1.0);
+      break;
+    case Op::L_OR:
+      dst = (regs[in.src1] > 0.0 || regs[in.src2] > 0.0 ? 1.0 : -1.0);
+      break;
+    case Op::ROUND: {
+      double n = std::pow(10.0, regs[in.src2]);
+      dst = std::round(regs[in.src1] * n) / n;
+      break;
+    }
+    // --- Ternary Logic ---
+    case Op::WHETHER:
+      dst = (regs[in.src1] > 0.0 ? regs[in.src2] : regs[in.src3]);
+      break;
+    default:
+      // Superinstructions are only selected by the stack compiler.
+      break;
+    }
+  }
+}
+
+class FunctionParserReg {
+private:
+  const char *equation;
+  ExprTree tree;
+  std::vector<uint8_t> needs;
+  std::vector<RegInstr> program;
+  std::vector<double> constants;
+  std::array<double, REGISTER_COUNT> regs{};
+  bool valid = true;
+
+  // Sethi-Ullman: children run heaviest first, the i-th one evaluated keeps
+  // i registers of its siblings alive.
+  void computeNeeds() {
+    needs.assign(tree.nodes.size(), 1);
+    for (size_t n = 0; n < tree.nodes.size(); n++) {
+      const ExprNode &node = tree.nodes[n];
+      if (node.arity == 0)
+        continue;
+      // Unused entries stay 0 and sort last.
+      std::array<uint8_t, 3> sorted{};
+      for (uint8_t i = 0; i < node.arity; i++)
+        sorted[i] = needs[node.children[i]];
+      std::ranges::sort(sorted, std::greater<>());
+      needs[n] = 0;
+      for (uint8_t i = 0; i < node.arity; i++)
+        needs[n] = std::max<uint8_t>(needs[n], sorted[i] + i);
+    }
+  }
+
+  void emitNode(uint32_t idx, uint8_t base) {
+    const ExprNode &node = tree.nodes[idx];
+    if (base >= REGISTER_COUNT || node.operand > 0xFFFF) {
+      valid = false;
+      return;
+    }
+    if (node.arity == 0) {
+      program.push_back({node.op, base, static_cast<uint8_t>(node.operand),
+                         static_cast<uint8_t>(node.operand >> 8), 0});
+      return;
+    }
+
+    uint8_t order[3] = {0, 1, 2};
+    std::stable_sort(order, order + node.arity, [&](uint8_t a, uint8_t b) {
+      return needs[node.children[a]] > needs[node.children[b]];
+    });
+
+    uint8_t srcs[3] = {0, 0, 0};
+    for (uint8_t i = 0; i < node.arity; i++) {
+      srcs[order[i]] = static_cast<uint8_t>(base + i);
+      emitNode(node.children[order[i]], static_cast<uint8_t>(base + i));
+    }
+    program.push_back({node.op, base, srcs[0], srcs[1], srcs[2]});
+  }
+
+  void compile(const char *ptr) {
+    FUNCTIONLANG_TRACE_SPAN(span, "FunctionParserReg::compile", "compile");
+    tree.clear();
+    program.clear();
+    valid = true;
+    uint32_t root = tree.parse(ptr);
+    if (tree.hasError() || tree.hasLoops) {
+      valid = false;
+    } else {
+      {
+        FUNCTIONLANG_TRACE_SPAN(needs, "computeNeeds", "compile");
+        computeNeeds();
+      }
+      FUNCTIONLANG_TRACE_SPAN(emit, "emitNode", "compile");
+      emitNode(root, 0);
+    }
+    constants = std::move(tree.constants);
+    tree.clear();
+    needs.clear();
+  }
+
+public:
+  FunctionParserReg(const char *eq) : equation(eq) { compile(equation); }
+
+  double eval(const std::vector<double> &args) {
+    if (!valid || program.empty())
+      return DEFAULT_RESULT;
+    runThreeAddress(program, regs.data(), constants, args);
+    return regs[0];
+  }
+
+  void setEq(const char *eq) {
+    equation = eq;
+    compile(eq);
+  }
+
+  // False for loops, parse errors and trees too deep for the registers.
+  bool isSupported() const { return valid && !program.empty(); }
+};
+} // namespace functionlang
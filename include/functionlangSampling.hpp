@@ -0,0 +1,289 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+// Sampling behind the Q operator and integrate(): Sobol points and a
+// counter-based generator, spread over threads in fixed chunks so results do
+// not depend on the thread count.
+namespace functionlang {
+
+const size_t SOBOL_MAX_DIMENSIONS = 16;
+// Points per task; also the unit of reproducibility.
+const uint64_t SAMPLE_CHUNK = 4096;
+// Points handed to an evaluator at once.
+const size_t SAMPLE_BATCH = 64;
+
+enum class SampleMethod : uint8_t { SOBOL, PSEUDO_RANDOM };
+
+struct IntegrationOptions {
+  // Sobol is used up to SOBOL_MAX_DIMENSIONS and pseudo-random beyond.
+  SampleMethod method = SampleMethod::SOBOL;
+  uint64_t seed = 0x5eed;
+  // Independently shifted copies of the Sobol points, whose spread gives
+  // the error estimate.
+  size_t replicates = 8;
+  // 0 uses every hardware thread.
+  size_t threads = 0;
+};
+
+struct IntegrationResult {
+  double value = 0;
+  // One standard error.
+  double error = 0;
+  uint64_t samples = 0;
+  size_t threads = 0;
+  // False when cancelled; value and error are then meaningless.
+  bool complete = true;
+};
+
+// SplitMix64 as a counter-based generator: the n-th number of a stream is a
+// pure function of (key, n), so any thread can produce any part of it.
+inline uint64_t counterRandom(uint64_t key, uint64_t counter) {
+  uint64_t z = key + (counter + 1) * 0x9e3779b97f4a7c15ull;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+// Uniform in (0, 1), never exactly 0 or 1.
+inline double counterUniform(uint64_t key, uint64_t counter) {
+  return ((counterRandom(key, counter) >> 11) + 0.5) * 0x1p-53;
+}
+
+// Sobol points in Gray-code order, 32 bits per coordinate, with Joe and
+// Kuo's primitive polynomials and initial direction numbers.
+class SobolSequence {
+private:
+  struct Polynomial {
+    uint32_t degree;
+    uint32_t coefficients;
+    uint32_t initial[6];
+  };
+  static constexpr Polynomial POLYNOMIALS[SOBOL_MAX_DIMENSIONS - 1] = {
+      {1, 0, {1}},
+      {2, 1, {1, 3}},
+      {3, 1, {1, 3, 1}},
+      {3, 2, {1, 1, 1}},
+      {4, 1, {1, 1, 3, 3}},
+      {4, 4, {1, 3, 5, 13}},
+      {5, 2, {1, 1, 5, 5, 17}},
+      {5, 4, {1, 1, 5, 5, 5}},
+      {5, 7, {1, 1, 7, 11, 19}},
+      {5, 11, {1, 1, 5, 1, 1}},
+      {5, 13, {1, 1, 1, 3, 11}},
+      {5, 14, {1, 3, 5, 5, 31}},
+      {6, 1, {1, 3, 3, 9, 7, 49}},
+      {6, 13, {1, 1, 1, 15, 21, 21}},
+      {6, 16, {1, 3, 1, 13, 27, 49}}};
+
+  size_t dims;
+  std::vector<uint32_t> directions;
+  std::vector<uint32_t> point;
+  uint64_t position = 0;
+
+public:
+  SobolSequence(size_t dimensions)
+      : dims(std::min(dimensions, SOBOL_MAX_DIMENSIONS)),
+        directions(dims * 32), point(dims, 0) {
+    for (uint32_t k = 0; k < 32; k++)
+      directions[k] = 1u << (31 - k);
+    for (size_t d = 1; d < dims; d++) {
+      const Polynomial &p = POLYNOMIALS[d - 1];
+      uint32_t *v = &directions[d * 32];
+      for (uint32_t k = 0; k < p.degree; k++)
+        v[k] = p.initial[k] << (31 - k);
+      for (uint32_t k = p.degree; k < 32; k++) {
+        v[k] = v[k - p.degree] ^ (v[k - p.degree] >> p.degree);
+        for (uint32_t l = 1; l < p.degree; l++)
+          if ((p.coefficients >> (p.degree - 1 - l)) & 1)
+            v[k] ^= v[k - l];
+      }
+    }
+  }
+
+  // Jumps to the n-th point.
+  void seek(uint64_t n) {
+    position = n;
+    uint64_t gray = n ^ (n >> 1);
+    for (size_t d = 0; d < dims; d++) {
+      uint32_t x = 0;
+      for (uint32_t k = 0; k < 32; k++)
+        if ((gray >> k) & 1)
+          x ^= directions[d * 32 + k];
+      point[d] = x;
+    }
+  }
+
+  // Steps to the following point, flipping one direction per coordinate.
+  void next() {
+    position++;
+    uint32_t k = static_cast<uint32_t>(std::countr_zero(position));
+    for (size_t d = 0; d < dims; d++)
+      point[d] ^= directions[d * 32 + k];
+  }
+
+  uint32_t operator[](size_t d) const { return point[d]; }
+  size_t dimensions() const { return dims; }
+};
+
+namespace detail {
+// Set on integration workers, so nested integrals run on the thread that
+// reaches them instead of starting threads of their own.
+inline thread_local bool integrating = false;
+
+// Mean and sum of squared deviations of one chunk, merged in chunk order.
+struct Moments {
+  double count = 0;
+  double mean = 0;
+  double m2 = 0;
+
+  void add(double x) {
+    count++;
+    double delta = x - mean;
+    mean += delta / count;
+    m2 += delta * (x - mean);
+  }
+
+  void merge(const Moments &o) {
+    if (o.count == 0)
+      return;
+    double total = count + o.count;
+    double delta = o.mean - mean;
+    mean += delta * o.count / total;
+    m2 += o.m2 + delta * delta * count * o.count / total;
+    count = total;
+  }
+};
+} // namespace detail
+
+// Integrates over the box [lo, hi]. `makeEvaluator()` is called once per
+// thread and must return a callable `(const double *points, size_t count,
+// double *values)` taking `count` points of lo.size() coordinates each.
+// Evaluators run concurrently, one per thread. Each worker observes the
+// caller's cancelToken through `cancel`.
+template <typename MakeEvaluator>
+IntegrationResult integrateBox(const std::vector<double> &lo,
+                               const std::vector<double> &hi,
+                               uint64_t samples, IntegrationOptions options,
+                               MakeEvaluator makeEvaluator,
+                               const std::atomic<bool> *cancel = nullptr) {
+  IntegrationResult result;
+  size_t dims = lo.size();
+  if (dims == 0 || samples == 0 || hi.size() != dims)
+    return result;
+  if (dims > SOBOL_MAX_DIMENSIONS)
+    options.method = SampleMethod::PSEUDO_RANDOM;
+  bool sobol = options.method == SampleMethod::SOBOL;
+
+  // Sobol replicates hold a power of two of points, so each is a complete
+  // net; pseudo-random samples form one stream.
+  size_t replicates = sobol ? std::max<size_t>(1, options.replicates) : 1;
+  uint64_t perReplicate = (samples + replicates - 1) / replicates;
+  if (sobol)
+    perReplicate = std::bit_ceil(perReplicate);
+  uint64_t chunksPerReplicate =
+      (perReplicate + SAMPLE_CHUNK - 1) / SAMPLE_CHUNK;
+  uint64_t tasks = chunksPerReplicate * replicates;
+  result.samples = perReplicate * replicates;
+
+  double volume = 1;
+  for (size_t d = 0; d < dims; d++)
+    volume *= hi[d] - lo[d];
+
+  std::vector<uint32_t> shifts(replicates * dims);
+  for (size_t i = 0; i < shifts.size(); i++)
+    shifts[i] = static_cast<uint32_t>(counterRandom(options.seed, i) >> 32);
+  // A separate stream for pseudo-random coordinates; point i, coordinate d
+  // is number i * dims + d of it.
+  uint64_t pointKey = counterRandom(~options.seed, 0);
+
+  size_t threads = options.threads
+                       ? options.threads
+                       : std::max(1u, std::thread::hardware_concurrency());
+  if (detail::integrating)
+    threads = 1;
+  threads = static_cast<size_t>(std::min<uint64_t>(threads, tasks));
+  result.threads = threads;
+
+  std::vector<detail::Moments> moments(tasks);
+  std::atomic<uint64_t> nextTask{0};
+  std::atomic<bool> stopped{false};
+
+  auto work = [&] {
+    bool outer = detail::integrating;
+    detail::integrating = true;
+    auto evaluate = makeEvaluator();
+    SobolSequence sequence(sobol ? dims : 1);
+    std::vector<double> points(SAMPLE_BATCH * dims);
+    double values[SAMPLE_BATCH];
+
+    for (uint64_t task; (task = nextTask++) < tasks;) {
+      if (cancel && cancel->load(std::memory_order_relaxed)) {
+        stopped = true;
+        break;
+      }
+      uint64_t replicate = task / chunksPerReplicate;
+      uint64_t first = (task % chunksPerReplicate) * SAMPLE_CHUNK;
+      uint64_t last = std::min(first + SAMPLE_CHUNK, perReplicate);
+      const uint32_t *shift = &shifts[replicate * dims];
+      if (sobol)
+        sequence.seek(first);
+
+      detail::Moments &m = moments[task];
+      for (uint64_t i = first; i < last;) {
+        size_t count =
+            static_cast<size_t>(std::min<uint64_t>(SAMPLE_BATCH, last - i));
+        for (size_t p = 0; p < count; p++, i++) {
+          for (size_t d = 0; d < dims; d++) {
+            double u = sobol ? ((sequence[d] ^ shift[d]) + 0.5) * 0x1p-32
+                             : counterUniform(pointKey, i * dims + d);
+            points[p * dims + d] = lo[d] + u * (hi[d] - lo[d]);
+          }
+          if (sobol && i + 1 < last)
+            sequence.next();
+        }
+        evaluate(points.data(), count, values);
+        for (size_t p = 0; p < count; p++)
+          m.add(values[p]);
+      }
+    }
+    detail::integrating = outer;
+  };
+
+  {
+    std::vector<std::jthread> pool;
+    for (size_t t = 1; t < threads; t++)
+      pool.emplace_back(work);
+    work();
+  }
+  if (stopped) {
+    result.complete = false;
+    return result;
+  }
+
+  // Combined in task order, so the sum is the same for any thread count.
+  std::vector<detail::Moments> replicateMoments(replicates);
+  for (uint64_t task = 0; task < tasks; task++)
+    replicateMoments[task / chunksPerReplicate].merge(moments[task]);
+  detail::Moments total, means;
+  for (const detail::Moments &r : replicateMoments) {
+    total.merge(r);
+    means.add(r.mean);
+  }
+  result.value = volume * total.mean;
+  if (sobol)
+    result.error = replicates > 1
+                       ? volume * std::sqrt(means.m2 / (replicates - 1) /
+                                            replicates)
+                       : 0;
+  else if (total.count > 1)
+    result.error = volume * std::sqrt(total.m2 / (total.count - 1) /
+                                      total.count);
+  return result;
+}
+} // namespace functionlang
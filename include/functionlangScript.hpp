@@ -0,0 +1,260 @@
+#pragma once
+#include <functionlangKernel.hpp>
+#include <functionlangPlanner.hpp>
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+// The REPL lines that only read the store and, for :s, write one $n:
+// `:s $n expr`, `:f #n expr`, `:b expr; ...` and plain expressions. The REPL
+// prepares, runs and prints one at a time; script mode prepares a run of
+// them in parallel, orders them by the $n they write and read, and runs
+// each level of that order in parallel, so results are those of running
+// the lines one by one.
+namespace functionlang::script {
+
+enum class Kind {
+  SET,
+  FUNCTION,
+  EXPRESSION,
+  BLOCK,
+  // Any other REPL command; it runs on its own, in order.
+  OTHER
+};
+
+struct Statement {
+  Kind kind = Kind::OTHER;
+  std::string line;
+  // The expression of :s, :f and plain lines; the parts of :b.
+  std::vector<std::string> exprs;
+  // :s and :f without a `$n ` or `#n ` print nothing.
+  bool addressed = false;
+  int index = -1;
+  // Set when the :s or :f index did not parse.
+  std::string indexError;
+  // Plain lines V1 cannot parse are not run.
+  ParseError syntax;
+  // Slots of the store the statement reads.
+  std::vector<size_t> reads;
+
+  ExprFunc setter;
+  std::shared_ptr<PlannedFunction> planned;
+  std::shared_ptr<FunctionKernel> kernel;
+  std::vector<ExprFunc> fallback;
+
+  std::vector<double> results;
+
+  bool inRange() const {
+    return index >= 0 && index < static_cast<int>(INTERNAL_VARIABLE_START);
+  }
+  // True for a :s that stores its result.
+  bool writes() const {
+    return kind == Kind::SET && addressed && indexError.empty() && inRange();
+  }
+};
+
+// The slots below INTERNAL_VARIABLE_START that `expr` reads, resolved as the
+// $ and @ nodes resolve them.
+inline void scanReads(const std::string &expr, std::vector<size_t> &reads) {
+  for (size_t i = 0; i < expr.size(); i++) {
+    if (expr[i] != USER_VARIABLE_IDENT && expr[i] != INTERNAL_VARIABLE_IDENT)
+      continue;
+    long n = std::strtol(expr.c_str() + i + 1, nullptr, 10);
+    if (expr[i] == INTERNAL_VARIABLE_IDENT)
+      n += INTERNAL_VARIABLE_START;
+    if (n >= 0 && n < static_cast<long>(INTERNAL_VARIABLE_START) &&
+        !std::ranges::contains(reads, static_cast<size_t>(n)))
+      reads.push_back(static_cast<size_t>(n));
+  }
+}
+
+namespace detail {
+// Reads the `$n ` or `#n ` after the command, as the REPL does.
+inline void parseAddress(Statement &s, char ident) {
+  size_t v_pos = s.line.find(ident);
+  size_t space_pos = s.line.find(' ', v_pos);
+  if (v_pos == std::string::npos || space_pos == std::string::npos)
+    return;
+  s.addressed = true;
+  try {
+    s.index = std::stoi(s.line.substr(v_pos + 1, space_pos - v_pos - 1));
+  } catch (const std::exception &e) {
+    s.indexError = e.what();
+    return;
+  }
+  s.exprs = {s.line.substr(space_pos + 1)};
+}
+
+// Splits a :b line at its semicolons, dropping empty parts.
+inline std::vector<std::string> splitBlock(const std::string &rest) {
+  std::vector<std::string> exprs;
+  size_t start = 0;
+  while (start <= rest.size()) {
+    size_t end = rest.find(';', start);
+    if (end == std::string::npos)
+      end = rest.size();
+    std::string expr = rest.substr(start, end - start);
+    size_t first = expr.find_first_not_of(" \t");
+    if (first != std::string::npos)
+      exprs.push_back(
+          expr.substr(first, expr.find_last_not_of(" \t") - first + 1));
+    start = end + 1;
+  }
+  return exprs;
+}
+} // namespace detail
+
+// Matches the order in which the REPL tests its commands.
+inline Kind kindOf(const std::string &line) {
+  if (line == ":q" || line == ":h" || line == ":tiers" || line == ":memo" ||
+      line.starts_with(":trace") || line.starts_with(":explain") ||
+      line.starts_with(":shm") || line.starts_with(":r"))
+    return Kind::OTHER;
+  if (line.starts_with(":s"))
+    return Kind::SET;
+  if (line.starts_with(":b"))
+    return Kind::BLOCK;
+  if (line.starts_with(":f"))
+    return Kind::FUNCTION;
+  return Kind::EXPRESSION;
+}
+
+// Classifies and compiles `line` without touching the store.
+inline Statement prepare(const std::string &line) {
+  Statement s;
+  s.line = line;
+  s.kind = kindOf(line);
+  if (s.kind == Kind::OTHER)
+    return s;
+
+  if (s.kind == Kind::SET) {
+    detail::parseAddress(s, USER_VARIABLE_IDENT);
+    if (!s.exprs.empty()) {
+      const char *ptr = s.exprs[0].c_str();
+      s.setter = parseExpression(ptr);
+    }
+  } else if (s.kind == Kind::BLOCK) {
+    s.exprs = detail::splitBlock(line.substr(2));
+    s.kernel = std::make_shared<FunctionKernel>(s.exprs);
+    if (!s.kernel->isSupported()) {
+      s.kernel.reset();
+      for (const std::string &expr : s.exprs) {
+        const char *ptr = expr.c_str();
+        s.fallback.push_back(parseExpression(ptr));
+      }
+    }
+  } else if (s.kind == Kind::FUNCTION) {
+    detail::parseAddress(s, USER_FUNCTION_IDENT);
+    return s;
+  } else {
+    s.exprs = {line};
+    ExprTree tree;
+    const char *ptr = line.c_str();
+    tree.parse(ptr);
+    // Lines only the VMs reject still run, on V1, as do blank lines, which
+    // V1 evaluates to 0.
+    bool blank = line.find_first_not_of(" \t") == std::string::npos;
+    if (!blank && tree.hasSyntaxError()) {
+      s.syntax = tree.error;
+      return s;
+    }
+    s.planned = std::make_shared<PlannedFunction>(line);
+  }
+  for (const std::string &expr : s.exprs)
+    scanReads(expr, s.reads);
+  return s;
+}
+
+// Evaluates a prepared statement against `values`. :s ignores the store and
+// evaluates with $0 = 10, $1 = 5, as the REPL always has.
+inline void run(Statement &s, ExprFuncRet values) {
+  switch (s.kind) {
+  case Kind::SET:
+    if (s.setter)
+      s.results = {s.setter({10, 5})};
+    break;
+  case Kind::EXPRESSION:
+    if (s.planned)
+      s.results = {s.planned->eval(values)};
+    break;
+  case Kind::BLOCK:
+    if (s.kernel) {
+      s.results = s.kernel->eval(values);
+    } else {
+      s.results.clear();
+      for (const ExprFunc &f : s.fallback)
+        s.results.push_back(f(values));
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+// Calls f(i) for every i < count on up to `threads` threads.
+template <typename F> void parallelFor(size_t count, size_t threads, F &&f) {
+  threads = std::min(count, std::max<size_t>(threads, 1));
+  std::atomic<size_t> next{0};
+  auto work = [&] {
+    for (size_t i; (i = next++) < count;)
+      f(i);
+  };
+  if (threads <= 1) {
+    work();
+    return;
+  }
+  std::vector<std::jthread> pool;
+  for (size_t t = 1; t < threads; t++)
+    pool.emplace_back(work);
+  work();
+}
+
+// Prepares and runs `lines`, none of them OTHER, on `threads` threads, as if
+// they ran in order starting from `values`. The store itself is left to the
+// caller, which applies the writes while printing.
+inline std::vector<Statement> runBatch(const std::vector<std::string> &lines,
+                                       const std::vector<double> &values,
+                                       size_t threads) {
+  std::vector<Statement> statements(lines.size());
+  parallelFor(lines.size(), threads,
+              [&](size_t i) { statements[i] = prepare(lines[i]); });
+
+  // Each read sees the last :s of its slot before it, or the store.
+  const size_t NONE = lines.size();
+  std::vector<size_t> lastWriter(values.size(), NONE);
+  std::vector<std::vector<size_t>> deps(lines.size());
+  std::vector<size_t> depth(lines.size(), 0);
+  size_t levels = 1;
+  for (size_t i = 0; i < statements.size(); i++) {
+    const Statement &s = statements[i];
+    if (s.kind != Kind::SET) {
+      for (size_t slot : s.reads)
+        if (slot < values.size() && lastWriter[slot] != NONE) {
+          deps[i].push_back(lastWriter[slot]);
+          depth[i] = std::max(depth[i], depth[lastWriter[slot]] + 1);
+        }
+    }
+    levels = std::max(levels, depth[i] + 1);
+    if (s.writes())
+      lastWriter[s.index] = i;
+  }
+
+  std::vector<std::vector<size_t>> byLevel(levels);
+  for (size_t i = 0; i < statements.size(); i++)
+    byLevel[depth[i]].push_back(i);
+  for (const std::vector<size_t> &level : byLevel)
+    parallelFor(level.size(), threads, [&](size_t k) {
+      Statement &s = statements[level[k]];
+      if (deps[level[k]].empty()) {
+        run(s, values);
+        return;
+      }
+      std::vector<double> args = values;
+      for (size_t d : deps[level[k]])
+        args[statements[d].index] = statements[d].results[0];
+      run(s, args);
+    });
+  return statements;
+}
+} // namespace functionlang::script
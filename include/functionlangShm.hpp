@@ -0,0 +1,180 @@
+#pragma once
+#include <functionlang.hpp>
+
+#include <atomic>
+#include <span>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Variable store in a POSIX shared-memory segment, so a producer process can
+// publish $n values that evaluators in other processes read without copying
+// them through a socket or file.
+//
+// Consistency uses a seqlock: a writer makes the sequence odd, stores its
+// values and makes it even again. A reader copies the values between two
+// reads of the sequence and retries if it was odd or changed. Readers never
+// block writers or each other. Writers serialise on the sequence itself.
+namespace functionlang::shm {
+
+const uint64_t MAGIC = 0x464c534d454d3031; // "FLSMEM01"
+const size_t SLOTS = INTERNAL_VARIABLE_START;
+
+struct Segment {
+  uint64_t magic;
+  std::atomic<uint64_t> sequence;
+  // Relaxed atomics, so readers racing a writer stay well-defined; the
+  // sequence tells them to discard what they read.
+  std::atomic<double> values[SLOTS];
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free &&
+                  std::atomic<double>::is_always_lock_free,
+              "a shared segment needs address-free atomics");
+
+class SharedStore {
+private:
+  std::string name;
+  Segment *segment = nullptr;
+  bool owner = false;
+
+  bool map(int fd) {
+    void *addr = mmap(nullptr, sizeof(Segment), PROT_READ | PROT_WRITE,
+                      MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+      return false;
+    segment = static_cast<Segment *>(addr);
+    return true;
+  }
+
+  // Takes the write side by moving the sequence from even to odd.
+  uint64_t beginWrite() {
+    uint64_t seq = segment->sequence.load(std::memory_order_relaxed);
+    while ((seq & 1) || !segment->sequence.compare_exchange_weak(
+                            seq, seq + 1, std::memory_order_acquire,
+                            std::memory_order_relaxed))
+      seq = segment->sequence.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    return seq + 2;
+  }
+
+  void endWrite(uint64_t seq) {
+    segment->sequence.store(seq, std::memory_order_release);
+  }
+
+public:
+  SharedStore() = default;
+  SharedStore(const SharedStore &) = delete;
+  SharedStore &operator=(const SharedStore &) = delete;
+  ~SharedStore() { detach(); }
+
+  // Creates the segment `shmName` (e.g. "/functionlang"), or takes over an
+  // existing one, with every slot zero. The creator removes the name when
+  // it detaches. On failure errno says why.
+  bool create(const std::string &shmName) {
+    detach();
+    int fd = shm_open(shmName.c_str(), O_RDWR | O_CREAT, 0600);
+    if (fd < 0)
+      return false;
+    if (ftruncate(fd, sizeof(Segment)) < 0) {
+      close(fd);
+      return false;
+    }
+    if (!map(fd))
+      return false;
+    name = shmName;
+    owner = true;
+    // Reset rather than take the sequence, which a writer that died
+    // mid-update may have left odd.
+    segment->sequence.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (auto &value : segment->values)
+      value.store(0.0, std::memory_order_relaxed);
+    segment->magic = MAGIC;
+    endWrite(2);
+    return true;
+  }
+
+  // Attaches to a segment another process created.
+  bool open(const std::string &shmName) {
+    detach();
+    int fd = shm_open(shmName.c_str(), O_RDWR, 0);
+    if (fd < 0)
+      return false;
+    struct stat st;
+    if (fstat(fd, &st) < 0 ||
+        st.st_size < static_cast<off_t>(sizeof(Segment))) {
+      close(fd);
+      errno = EINVAL;
+      return false;
+    }
+    if (!map(fd))
+      return false;
+    if (segment->magic != MAGIC) {
+      detach();
+      errno = EINVAL;
+      return false;
+    }
+    name = shmName;
+    return true;
+  }
+
+  void detach() {
+    if (!segment)
+      return;
+    munmap(segment, sizeof(Segment));
+    segment = nullptr;
+    if (owner)
+      shm_unlink(name.c_str());
+    owner = false;
+    name.clear();
+  }
+
+  bool attached() const { return segment != nullptr; }
+  const std::string &segmentName() const { return name; }
+
+  // Number of completed writes; changes whenever any value does.
+  uint64_t version() const {
+    return segment->sequence.load(std::memory_order_acquire) / 2;
+  }
+
+  void set(size_t idx, double value) { set(idx, std::span(&value, 1)); }
+
+  // Publishes values[i] to $(first + i) as one update, so readers see all or
+  // none of them. Slots past the end of the store are ignored.
+  void set(size_t first, std::span<const double> values) {
+    uint64_t seq = beginWrite();
+    for (size_t i = 0; i < values.size() && first + i < SLOTS; i++)
+      segment->values[first + i].store(values[i], std::memory_order_relaxed);
+    endWrite(seq);
+  }
+
+  // A single slot is always consistent on its own.
+  double get(size_t idx) const {
+    return idx < SLOTS ? segment->values[idx].load(std::memory_order_relaxed)
+                       : DEFAULT_RESULT;
+  }
+
+  // Copies a consistent snapshot of every slot into `out`, which keeps its
+  // capacity between calls, and returns its version. Slots of `out` beyond
+  // the store are left alone.
+  uint64_t snapshot(std::vector<double> &out) const {
+    if (out.size() < SLOTS)
+      out.resize(SLOTS);
+    while (true) {
+      uint64_t before = segment->sequence.load(std::memory_order_acquire);
+      if (before & 1)
+        continue;
+      for (size_t i = 0; i < SLOTS; i++)
+        out[i] = segment->values[i].load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (segment->sequence.load(std::memory_order_relaxed) == before)
+        return before / 2;
+    }
+  }
+};
+} // namespace functionlang::shm
@@ -0,0 +1,626 @@
+#pragma once
+#include <functionlangV2.hpp>
+
+#include <charconv>
+#include <memory>
+#include <string>
+
+namespace functionlang {
+
+// The character that spells `op` in an expression, or '\0' for opcodes the
+// parser never produces.
+inline char opSymbol(Op op) {
+  for (size_t c = 0; c < OPERATOR_TABLE.size(); c++)
+    if (OPERATOR_TABLE[c].kind == TokenKind::OPERATOR &&
+        OPERATOR_TABLE[c].opcode == op)
+      return static_cast<char>(c);
+  return '\0';
+}
+
+// Forward-mode differentiation by source transformation: walks the parsed
+// tree once and spells the derivative as another expression, which the VMs
+// compile like any other.
+class Differentiator {
+private:
+  // A derivative term, folded while it is still a constant so the output
+  // stays close to what one would write by hand.
+  struct Term {
+    std::string text;
+    bool constant = false;
+    double value = 0;
+  };
+
+  const ExprTree &tree;
+  size_t variable;
+  std::vector<std::string> rendered;
+  bool failed = false;
+
+  static Term number(double v) {
+    char buf[32];
+    auto res = std::to_chars(buf, buf + sizeof buf, v);
+    return {std::string(buf, res.ptr), true, v};
+  }
+
+  static bool isZero(const Term &t) { return t.constant && t.value == 0; }
+  static bool isOne(const Term &t) { return t.constant && t.value == 1; }
+
+  static Term call(Op op, std::initializer_list<Term> operands) {
+    std::string text(1, opSymbol(op));
+    for (const Term &t : operands) {
+      if (&t != operands.begin())
+        text += ',';
+      text += t.text;
+    }
+    return {text};
+  }
+
+  static Term add(Term a, Term b) {
+    if (isZero(a))
+      return b;
+    if (isZero(b))
+      return a;
+    if (a.constant && b.constant)
+      return number(a.value + b.value);
+    return call(Op::ADD, {a, b});
+  }
+  static Term sub(Term a, Term b) {
+    if (isZero(b))
+      return a;
+    if (a.constant && b.constant)
+      return number(a.value - b.value);
+    return call(Op::SUB, {a, b});
+  }
+  static Term mul(Term a, Term b) {
+    if (isZero(a) || isZero(b))
+      return number(0);
+    if (isOne(a))
+      return b;
+    if (isOne(b))
+      return a;
+    if (a.constant && b.constant)
+      return number(a.value * b.value);
+    return call(Op::MUL, {a, b});
+  }
+  static Term div(Term a, Term b) {
+    if (isZero(a))
+      return number(0);
+    if (isOne(b))
+      return a;
+    return call(Op::DIV, {a, b});
+  }
+
+  // The source of the subtree at `idx`, i.e. the value being differentiated.
+  Term value(uint32_t idx) {
+    if (!rendered[idx].empty())
+      return {rendered[idx]};
+    const ExprNode &node = tree.nodes[idx];
+    std::string text;
+    switch (node.op) {
+    case Op::PUSH_V: {
+      double v = tree.constants[node.operand];
+      if (!std::isfinite(v))
+        failed = true;
+      text = number(v).text;
+      break;
+    }
+    case Op::GET_V:
+      text = USER_VARIABLE_IDENT + std::to_string(node.operand);
+      break;
+    default:
+      text = opSymbol(node.op);
+      for (uint8_t i = 0; i < node.arity; i++)
+        text += (i ? "," : "") + value(node.children[i]).text;
+    }
+    rendered[idx] = text;
+    return {text};
+  }
+
+  Term derive(uint32_t idx) {
+    const ExprNode &node = tree.nodes[idx];
+    auto child = [&](int i) { return node.children[i]; };
+    switch (node.op) {
+    case Op::PUSH_V:
+      return number(0);
+    case Op::GET_V:
+      return number(node.operand == variable ? 1 : 0);
+    case Op::ADD:
+      return add(derive(child(0)), derive(child(1)));
+    case Op::SUB:
+      return sub(derive(child(0)), derive(child(1)));
+    case Op::MUL: {
+      Term a = value(child(0)), b = value(child(1));
+      return add(mul(derive(child(0)), b), mul(a, derive(child(1))));
+    }
+    case Op::DIV: {
+      // Where b is zero the VMs define a / b as 0, and so is this.
+      Term a = value(child(0)), b = value(child(1));
+      Term da = derive(child(0)), db = derive(child(1));
+      if (isZero(db))
+        return div(da, b);
+      return div(sub(mul(da, b), mul(a, db)), mul(b, b));
+    }
+    case Op::POW: {
+      Term a = value(child(0)), b = value(child(1));
+      Term da = derive(child(0)), db = derive(child(1));
+      if (isZero(db))
+        return mul(mul(b, call(Op::POW, {a, sub(b, number(1))})), da);
+      Term pow = value(idx);
+      Term log = call(Op::LOG, {a});
+      if (isZero(da))
+        return mul(mul(pow, log), db);
+      return mul(pow, add(mul(db, log), div(mul(b, da), a)));
+    }
+    case Op::MIN:
+    case Op::MAX: {
+      // The comparisons yield +1 or -1, which WHETHER reads as a condition.
+      Term a = value(child(0)), b = value(child(1));
+      Term da = derive(child(0)), db = derive(child(1));
+      if (da.constant && db.constant && da.value == db.value)
+        return da;
+      return call(Op::WHETHER,
+                  {call(node.op == Op::MIN ? Op::LT : Op::GT, {a, b}), da, db});
+    }
+    case Op::MOD: {
+      // fmod(a, b) has slope 1 in a; a varying divisor is not handled.
+      if (!isZero(derive(child(1))))
+        break;
+      return derive(child(0));
+    }
+    case Op::LOG_N: {
+      // log_a(b) = ln b / ln a.
+      Term a = value(child(0)), b = value(child(1));
+      Term da = derive(child(0)), db = derive(child(1));
+      Term lna = call(Op::LOG, {a}), lnb = call(Op::LOG, {b});
+      Term num = sub(mul(div(db, b), lna), mul(lnb, div(da, a)));
+      return div(num, mul(lna, lna));
+    }
+    case Op::SIN:
+      return mul(call(Op::COS, {value(child(0))}), derive(child(0)));
+    case Op::COS:
+      return mul(mul(number(-1), call(Op::SIN, {value(child(0))})),
+                 derive(child(0)));
+    case Op::ABS:
+      return mul(call(Op::GT, {value(child(0)), number(0)}), derive(child(0)));
+    case Op::LOG:
+      return div(derive(child(0)), value(child(0)));
+    case Op::LOG2:
+      return div(derive(child(0)),
+                 mul(value(child(0)), number(std::log(2.0))));
+    case Op::LOG10:
+      return div(derive(child(0)),
+                 mul(value(child(0)), number(std::log(10.0))));
+    case Op::SQRT:
+      return div(derive(child(0)), mul(number(2), value(idx)));
+    case Op::CBRT:
+      return div(derive(child(0)),
+                 mul(number(3), call(Op::POW, {value(idx), number(2)})));
+    case Op::WHETHER:
+      return call(Op::WHETHER, {value(child(0)), derive(child(1)),
+                                derive(child(2))});
+    // Piecewise constant, so flat wherever they are differentiable.
+    case Op::NOT:
+    case Op::LT:
+    case Op::GT:
+    case Op::EQ:
+    case Op::NE:
+    case Op::L_AND:
+    case Op::L_OR:
+    case Op::ROUND:
+      return number(0);
+    default:
+      // FACTORIAL needs the digamma function; loops are not differentiated.
+      break;
+    }
+    failed = true;
+    return number(0);
+  }
+
+public:
+  Differentiator(const ExprTree &parsed, size_t var)
+      : tree(parsed), variable(var), rendered(parsed.nodes.size()) {}
+
+  // Spells d(expr)/d$var into `out`. Fails on parse errors and on operators
+  // without a rule, leaving `out` unchanged.
+  static bool differentiate(const char *eq, size_t var, std::string &out) {
+    ExprTree tree;
+    uint32_t root = tree.parse(eq);
+    if (tree.hasError() || tree.hasLoops)
+      return false;
+    Differentiator d(tree, var);
+    Term result = d.derive(root);
+    if (d.failed)
+      return false;
+    out = result.text;
+    return true;
+  }
+};
+
+struct Bracket {
+  double lo;
+  double hi;
+};
+
+struct SolveOptions {
+  // Relative tolerance on x, plus the same amount absolute near zero.
+  double tolerance = 1e-12;
+  int maxIterations = 100;
+};
+
+struct SolveResult {
+  double x = 0;
+  // f(x) at the returned x.
+  double value = 0;
+  int iterations = 0;
+  // Evaluations of f, plus of f' for Newton.
+  size_t evaluations = 0;
+  bool converged = false;
+};
+
+// Totals over the problems of the last solve call.
+struct SolveStats {
+  size_t problems = 0;
+  size_t converged = 0;
+  size_t iterations = 0;
+  int maxIterations = 0;
+  size_t evaluations = 0;
+  // Passes over the compiled program, each serving up to LANES problems.
+  size_t batches = 0;
+};
+
+// Root finding and minimisation of an expression in one $n, with the other
+// $n held fixed. Each solver is a state machine asking for f at one point
+// per step, so independent problems are stepped together, LANES at a time,
+// through one vectorised evaluation. Expressions the VM cannot run (loops)
+// are evaluated one point at a time with V1.
+class Solver {
+public:
+  static constexpr size_t LANES = 4;
+  using LaneVM = BasicFunctionParserV2<Lanes<double, LANES>>;
+  // Relative step of the central differences used without a derivative.
+  static constexpr double FD_STEP = 1e-6;
+
+private:
+  std::string expression;
+  std::string derivative;
+  size_t variable;
+  std::vector<double> args;
+  std::unique_ptr<LaneVM> f, df;
+  std::vector<Lanes<double, LANES>> laneArgs;
+  ExprFunc fallback;
+  SolveStats lastStats;
+
+  // f (or f') at xs[0..n). Unused lanes repeat the last point.
+  void evalLanes(const double *xs, size_t n, double *ys, bool slope) {
+    lastStats.batches++;
+    if (!f) {
+      std::vector<double> local = args;
+      for (size_t i = 0; i < n; i++) {
+        local[variable] = xs[i];
+        ys[i] = slope ? centralDifference(xs[i]) : fallback(local);
+      }
+      return;
+    }
+    if (slope && !df) {
+      // Central differences, batched like f itself.
+      double plus[LANES] = {}, minus[LANES] = {}, h[LANES], yp[LANES],
+          ym[LANES];
+      for (size_t i = 0; i < n; i++) {
+        h[i] = FD_STEP * std::max(1.0, std::abs(xs[i]));
+        plus[i] = xs[i] + h[i];
+        minus[i] = xs[i] - h[i];
+      }
+      evalLanes(plus, n, yp, false);
+      evalLanes(minus, n, ym, false);
+      for (size_t i = 0; i < n; i++)
+        ys[i] = (yp[i] - ym[i]) / (2 * h[i]);
+      return;
+    }
+    for (size_t l = 0; l < LANES; l++)
+      laneArgs[variable][l] = xs[std::min(l, n - 1)];
+    Lanes<double, LANES> out = (slope ? *df : *f).eval(laneArgs);
+    for (size_t i = 0; i < n; i++)
+      ys[i] = out[i];
+  }
+
+  // Slope estimate for V1, one point at a time.
+  double centralDifference(double x) {
+    double h = FD_STEP * std::max(1.0, std::abs(x));
+    std::vector<double> local = args;
+    local[variable] = x + h;
+    double yp = fallback(local);
+    local[variable] = x - h;
+    return (yp - fallback(local)) / (2 * h);
+  }
+
+  // Steps every problem to completion, refilling lanes as problems finish.
+  template <typename Problem>
+  std::vector<SolveResult> run(std::vector<Problem> problems) {
+    lastStats = {};
+    lastStats.problems = problems.size();
+    std::vector<size_t> active;
+    size_t next = 0;
+    double xs[LANES], fx[LANES], dfx[LANES] = {};
+    while (true) {
+      while (active.size() < LANES && next < problems.size())
+        active.push_back(next++);
+      if (active.empty())
+        break;
+      for (size_t i = 0; i < active.size(); i++)
+        xs[i] = problems[active[i]].point();
+      evalLanes(xs, active.size(), fx, false);
+      if (Problem::NEEDS_SLOPE)
+        evalLanes(xs, active.size(), dfx, true);
+      for (size_t i = 0; i < active.size(); i++)
+        problems[active[i]].step(fx[i], dfx[i]);
+      std::erase_if(active, [&](size_t p) { return problems[p].done; });
+    }
+
+    std::vector<SolveResult> results;
+    results.reserve(problems.size());
+    for (const Problem &p : problems) {
+      results.push_back(p.result);
+      lastStats.converged += p.result.converged;
+      lastStats.iterations += p.result.iterations;
+      lastStats.maxIterations =
+          std::max(lastStats.maxIterations, p.result.iterations);
+      lastStats.evaluations += p.result.evaluations;
+    }
+    return results;
+  }
+
+  static bool closeEnough(double step, double x, double tol) {
+    return std::abs(step) <= tol * (1 + std::abs(x));
+  }
+
+  struct NewtonProblem {
+    static constexpr bool NEEDS_SLOPE = true;
+    SolveOptions options;
+    double x;
+    SolveResult result;
+    bool done = false;
+    // The last step was small enough; this evaluation reports f there.
+    bool settled = false;
+
+    double point() const { return x; }
+
+    void step(double fx, double dfx) {
+      result.evaluations += 2;
+      result.x = x;
+      result.value = fx;
+      if (settled || fx == 0) {
+        result.converged = true;
+        done = true;
+        return;
+      }
+      if (result.iterations >= options.maxIterations || !std::isfinite(fx) ||
+          dfx == 0 || !std::isfinite(dfx)) {
+        done = true;
+        return;
+      }
+      double dx = fx / dfx;
+      x -= dx;
+      result.iterations++;
+      settled = closeEnough(dx, x, options.tolerance);
+    }
+  };
+
+  // Brent's method: inverse quadratic interpolation and secant steps,
+  // falling back to bisection whenever they do not shrink the bracket fast
+  // enough. Follows the structure of Brent's zeroin.
+  struct BrentProblem {
+    static constexpr bool NEEDS_SLOPE = false;
+    SolveOptions options;
+    double a, b, c = 0, fa = 0, fb = 0, fc = 0, d = 0, e = 0;
+    int phase = 0;
+    SolveResult result;
+    bool done = false;
+
+    BrentProblem(SolveOptions opts, Bracket br)
+        : options(opts), a(br.lo), b(br.hi) {}
+
+    double point() const { return phase == 0 ? a : b; }
+
+    void step(double fx, double) {
+      result.evaluations++;
+      if (phase == 0) {
+        fa = fx;
+        phase = 1;
+        return;
+      }
+      fb = fx;
+      if (phase == 1) {
+        phase = 2;
+        if ((fa > 0 && fb > 0) || (fa < 0 && fb < 0) || std::isnan(fa) ||
+            std::isnan(fb)) {
+          // Not a bracket: report the better end.
+          bool aBetter = std::abs(fa) < std::abs(fb);
+          double best = aBetter ? fa : fb;
+          finish(aBetter ? a : b, best, best == 0);
+          return;
+        }
+        c = b;
+        fc = fb;
+      }
+
+      if ((fb > 0 && fc > 0) || (fb < 0 && fc < 0)) {
+        c = a;
+        fc = fa;
+        e = d = b - a;
+      }
+      if (std::abs(fc) < std::abs(fb)) {
+        a = b;
+        b = c;
+        c = a;
+        fa = fb;
+        fb = fc;
+        fc = fa;
+      }
+      double tol = 2 * std::numeric_limits<double>::epsilon() * std::abs(b) +
+                   0.5 * options.tolerance * (1 + std::abs(b));
+      double xm = 0.5 * (c - b);
+      if (std::abs(xm) <= tol || fb == 0) {
+        finish(b, fb, true);
+        return;
+      }
+      if (result.iterations >= options.maxIterations) {
+        finish(b, fb, false);
+        return;
+      }
+      if (std::abs(e) >= tol && std::abs(fa) > std::abs(fb)) {
+        double s = fb / fa, p, q;
+        if (a == c) {
+          p = 2 * xm * s;
+          q = 1 - s;
+        } else {
+          double r = fb / fc;
+          q = fa / fc;
+          p = s * (2 * xm * q * (q - r) - (b - a) * (r - 1));
+          q = (q - 1) * (r - 1) * (s - 1);
+        }
+        if (p > 0)
+          q = -q;
+        p = std::abs(p);
+        if (2 * p < std::min(3 * xm * q - std::abs(tol * q), std::abs(e * q))) {
+          e = d;
+          d = p / q;
+        } else {
+          d = xm;
+          e = d;
+        }
+      } else {
+        d = xm;
+        e = d;
+      }
+      a = b;
+      fa = fb;
+      b += std::abs(d) > tol ? d : std::copysign(tol, xm);
+      result.iterations++;
+    }
+
+    void finish(double x, double fx, bool converged) {
+      result.x = x;
+      result.value = fx;
+      result.converged = converged;
+      done = true;
+    }
+  };
+
+  // Golden-section search for a minimum; shrinks the bracket by the golden
+  // ratio per evaluation, keeping one interior point from the last step.
+  struct GoldenProblem {
+    static constexpr bool NEEDS_SLOPE = false;
+    static constexpr double RATIO = 0.6180339887498949;
+    SolveOptions options;
+    double a, b, c, d, fc = 0, fd = 0;
+    // Which interior point the next evaluation is for.
+    bool wantC = true;
+    bool primed = false;
+    SolveResult result;
+    bool done = false;
+
+    GoldenProblem(SolveOptions opts, Bracket br)
+        : options(opts), a(br.lo), b(br.hi), c(b - RATIO * (b - a)),
+          d(a + RATIO * (b - a)) {}
+
+    double point() const { return wantC ? c : d; }
+
+    void step(double fx, double) {
+      result.evaluations++;
+      if (!primed) {
+        // The first two evaluations fill in both interior points.
+        if (wantC) {
+          fc = fx;
+          wantC = false;
+          return;
+        }
+        fd = fx;
+        primed = true;
+      } else if (wantC) {
+        fc = fx;
+      } else {
+        fd = fx;
+      }
+
+      bool best = fc < fd;
+      result.x = best ? c : d;
+      result.value = best ? fc : fd;
+      if (closeEnough(b - a, result.x, options.tolerance) ||
+          result.iterations >= options.maxIterations) {
+        result.converged = result.iterations < options.maxIterations;
+        done = true;
+        return;
+      }
+      result.iterations++;
+      if (best) {
+        b = d;
+        d = c;
+        fd = fc;
+        c = b - RATIO * (b - a);
+        wantC = true;
+      } else {
+        a = c;
+        c = d;
+        fc = fd;
+        d = a + RATIO * (b - a);
+        wantC = false;
+      }
+    }
+  };
+
+public:
+  // Solves for $var in `expr`, reading every other $n from `in`.
+  Solver(const std::string &expr, size_t var, std::vector<double> in = {})
+      : expression(expr), variable(var), args(std::move(in)) {
+    if (args.size() <= variable)
+      args.resize(variable + 1, 0.0);
+    f = std::make_unique<LaneVM>(expression.c_str());
+    if (!f->isSupported()) {
+      f.reset();
+      const char *ptr = expression.c_str();
+      fallback = parseExpression(ptr);
+      return;
+    }
+    laneArgs.assign(args.begin(), args.end());
+    if (Differentiator::differentiate(expression.c_str(), variable,
+                                      derivative)) {
+      df = std::make_unique<LaneVM>(derivative.c_str());
+      if (!df->isSupported())
+        df.reset();
+    }
+  }
+
+  // Newton's method from each start, using f' from differentiation where
+  // the expression allows it and central differences otherwise.
+  std::vector<SolveResult> newton(const std::vector<double> &starts,
+                                  SolveOptions options = {}) {
+    std::vector<NewtonProblem> problems;
+    for (double x : starts)
+      problems.push_back({options, x, {}});
+    return run(std::move(problems));
+  }
+
+  // A root inside each bracket, whose ends must differ in sign.
+  std::vector<SolveResult> brent(const std::vector<Bracket> &brackets,
+                                 SolveOptions options = {}) {
+    std::vector<BrentProblem> problems;
+    for (const Bracket &br : brackets)
+      problems.emplace_back(options, br);
+    return run(std::move(problems));
+  }
+
+  // A local minimum inside each bracket.
+  std::vector<SolveResult> goldenSection(const std::vector<Bracket> &brackets,
+                                         SolveOptions options = {}) {
+    std::vector<GoldenProblem> problems;
+    for (const Bracket &br : brackets)
+      problems.emplace_back(options, br);
+    return run(std::move(problems));
+  }
+
+  const SolveStats &stats() const { return lastStats; }
+  bool usesVM() const { return f != nullptr; }
+  // False when f' comes from central differences.
+  bool hasDerivative() const { return df != nullptr; }
+  const std::string &derivativeSource() const { return derivative; }
+};
+} // namespace functionlang
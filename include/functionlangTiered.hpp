@@ -0,0 +1,189 @@
+#pragma once
+#include <functionlangRegister.hpp>
+#include <functionlangV2.hpp>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+
+namespace functionlang {
+
+// Engines an expression moves through as it gets hotter. V1 closures are
+// the cheapest to build; the register VM is the closest thing to native
+// code this library has.
+enum class Tier : uint8_t { CLOSURE, BYTECODE, REGISTER };
+
+inline const char *tierName(Tier tier) {
+  switch (tier) {
+  case Tier::CLOSURE:
+    return "closure";
+  case Tier::BYTECODE:
+    return "bytecode";
+  default:
+    return "register";
+  }
+}
+
+struct TierPolicy {
+  // Evaluations before the bytecode VM is compiled in the background.
+  uint64_t bytecodeAfter = 64;
+  // Evaluations before the register VM is tried.
+  uint64_t registerAfter = 4096;
+  // Runs of each VM timed to decide whether the register VM is faster.
+  uint64_t trialRuns = 2000;
+};
+
+// Process-wide tier transitions, readable while evaluations run.
+struct TierCounters {
+  std::atomic<uint64_t> handles{0};
+  std::atomic<uint64_t> bytecodePromotions{0};
+  std::atomic<uint64_t> registerPromotions{0};
+  // The register VM was compiled but timed slower, or disagreed.
+  std::atomic<uint64_t> registerRejected{0};
+  // V2 could not compile the expression, e.g. it uses loops, or disagreed
+  // with V1.
+  std::atomic<uint64_t> closureFallbacks{0};
+};
+
+inline TierCounters tierCounters;
+
+// One handle per expression that starts on V1 and is recompiled to faster
+// engines on a background thread once it has been evaluated often enough.
+// A finished engine is swapped in between two evaluations. A handle is
+// evaluated by one thread at a time.
+class TieredFunction {
+private:
+  struct Engine {
+    Tier tier;
+    ExprFunc run;
+  };
+
+  // Where the compile thread leaves a finished engine for eval() to adopt.
+  struct Handoff {
+    std::mutex mutex;
+    std::optional<Engine> next;
+    std::atomic<bool> ready{false};
+
+    void publish(Engine engine) {
+      std::lock_guard lock(mutex);
+      next = std::move(engine);
+      ready.store(true, std::memory_order_release);
+    }
+  };
+
+  std::string expression;
+  TierPolicy policy;
+  Engine active;
+  uint64_t evaluations = 0;
+  bool registerTried = false;
+  std::shared_ptr<Handoff> handoff = std::make_shared<Handoff>();
+  // Declared last, so it is joined before the members it may still read.
+  std::jthread compiler;
+
+  void adopt() {
+    std::lock_guard lock(handoff->mutex);
+    active = std::move(*handoff->next);
+    handoff->next.reset();
+    handoff->ready.store(false, std::memory_order_relaxed);
+    if (active.tier == Tier::BYTECODE)
+      tierCounters.bytecodePromotions++;
+    else
+      tierCounters.registerPromotions++;
+  }
+
+  // Swaps in V2 only if it agrees with V1 on `sample`, the arguments of the
+  // evaluation that triggered it, so results do not change mid-run.
+  void compileBytecode(const std::vector<double> &sample) {
+    compiler = std::jthread([expr = expression, handoff = handoff, sample] {
+      FUNCTIONLANG_TRACE_SPAN(span, "tier up to bytecode", "compile");
+      auto vm = std::make_shared<FunctionParserV2>(expr.c_str());
+      if (!vm->isSupported()) {
+        tierCounters.closureFallbacks++;
+        return;
+      }
+      const char *ptr = expr.c_str();
+      double closureResult = parseExpression(ptr)(sample);
+      double stackResult = vm->eval(sample);
+      if (closureResult != stackResult &&
+          !(std::isnan(closureResult) && std::isnan(stackResult))) {
+        tierCounters.closureFallbacks++;
+        return;
+      }
+      handoff->publish({Tier::BYTECODE, [vm](ExprFuncRet args) {
+                          return vm->eval(args);
+                        }});
+    });
+  }
+
+  // Times both VMs on `sample`, the arguments of a recent evaluation, and
+  // swaps in the register VM only if it is faster and agrees with V2.
+  void compileRegister(const std::vector<double> &sample) {
+    compiler = std::jthread([expr = expression, handoff = handoff,
+                             runs = policy.trialRuns, sample] {
+      FUNCTIONLANG_TRACE_SPAN(span, "tier up to register", "compile");
+      FunctionParserV2 stackVM(expr.c_str());
+      auto regVM = std::make_shared<FunctionParserReg>(expr.c_str());
+
+      auto time = [&](auto &vm, double &result) {
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < runs; i++)
+          result = vm.eval(sample);
+        return std::chrono::steady_clock::now() - start;
+      };
+      double stackResult = 0, regResult = 0;
+      auto stackTime = time(stackVM, stackResult);
+      auto regTime = time(*regVM, regResult);
+
+      bool agrees = stackResult == regResult ||
+                    (std::isnan(stackResult) && std::isnan(regResult));
+      if (!agrees || regTime >= stackTime) {
+        tierCounters.registerRejected++;
+        return;
+      }
+      handoff->publish({Tier::REGISTER, [regVM](ExprFuncRet args) {
+                          return regVM->eval(args);
+                        }});
+    });
+  }
+
+public:
+  TieredFunction(std::string expr, TierPolicy tierPolicy = {})
+      : expression(std::move(expr)), policy(tierPolicy) {
+    const char *ptr = expression.c_str();
+    active = {Tier::CLOSURE, parseExpression(ptr)};
+    tierCounters.handles++;
+  }
+
+  TieredFunction(const TieredFunction &) = delete;
+  TieredFunction &operator=(const TieredFunction &) = delete;
+
+  double eval(const std::vector<double> &args) {
+    if (handoff->ready.load(std::memory_order_acquire))
+      adopt();
+    evaluations++;
+    if (evaluations == policy.bytecodeAfter)
+      compileBytecode(args);
+    else if (evaluations >= policy.registerAfter && !registerTried &&
+             active.tier == Tier::BYTECODE) {
+      registerTried = true;
+      compileRegister(args);
+    }
+    return active.run(args);
+  }
+
+  double operator()(const std::vector<double> &args) { return eval(args); }
+
+  Tier tier() const { return active.tier; }
+  uint64_t evaluationCount() const { return evaluations; }
+  const std::string &source() const { return expression; }
+
+  // Blocks until the background compile in progress, if any, has finished.
+  // Its engine is adopted by the next eval().
+  void waitForCompile() {
+    if (compiler.joinable())
+      compiler.join();
+  }
+};
+} // namespace functionlang
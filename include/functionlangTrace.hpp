@@ -0,0 +1,251 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Scoped spans around parsing, compilation passes and aggregate loops, for
+// telling where a slow request spent its time. Spans are compiled in only
+// with -DFUNCTIONLANG_TRACE (make TRACE=1) and record only while enabled at
+// runtime, so the default build pays nothing and a tracing build pays one
+// relaxed load per span while off.
+//
+// Each thread writes its own ring of the latest RING_EVENTS spans, which
+// exportChrome() turns into Chrome trace JSON for chrome://tracing or
+// Perfetto. Rings outlive their threads and are reused by new ones.
+namespace functionlang::trace {
+
+#ifdef FUNCTIONLANG_TRACE
+constexpr bool COMPILED = true;
+#else
+constexpr bool COMPILED = false;
+#endif
+
+const size_t RING_EVENTS = 16384;
+
+// Relaxed atomics, so an export racing a writer stays well-defined; the
+// ring's count tells it which events may have been overwritten.
+struct Event {
+  std::atomic<const char *> name{nullptr};
+  std::atomic<const char *> category{nullptr};
+  std::atomic<const char *> argName{nullptr};
+  std::atomic<uint64_t> arg{0};
+  std::atomic<uint64_t> start{0};
+  std::atomic<uint64_t> duration{0};
+  std::atomic<uint32_t> thread{0};
+};
+
+struct Ring {
+  std::array<Event, RING_EVENTS> events;
+  std::atomic<uint64_t> written{0};
+};
+
+namespace detail {
+inline std::atomic<bool> enabled{false};
+
+inline const std::chrono::steady_clock::time_point epoch =
+    std::chrono::steady_clock::now();
+
+inline uint64_t now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - epoch)
+      .count();
+}
+
+struct Registry {
+  std::mutex mutex;
+  std::vector<std::shared_ptr<Ring>> rings;
+  // Rings of exited threads, handed to the next new one.
+  std::vector<std::shared_ptr<Ring>> idle;
+  uint32_t threads = 0;
+};
+
+inline Registry &registry() {
+  static Registry r;
+  return r;
+}
+
+// The calling thread's ring, taken on its first span.
+class ThreadRing {
+private:
+  std::shared_ptr<Ring> ring;
+
+public:
+  uint32_t thread = 0;
+
+  Ring &get() {
+    if (!ring) {
+      Registry &r = registry();
+      std::lock_guard<std::mutex> lock(r.mutex);
+      thread = ++r.threads;
+      if (r.idle.empty()) {
+        ring = std::make_shared<Ring>();
+        r.rings.push_back(ring);
+      } else {
+        ring = std::move(r.idle.back());
+        r.idle.pop_back();
+      }
+    }
+    return *ring;
+  }
+
+  ~ThreadRing() {
+    if (!ring)
+      return;
+    Registry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.idle.push_back(std::move(ring));
+  }
+};
+
+inline thread_local ThreadRing threadRing;
+
+inline void record(const char *name, const char *category,
+                   const char *argName, uint64_t arg, uint64_t start,
+                   uint64_t end) {
+  Ring &ring = threadRing.get();
+  uint64_t n = ring.written.load(std::memory_order_relaxed);
+  Event &e = ring.events[n % RING_EVENTS];
+  e.name.store(name, std::memory_order_relaxed);
+  e.category.store(category, std::memory_order_relaxed);
+  e.argName.store(argName, std::memory_order_relaxed);
+  e.arg.store(arg, std::memory_order_relaxed);
+  e.start.store(start, std::memory_order_relaxed);
+  e.duration.store(end - start, std::memory_order_relaxed);
+  e.thread.store(threadRing.thread, std::memory_order_relaxed);
+  ring.written.store(n + 1, std::memory_order_release);
+}
+} // namespace detail
+
+inline bool enabled() {
+  return detail::enabled.load(std::memory_order_relaxed);
+}
+
+// Has no effect on spans unless they were compiled in.
+inline void setEnabled(bool on) {
+  detail::enabled.store(on, std::memory_order_relaxed);
+}
+
+// Times its scope. With `depth`, a per-call-site counter, only the
+// outermost of recursive spans is recorded.
+class Span {
+private:
+  const char *name = nullptr;
+  const char *category;
+  const char *argName = nullptr;
+  uint64_t value = 0;
+  uint64_t start = 0;
+  unsigned *depth;
+
+public:
+  Span(const char *n, const char *cat, unsigned *d = nullptr)
+      : category(cat), depth(d) {
+    if ((depth == nullptr || (*depth)++ == 0) && enabled()) {
+      name = n;
+      start = detail::now();
+    }
+  }
+  ~Span() {
+    if (depth != nullptr)
+      --*depth;
+    if (name != nullptr)
+      detail::record(name, category, argName, value, start, detail::now());
+  }
+  Span(const Span &) = delete;
+  Span &operator=(const Span &) = delete;
+
+  // Shown in the event's args; `key` must be a string literal.
+  void arg(const char *key, uint64_t v) {
+    argName = key;
+    value = v;
+  }
+};
+
+// Calls `f` on every event still in a ring, oldest first per thread.
+template <typename F> void forEachEvent(F &&f) {
+  detail::Registry &r = detail::registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  for (const std::shared_ptr<Ring> &ring : r.rings) {
+    uint64_t end = ring->written.load(std::memory_order_acquire);
+    uint64_t begin = end > RING_EVENTS ? end - RING_EVENTS : 0;
+    for (uint64_t i = begin; i < end; i++) {
+      const Event &e = ring->events[i % RING_EVENTS];
+      const char *name = e.name.load(std::memory_order_relaxed);
+      const char *category = e.category.load(std::memory_order_relaxed);
+      const char *argName = e.argName.load(std::memory_order_relaxed);
+      uint64_t arg = e.arg.load(std::memory_order_relaxed);
+      uint64_t start = e.start.load(std::memory_order_relaxed);
+      uint64_t duration = e.duration.load(std::memory_order_relaxed);
+      uint32_t thread = e.thread.load(std::memory_order_relaxed);
+      // Skips what the owning thread overwrote while it was read.
+      uint64_t now = ring->written.load(std::memory_order_acquire);
+      if (now > RING_EVENTS && i < now - RING_EVENTS)
+        continue;
+      f(name, category, argName, arg, start, duration, thread);
+    }
+  }
+}
+
+inline size_t eventCount() {
+  size_t count = 0;
+  forEachEvent([&](auto &&...) { count++; });
+  return count;
+}
+
+// Drops every recorded event.
+inline void clear() {
+  detail::Registry &r = detail::registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  for (const std::shared_ptr<Ring> &ring : r.rings)
+    ring->written.store(0, std::memory_order_release);
+}
+
+// The recorded spans as complete ("X") events of Chrome's trace format,
+// timestamps in microseconds since the process started.
+inline std::string exportChrome() {
+  std::ostringstream out;
+  out.precision(3);
+  out << std::fixed << "{\"traceEvents\":[";
+  bool first = true;
+  forEachEvent([&](const char *name, const char *category,
+                   const char *argName, uint64_t arg, uint64_t start,
+                   uint64_t duration, uint32_t thread) {
+    out << (first ? "\n" : ",\n") << "{\"name\":\"" << name
+        << "\",\"cat\":\"" << category << "\",\"ph\":\"X\",\"ts\":"
+        << start / 1e3 << ",\"dur\":" << duration / 1e3
+        << ",\"pid\":1,\"tid\":" << thread;
+    if (argName != nullptr)
+      out << ",\"args\":{\"" << argName << "\":" << arg << "}";
+    out << "}";
+    first = false;
+  });
+  out << "\n],\"displayTimeUnit\":\"ns\"}\n";
+  return out.str();
+}
+
+inline bool writeChrome(const std::string &path) {
+  std::ofstream file(path);
+  file << exportChrome();
+  return static_cast<bool>(file);
+}
+} // namespace functionlang::trace
+
+#ifdef FUNCTIONLANG_TRACE
+#define FUNCTIONLANG_TRACE_SPAN(var, name, category)                          \
+  ::functionlang::trace::Span var(name, category)
+// Records only the outermost span of a recursive function.
+#define FUNCTIONLANG_TRACE_OUTER_SPAN(var, name, category)                    \
+  static thread_local unsigned var##Depth = 0;                                \
+  ::functionlang::trace::Span var(name, category, &var##Depth)
+#define FUNCTIONLANG_TRACE_ARG(var, key, value) var.arg(key, value)
+#else
+#define FUNCTIONLANG_TRACE_SPAN(var, name, category) ((void)0)
+#define FUNCTIONLANG_TRACE_OUTER_SPAN(var, name, category) ((void)0)
+#define FUNCTIONLANG_TRACE_ARG(var, key, value) ((void)0)
+#endif
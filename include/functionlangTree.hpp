@@ -0,0 +1,174 @@
+#pragma once
+#include <cstring>
+#include <functionlang.hpp>
+#include <string>
+#include <unordered_map>
+
+namespace functionlang {
+
+// Largest $n or @n index the tree can address.
+const uint32_t MAX_VARIABLE_INDEX = 255;
+
+// Leaves are PUSH_V (operand indexes constants), GET_V and GET_IV (operand
+// is the variable index).
+struct ExprNode {
+  Op op;
+  uint8_t arity = 0;
+  uint32_t operand = 0;
+  uint32_t children[5] = {0, 0, 0, 0, 0};
+};
+
+// First problem found in the input, with its offset from the start of the
+// expression being parsed.
+struct ParseError {
+  std::string message;
+  size_t position = 0;
+  // Set for input V1 accepts but the VMs cannot compile: V1 reads any
+  // variable index and ignores what follows the expression.
+  bool vmOnly = false;
+};
+
+// Expression tree built in one recursive-descent pass over the input, each
+// token classified by OPERATOR_TABLE. Nodes are stored in post-order, so
+// children always precede their parent.
+class ExprTree {
+private:
+  // With sharing on, identical subtrees are interned to one node, turning
+  // the forest of parsed expressions into a DAG.
+  bool shareSubtrees;
+  std::unordered_map<std::string, uint32_t> interned;
+  const char *source = nullptr;
+
+  uint32_t add(const ExprNode &node, double value = 0.0) {
+    parsedNodes++;
+    if (!shareSubtrees) {
+      nodes.push_back(node);
+      return static_cast<uint32_t>(nodes.size() - 1);
+    }
+    std::string key(1, static_cast<char>(node.op));
+    if (node.op == Op::PUSH_V)
+      key.append(reinterpret_cast<const char *>(&value), sizeof value);
+    else if (node.arity == 0)
+      key.append(reinterpret_cast<const char *>(&node.operand),
+                 sizeof node.operand);
+    else
+      key.append(reinterpret_cast<const char *>(node.children),
+                 node.arity * sizeof node.children[0]);
+
+    auto [it, inserted] =
+        interned.emplace(key, static_cast<uint32_t>(nodes.size()));
+    if (inserted)
+      nodes.push_back(node);
+    else if (node.op == Op::PUSH_V)
+      constants.pop_back();
+    return it->second;
+  }
+
+  uint32_t addConstant(double v) {
+    constants.push_back(v);
+    return add({Op::PUSH_V, 0, static_cast<uint32_t>(constants.size() - 1), {}},
+               v);
+  }
+
+  // Records the first error only and yields a placeholder operand, so the
+  // caller can unwind without special cases. A syntax error replaces an
+  // earlier VM-only one, which does not stop the parse.
+  uint32_t fail(const char *at, const char *message, bool vmOnly = false) {
+    if (!hasError() || (error.vmOnly && !vmOnly))
+      error = {message, static_cast<size_t>(at - source), vmOnly};
+    return addConstant(DEFAULT_RESULT);
+  }
+
+  static void skipSeparators(const char *&ptr) {
+    while (*ptr == ' ' || *ptr == ',' || *ptr == '\t' || *ptr == '(' ||
+           *ptr == ')')
+      ptr++;
+  }
+
+  uint32_t parseNode(const char *&ptr) {
+    skipSeparators(ptr);
+    if (*ptr == '\0')
+      return fail(ptr, "unexpected end of expression");
+
+    const char *start = ptr;
+    const OperatorInfo &info = operatorInfo(*ptr++);
+    switch (info.kind) {
+    case TokenKind::USER_VARIABLE:
+    case TokenKind::INTERNAL_VARIABLE: {
+      if (!std::isdigit(static_cast<unsigned char>(*ptr)))
+        return fail(ptr, "missing variable index");
+      char *endPtr;
+      unsigned long idx = std::strtoul(ptr, &endPtr, 10);
+      ptr = endPtr;
+      if (idx > MAX_VARIABLE_INDEX)
+        return fail(start, "variable index out of range", true);
+      return add({info.opcode, 0, static_cast<uint32_t>(idx), {}});
+    }
+    case TokenKind::NUMBER: {
+      char *endPtr;
+      double v = std::strtod(start, &endPtr);
+      if (endPtr == start) {
+        ptr = start + 1;
+        return fail(start, "malformed number");
+      }
+      ptr = endPtr;
+      return addConstant(v);
+    }
+    case TokenKind::CONSTANT:
+      return addConstant(*start == CONSTS_ENUM::PI ? M_PI : M_E);
+    case TokenKind::OPERATOR:
+      break;
+    default:
+      return fail(start, "unknown operator");
+    }
+
+    ExprNode node{info.opcode, info.arity, 0, {}};
+    for (uint8_t i = 0; i < node.arity && !hasSyntaxError(); i++)
+      node.children[i] = parseNode(ptr);
+    if (hasSyntaxError())
+      return addConstant(DEFAULT_RESULT);
+    hasLoops |= node.arity > 3;
+    return add(node);
+  }
+
+public:
+  std::vector<ExprNode> nodes;
+  std::vector<double> constants;
+  ParseError error;
+  // Set when the tree holds A/P/I nodes, which the VMs cannot execute.
+  bool hasLoops = false;
+  // Nodes seen by the parser, before any sharing.
+  size_t parsedNodes = 0;
+
+  ExprTree(bool share = false) : shareSubtrees(share) {}
+
+  // Parses one expression and checks nothing but separators follows it.
+  // Error positions are relative to `ptr` as passed in.
+  uint32_t parse(const char *&ptr) {
+    FUNCTIONLANG_TRACE_SPAN(span, "ExprTree::parse", "compile");
+    source = ptr;
+    // Every node but the separators takes at least one character.
+    size_t length = std::strlen(ptr);
+    nodes.reserve(nodes.size() + length / 2 + 1);
+    uint32_t root = parseNode(ptr);
+    skipSeparators(ptr);
+    if (*ptr != '\0')
+      fail(ptr, "unexpected trailing input", true);
+    return root;
+  }
+
+  // Any error; the VMs compile only trees without one.
+  bool hasError() const { return !error.message.empty(); }
+  // An error V1 rejects as well.
+  bool hasSyntaxError() const { return hasError() && !error.vmOnly; }
+
+  void clear() {
+    nodes.clear();
+    constants.clear();
+    interned.clear();
+    error = {};
+    hasLoops = false;
+    parsedNodes = 0;
+  }
+};
+} // namespace functionlang
@@ -1,394 +1,483 @@
-#include <functionlang.hpp>
+#pragma once
+#include <array>
+#include <functionlangTree.hpp>
 
 namespace functionlang {
 
-enum class Op : uint8_t {
-  PUSH_V,
-  GET_V,
-  GET_IV,
-  // Unary
-  LOG,
-  LOG2,
-  LOG10,
-  SQRT,
-  CBRT,
-  SIN,
-  COS,
-  ABS,
-  NOT,
-  FACTORIAL,
-  // Binary
-  ADD,
-  SUB,
-  MUL,
-  DIV,
-  POW,
-  MIN,
-  MAX,
-  LOG_N,
-  LT,
-  GT,
-  EQ,
-  NE,
-  L_AND,
-  L_OR,
-  MOD,
-  ROUND,
-  // Ternary
-  WHETHER,
-  HALT
+// Largest exponent POW_INT expands into repeated multiplication. Up to 2 the
+// product is rounded once, as std::pow's is; above, each step rounds and the
+// result would drift from V1's by an ulp.
+const uint8_t POW_INT_MAX = 2;
+// Returned by fuseBinary when no superinstruction applies.
+const size_t NO_INSTRUCTION = static_cast<size_t>(-1);
+
+// Select superinstructions when compiling on this thread; off gives the
+// generic opcodes, for comparison.
+inline thread_local bool fuseInstructions = true;
+
+// A fixed group of N values evaluated together, one per lane, so a single
+// pass over the program serves N inputs. Lane loops over plain arrays let the
+// compiler use SIMD registers for the arithmetic ops.
+template <typename T, size_t N> struct Lanes {
+  std::array<T, N> lane{};
+
+  Lanes() = default;
+  Lanes(T v) { lane.fill(v); }
+
+  T &operator[](size_t i) { return lane[i]; }
+  const T &operator[](size_t i) const { return lane[i]; }
 };
 
-class FunctionParserV2 {
+// Element type and width of a VM value: the type itself for scalars.
+template <typename Value> struct LaneTraits {
+  using Scalar = Value;
+  static constexpr size_t width = 1;
+};
+template <typename T, size_t N> struct LaneTraits<Lanes<T, N>> {
+  using Scalar = T;
+  static constexpr size_t width = N;
+};
+
+// Apply a scalar function to every lane of its operands, in place in `a`.
+template <typename Value, typename F> inline void mapLanes(Value &a, F f) {
+  a = f(a);
+}
+template <typename T, size_t N, typename F>
+inline void mapLanes(Lanes<T, N> &a, F f) {
+  for (size_t i = 0; i < N; i++)
+    a[i] = f(a[i]);
+}
+template <typename Value, typename F>
+inline void mapLanes(Value &a, const Value &b, F f) {
+  a = f(a, b);
+}
+template <typename T, size_t N, typename F>
+inline void mapLanes(Lanes<T, N> &a, const Lanes<T, N> &b, F f) {
+  for (size_t i = 0; i < N; i++)
+    a[i] = f(a[i], b[i]);
+}
+template <typename Value, typename F>
+inline void mapLanes(Value &a, const Value &b, const Value &c, F f) {
+  a = f(a, b, c);
+}
+template <typename T, size_t N, typename F>
+inline void mapLanes(Lanes<T, N> &a, const Lanes<T, N> &b,
+                     const Lanes<T, N> &c, F f) {
+  for (size_t i = 0; i < N; i++)
+    a[i] = f(a[i], b[i], c[i]);
+}
+
+// Stack VM over `Value`: double, float or a Lanes of either. The program is
+// compiled from a double-precision parse, so literals are rounded once to
+// the element type rather than truncated during parsing.
+template <typename Value = double> class BasicFunctionParserV2 {
+public:
+  using Scalar = typename LaneTraits<Value>::Scalar;
+
 private:
   const char *equation;
   std::vector<Op> operations;
+  // Double precision while compiling, so fusion folds at full precision.
   std::vector<double> constants;
-  std::vector<double> stack;
+  std::vector<Scalar> scalarConstants;
+  std::vector<Value> stack;
+  // Kept between compiles so setEq reuses its storage.
+  ExprTree tree;
+  std::vector<size_t> roots;
+  // False when the equation failed to parse or used the A/P/I loops.
+  bool supported = true;
 
-  void compileInstructions(const char *&ptr) {
-    while (*ptr == ' ' || *ptr == ',' || *ptr == '\t' || *ptr == '(' ||
-           *ptr == ')') {
-      ptr++;
-    }
-    if (*ptr == '\0')
-      return;
+  // Replaces the generic sequence for `op` with a superinstruction when the
+  // operands allow it, given the indexes of both operands' final opcodes.
+  // Every rewrite gives the same result as the generic opcodes bit for bit,
+  // so switching engines never changes a result.
+  size_t fuseBinary(Op op, size_t lhs, size_t rhs) {
+    if (lhs == NO_INSTRUCTION || rhs == NO_INSTRUCTION)
+      return NO_INSTRUCTION;
+    size_t last = operations.size() - 1;
+    bool rhsConst = rhs == last && operations[rhs] == Op::PUSH_V;
+    bool rhsVar = rhs + 1 == last && operations[rhs] == Op::GET_V;
 
-    char op = *ptr++;
-
-    // 1. Handle Variables
-    if (op == USER_VARIABLE_IDENT) {
-      char *endPtr;
-      uint8_t idx = static_cast<uint8_t>(std::strtol(ptr, &endPtr, 10));
-      ptr = endPtr;
-      operations.push_back(Op::GET_V);
-      operations.push_back(static_cast<Op>(idx));
-      return;
+    switch (op) {
+    case Op::POW: {
+      if (!rhsConst)
+        break;
+      double k = constants.back();
+      if (k == 0.5) {
+        constants.pop_back();
+        operations.back() = Op::POW_HALF;
+        return last;
+      }
+      if (k == 2.0) {
+        constants.pop_back();
+        operations.back() = Op::SQUARE;
+        return last;
+      }
+      if (k >= 0.0 && k <= POW_INT_MAX && k == std::floor(k)) {
+        constants.pop_back();
+        operations.back() = Op::POW_INT;
+        operations.push_back(static_cast<Op>(static_cast<uint8_t>(k)));
+        return last;
+      }
+      break;
     }
-    if (op == INTERNAL_VARIABLE_IDENT) {
-      char *endPtr;
-      uint8_t idx = static_cast<uint8_t>(std::strtol(ptr, &endPtr, 10));
-      ptr = endPtr;
-      operations.push_back(Op::GET_IV);
-      operations.push_back(static_cast<Op>(idx));
-      return;
+    case Op::ROUND:
+      if (!rhsConst)
+        break;
+      constants.back() = std::pow(10.0, constants.back());
+      operations.back() = Op::ROUND_CONST;
+      return last;
+    case Op::SUB:
+      // x - k and x + (-k) round identically.
+      if (!rhsConst)
+        break;
+      constants.back() = -constants.back();
+      operations.back() = Op::ADD_CONST;
+      return last;
+    case Op::ADD:
+    case Op::MUL: {
+      bool add = op == Op::ADD;
+      if (rhsConst) {
+        operations.back() = add ? Op::ADD_CONST : Op::MUL_CONST;
+        return last;
+      }
+      if (rhsVar) {
+        operations[rhs] = add ? Op::ADD_VAR : Op::MUL_VAR;
+        return rhs;
+      }
+      // Both operators commute, so a leading variable can move last.
+      if (operations[lhs] == Op::GET_V) {
+        Op idx = operations[lhs + 1];
+        operations.erase(operations.begin() + lhs,
+                         operations.begin() + lhs + 2);
+        operations.push_back(add ? Op::ADD_VAR : Op::MUL_VAR);
+        operations.push_back(idx);
+        return operations.size() - 2;
+      }
+      if (add && operations[lhs] == Op::MUL) {
+        operations.erase(operations.begin() + lhs);
+        operations.push_back(Op::MUL_ADD);
+        return operations.size() - 1;
+      }
+      if (!add && rhs == last && operations[rhs] == Op::ADD) {
+        operations.back() = Op::ADD_MUL;
+        return last;
+      }
+      break;
     }
-
-    // 2. Handle Numeric Constants & Literal Numbers
-    if (std::isdigit(op) || (op == '-' && std::isdigit(*ptr)) || op == '.') {
-      ptr--;
-      char *endPtr;
-      double v = std::strtod(ptr, &endPtr);
-      ptr = endPtr;
-      constants.push_back(v);
-      operations.push_back(Op::PUSH_V);
-      return;
+    default:
+      break;
     }
+    return NO_INSTRUCTION;
+  }
 
-    // 3. Handle Named Constants (pi, e)
-    if (op == CONSTS_ENUM::PI) {
-      constants.push_back(M_PI);
-      operations.push_back(Op::PUSH_V);
+  // The tree is in post-order, which is already stack-machine order, so
+  // lowering is one linear walk. `roots` holds the final opcode index of
+  // each operand not yet consumed, for fuseBinary.
+  void compile(const char *eq) {
+    FUNCTIONLANG_TRACE_SPAN(span, "V2::compile", "compile");
+    operations.clear();
+    constants.clear();
+    scalarConstants.clear();
+    tree.clear();
+    tree.parse(eq);
+    supported = !tree.hasError() && !tree.hasLoops;
+    if (!supported)
       return;
-    }
-    if (op == CONSTS_ENUM::EULER) {
-      constants.push_back(M_E);
-      operations.push_back(Op::PUSH_V);
-      return;
-    }
+    // Variable reads take two opcodes; everything else at most one.
+    operations.reserve(2 * tree.nodes.size());
+    constants.reserve(tree.constants.size());
+    roots.clear();
 
-    // 4. Handle Unary Operators
-    if (std::ranges::contains(UNARY_OPS, op)) {
-      compileInstructions(ptr);
-      switch (op) {
-      case UNARY_OPS_ENUM::LOG:
-        operations.push_back(Op::LOG);
-        break;
-      case UNARY_OPS_ENUM::LOG2:
-        operations.push_back(Op::LOG2);
-        break;
-      case UNARY_OPS_ENUM::LOG10:
-        operations.push_back(Op::LOG10);
-        break;
-      case UNARY_OPS_ENUM::SQRT:
-        operations.push_back(Op::SQRT);
-        break;
-      case UNARY_OPS_ENUM::CBRT:
-        operations.push_back(Op::CBRT);
-        break;
-      case UNARY_OPS_ENUM::SIN:
-        operations.push_back(Op::SIN);
-        break;
-      case UNARY_OPS_ENUM::COS:
-        operations.push_back(Op::COS);
-        break;
-      case UNARY_OPS_ENUM::ABS:
-        operations.push_back(Op::ABS);
-        break;
-      case UNARY_OPS_ENUM::NOT:
-        operations.push_back(Op::NOT);
-        break;
-      case UNARY_OPS_ENUM::FACTORIAL:
-        operations.push_back(Op::FACTORIAL);
+    for (const ExprNode &node : tree.nodes) {
+      switch (node.op) {
+      case Op::PUSH_V:
+        constants.push_back(tree.constants[node.operand]);
+        operations.push_back(Op::PUSH_V);
+        roots.push_back(operations.size() - 1);
+        continue;
+      case Op::GET_V:
+      case Op::GET_IV:
+        operations.push_back(node.op);
+        operations.push_back(static_cast<Op>(node.operand));
+        roots.push_back(operations.size() - 2);
+        continue;
+      default:
         break;
       }
-      return;
-    }
 
-    // 5. Handle Binary Operators
-    if (std::ranges::contains(BINARY_OPS, op)) {
-      compileInstructions(ptr);
-      compileInstructions(ptr);
-      switch (op) {
-      case BINARY_OPS_ENUM::ADD:
-        operations.push_back(Op::ADD);
-        break;
-      case BINARY_OPS_ENUM::SUB:
-        operations.push_back(Op::SUB);
-        break;
-      case BINARY_OPS_ENUM::MUL:
-        operations.push_back(Op::MUL);
-        break;
-      case BINARY_OPS_ENUM::DIV:
-        operations.push_back(Op::DIV);
-        break;
-      case BINARY_OPS_ENUM::POW:
-        operations.push_back(Op::POW);
-        break;
-      case BINARY_OPS_ENUM::MIN:
-        operations.push_back(Op::MIN);
-        break;
-      case BINARY_OPS_ENUM::MAX:
-        operations.push_back(Op::MAX);
-        break;
-      case BINARY_OPS_ENUM::LOG_N:
-        operations.push_back(Op::LOG_N);
-        break;
-      case BINARY_OPS_ENUM::LT:
-        operations.push_back(Op::LT);
-        break;
-      case BINARY_OPS_ENUM::GT:
-        operations.push_back(Op::GT);
-        break;
-      case BINARY_OPS_ENUM::EQ:
-        operations.push_back(Op::EQ);
-        break;
-      case BINARY_OPS_ENUM::NE:
-        operations.push_back(Op::NE);
-        break;
-      case BINARY_OPS_ENUM::L_AND:
-        operations.push_back(Op::L_AND);
-        break;
-      case BINARY_OPS_ENUM::L_OR:
-        operations.push_back(Op::L_OR);
-        break;
-      case BINARY_OPS_ENUM::MOD:
-        operations.push_back(Op::MOD);
-        break;
-      case BINARY_OPS_ENUM::ROUND:
-        operations.push_back(Op::ROUND);
-        break;
+      size_t first = roots.size() - node.arity;
+      size_t root = node.arity == 2 && fuseInstructions
+                        ? fuseBinary(node.op, roots[first], roots[first + 1])
+                        : NO_INSTRUCTION;
+      if (root == NO_INSTRUCTION) {
+        operations.push_back(node.op);
+        root = operations.size() - 1;
       }
-      return;
+      roots.resize(first);
+      roots.push_back(root);
     }
+    scalarConstants.assign(constants.begin(), constants.end());
+    FUNCTIONLANG_TRACE_ARG(span, "instructions", operations.size());
+  }
 
-    // 6. Handle Ternary Operators
-    if (std::ranges::contains(TERNARY_OPS, op)) {
-      compileInstructions(ptr);
-      compileInstructions(ptr);
-      compileInstructions(ptr);
-      if (op == TERNARY_OPS_ENUM::WHETHER)
-        operations.push_back(Op::WHETHER);
-      return;
-    }
+  // Pops the right operand and combines it into the new top.
+  template <typename F> void binary(F f) {
+    Value b = stack.back();
+    stack.pop_back();
+    mapLanes(stack.back(), b, f);
+  }
+
+  Value variable(const std::vector<Value> &args, size_t idx) const {
+    return idx < args.size() ? args[idx] : Value(DEFAULT);
   }
 
 public:
-  FunctionParserV2(const char *eq) : equation(eq) {
-    compileInstructions(equation);
+  // DEFAULT_RESULT in the element type.
+  static constexpr Scalar DEFAULT = -std::numeric_limits<Scalar>::max();
+
+  BasicFunctionParserV2(const char *eq) : equation(eq) {
+    compile(equation);
     // operations.push_back(Op::HALT);
     stack.reserve(128);
   }
 
-  double eval(std::vector<double> args) {
-
+  Value eval(const std::vector<Value> &args) {
+    using S = Scalar;
     size_t cidx = 0, opidx = 0;
+    stack.clear();
 
     while (opidx < operations.size()) {
       Op code = operations[opidx++];
       switch (code) {
       case Op::PUSH_V:
-        stack.push_back(constants[cidx++]);
+        stack.push_back(Value(scalarConstants[cidx++]));
         break;
       case Op::GET_V: {
         uint8_t vidx = static_cast<uint8_t>(operations[opidx++]);
-        stack.push_back(vidx < args.size() ? args[vidx] : DEFAULT_RESULT);
+        stack.push_back(variable(args, vidx));
         break;
       }
       case Op::GET_IV: {
         uint8_t vidx = static_cast<uint8_t>(operations[opidx++]);
-        size_t internalIndex = INTERNAL_VARIABLE_START + vidx;
-        stack.push_back(internalIndex < args.size() ? args[internalIndex]
-                                                    : DEFAULT_RESULT);
+        stack.push_back(variable(args, INTERNAL_VARIABLE_START + vidx));
         break;
       }
       // --- Unary Logic ---
       case Op::SIN:
-        stack.back() = std::sin(stack.back());
+        mapLanes(stack.back(), [](S v) { return std::sin(v); });
         break;
       case Op::COS:
-        stack.back() = std::cos(stack.back());
+        mapLanes(stack.back(), [](S v) { return std::cos(v); });
         break;
       case Op::ABS:
-        stack.back() = std::abs(stack.back());
+        mapLanes(stack.back(), [](S v) { return std::abs(v); });
         break;
       case Op::LOG:
-        stack.back() = std::log(stack.back());
+        mapLanes(stack.back(), [](S v) { return std::log(v); });
         break;
       case Op::LOG2:
-        stack.back() = std::log2(stack.back());
+        mapLanes(stack.back(), [](S v) { return std::log2(v); });
         break;
       case Op::LOG10:
-        stack.back() = std::log10(stack.back());
+        mapLanes(stack.back(), [](S v) { return std::log10(v); });
         break;
       case Op::SQRT:
-        stack.back() = std::sqrt(stack.back());
+        mapLanes(stack.back(), [](S v) { return std::sqrt(v); });
         break;
       case Op::CBRT:
-        stack.back() = std::cbrt(stack.back());
+        mapLanes(stack.back(), [](S v) { return std::cbrt(v); });
         break;
       case Op::NOT:
-        stack.back() = (stack.back() <= 0.0 ? 1.0 : -1.0);
-        break;
-      case Op::FACTORIAL: {
-        double v = stack.back();
-        stack.back() =
-            (v < 0.0              ? 0.0
-             : v >= FACTORIAL_MAX ? std::numeric_limits<double>::max()
-                                  : std::tgamma(v + 1.0));
+        mapLanes(stack.back(), [](S v) { return v <= S(0) ? S(1) : S(-1); });
+        break;
+      case Op::FACTORIAL:
+        // Saturates like V1; below FACTORIAL_MAX tgamma only overflows in
+        // narrower types.
+        mapLanes(stack.back(), [](S v) {
+          if (v < S(0))
+            return S(0);
+          S r = v >= S(FACTORIAL_MAX) ? std::numeric_limits<S>::infinity()
+                                      : std::tgamma(v + S(1));
+          return std::isinf(r) ? std::numeric_limits<S>::max() : r;
+        });
         break;
-      }
       // --- Binary Logic ---
-      case Op::ADD: {
-        double b = stack.back();
-        stack.pop_back();
-        stack.back() += b;
+      case Op::ADD:
+        binary([](S a, S b) { return a + b; });
         break;
-      }
-      case Op::SUB: {
-        double b = stack.back();
-        stack.pop_back();
-        stack.back() -= b;
+      case Op::SUB:
+        binary([](S a, S b) { return a - b; });
         break;
-      }
-      case Op::MUL: {
-        double b = stack.back();
-        stack.pop_back();
-        stack.back() *= b;
+      case Op::MUL:
+        binary([](S a, S b) { return a * b; });
         break;
-      }
-      case Op::DIV: {
-        double b = stack.back();
-        stack.pop_back();
-        stack.back() = (b == 0.0 ? 0.0 : stack.back() / b);
+      case Op::DIV:
+        binary([](S a, S b) { return b == S(0) ? S(0) : a / b; });
         break;
-      }
-      case Op::POW: {
-        double b = stack.back();
-        stack.pop_back();
-        stack.back() = std::pow(stack.back(), b);
+      case Op::POW:
+        binary([](S a, S b) { return std::pow(a, b); });
         break;
-      }
-      case Op::MIN: {
-        double b = stack.back();
-        stack.pop_back();
-        stack.back() = std::min(stack.back(), b);
+      case Op::MIN:
+        binary([](S a, S b) { return std::min(a, b); });
         break;
-      }
-      case Op::MAX: {
-        double b = stack.back();
-        stack.pop_back();
-        stack.back() = std::max(stack.back(), b);
+      case Op::MAX:
+        binary([](S a, S b) { return std::max(a, b); });
         break;
-      }
-      case Op::MOD: {
-        double b = stack.back();
-        stack.pop_back();
-        stack.back() = (b == 0.0 ? 0.0 : std::fmod(stack.back(), b));
+      case Op::MOD:
+        binary([](S a, S b) { return b == S(0) ? S(0) : std::fmod(a, b); });
         break;
-      }
-      case Op::LOG_N: {
-        double b = stack.back();
+      case Op::LOG_N:
+        binary([](S a, S b) {
+          return (b <= S(0) || a <= S(0) || a == S(1))
+                     ? S(0)
+                     : std::log(b) / std::log(a);
+        });
+        break;
+      case Op::LT:
+        binary([](S a, S b) { return a < b ? S(1) : S(-1); });
+        break;
+      case Op::GT:
+        binary([](S a, S b) { return a > b ? S(1) : S(-1); });
+        break;
+      case Op::EQ:
+        binary([](S a, S b) {
+          return std::abs(a - b) < S(0.00001) ? S(1) : S(-1);
+        });
+        break;
+      case Op::NE:
+        binary([](S a, S b) {
+          return std::abs(a - b) > S(0.00001) ? S(1) : S(-1);
+        });
+        break;
+      case Op::L_AND:
+        binary([](S a, S b) { return a > S(0) && b > S(0) ? S(1) : S(-1); });
+        break;
+      case Op::L_OR:
+        binary([](S a, S b) { return a > S(0) || b > S(0) ? S(1) : S(-1); });
+        break;
+      case Op::ROUND:
+        binary([](S a, S precision) {
+          S n = std::pow(S(10), precision);
+          return std::round(a * n) / n;
+        });
+        break;
+      // --- Ternary Logic ---
+      case Op::WHETHER: {
+        Value falseVal = stack.back();
+        stack.pop_back();
+        Value trueVal = stack.back();
         stack.pop_back();
-        double a = stack.back();
-        stack.back() = (b <= 0.0 || a <= 0.0 || a == 1.0)
-                           ? 0.0
-                           : std::log(b) / std::log(a);
+        mapLanes(stack.back(), trueVal, falseVal, [](S c, S t, S f) {
+          return c > S(0) ? t : f;
+        });
         break;
       }
-      case Op::LT: {
-        double b = stack.back();
-        stack.pop_back();
-        stack.back() = (stack.back() < b ? 1.0 : -1.0);
+      // --- Superinstructions ---
+      case Op::SQUARE:
+        mapLanes(stack.back(), [](S v) { return v * v; });
+        break;
+      case Op::POW_HALF:
+        // Matches std::pow(x, 0.5) for -0.0 and -inf, unlike plain sqrt.
+        mapLanes(stack.back(), [](S v) {
+          return v == -std::numeric_limits<S>::infinity()
+                     ? std::numeric_limits<S>::infinity()
+                     : std::sqrt(v) + S(0);
+        });
+        break;
+      case Op::POW_INT: {
+        uint8_t n = static_cast<uint8_t>(operations[opidx++]);
+        mapLanes(stack.back(), [n](S v) {
+          S r = S(1);
+          for (uint8_t i = 0; i < n; i++)
+            r *= v;
+          return r;
+        });
         break;
       }
-      case Op::GT: {
-        double b = stack.back();
+      case Op::MUL_ADD: {
+        Value c = stack.back();
+        stack.pop_back();
+        Value b = stack.back();
         stack.pop_back();
-        stack.back() = (stack.back() > b ? 1.0 : -1.0);
+        mapLanes(stack.back(), b, c, [](S a, S b, S c) {
+          // Kept as two statements so the compiler cannot contract to fma.
+          S product = a * b;
+          return product + c;
+        });
         break;
       }
-      case Op::EQ: {
-        double b = stack.back();
+      case Op::ADD_MUL: {
+        Value c = stack.back();
         stack.pop_back();
-        stack.back() = (std::abs(stack.back() - b) < 0.00001 ? 1.0 : -1.0);
+        Value b = stack.back();
+        stack.pop_back();
+        mapLanes(stack.back(), b, c, [](S a, S b, S c) { return a * (b + c); });
         break;
       }
-      case Op::NE: {
-        double b = stack.back();
-        stack.pop_back();
-        stack.back() = (std::abs(stack.back() - b) > 0.00001 ? 1.0 : -1.0);
+      case Op::ADD_VAR: {
+        uint8_t vidx = static_cast<uint8_t>(operations[opidx++]);
+        mapLanes(stack.back(), variable(args, vidx),
+                 [](S a, S b) { return a + b; });
         break;
       }
-      case Op::L_AND: {
-        double b = stack.back();
-        stack.pop_back();
-        stack.back() = (stack.back() > 0.0 && b > 0.0 ? 1.0 : -1.0);
+      case Op::MUL_VAR: {
+        uint8_t vidx = static_cast<uint8_t>(operations[opidx++]);
+        mapLanes(stack.back(), variable(args, vidx),
+                 [](S a, S b) { return a * b; });
         break;
       }
-      case Op::L_OR: {
-        double b = stack.back();
-        stack.pop_back();
-        stack.back() = (stack.back() > 0.0 || b > 0.0 ? 1.0 : -1.0);
+      case Op::ADD_CONST: {
+        S k = scalarConstants[cidx++];
+        mapLanes(stack.back(), [k](S v) { return v + k; });
         break;
       }
-      case Op::ROUND: {
-        double precision = stack.back();
-        stack.pop_back();
-        double n = std::pow(10.0, precision);
-        stack.back() = std::round(stack.back() * n) / n;
+      case Op::MUL_CONST: {
+        S k = scalarConstants[cidx++];
+        mapLanes(stack.back(), [k](S v) { return v * k; });
         break;
       }
-      // --- Ternary Logic ---
-      case Op::WHETHER: {
-        double falseVal = stack.back();
-        stack.pop_back();
-        double trueVal = stack.back();
-        stack.pop_back();
-        double condition = stack.back();
-        stack.back() = (condition > 0.0 ? trueVal : falseVal);
+      case Op::ROUND_CONST: {
+        S n = scalarConstants[cidx++];
+        mapLanes(stack.back(), [n](S v) { return std::round(v * n) / n; });
         break;
       }
+      // Never emitted: compile() rejects trees containing loops.
+      case Op::SUMMATION:
+      case Op::PRODUCT:
+      case Op::INTEGRAL:
+      case Op::MONTE_CARLO:
+        break;
       case Op::HALT:
-        return stack.empty() ? DEFAULT_RESULT : stack.back();
+        return stack.empty() ? Value(DEFAULT) : stack.back();
       }
     }
-    return stack.empty() ? DEFAULT_RESULT : stack.back();
+    return stack.empty() ? Value(DEFAULT) : stack.back();
+  }
+
+  // V2 programs have no back-edges, so the instruction budget is checked
+  // against the exact program length before running.
+  EvalStatus eval(const std::vector<Value> &args, const EvalLimits &limits,
+                  Value &result) {
+    result = Value(DEFAULT);
+    if (limits.maxInstructions && operations.size() > limits.maxInstructions)
+      return EvalStatus::REJECTED;
+    if (cancelRequested())
+      return EvalStatus::CANCELLED;
+    result = eval(args);
+    return EvalStatus::OK;
   }
 
   void setEq(const char *eq) {
     equation = eq;
-    compileInstructions(eq);
+    compile(eq);
   }
+
+  bool isSupported() const { return supported; }
+
+  // Opcodes followed by their inline operands, for tests and tools.
+  const std::vector<Op> &instructions() const { return operations; }
 };
+
+using FunctionParserV2 = BasicFunctionParserV2<double>;
 } // namespace functionlang
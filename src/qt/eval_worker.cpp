@@ -0,0 +1,27 @@
+#include "eval_worker.hpp"
+#include <functionlangTiered.hpp>
+
+EvalWorker::EvalWorker(QObject *parent)
+    : QObject(parent),
+      worker([this](const Request &r) { return evaluate(r); },
+             // Queued to the receiver's thread, as this runs off the GUI
+             // thread.
+             [this](quint64 id, double value, qint64 elapsedNs,
+                    bool cancelled) {
+               emit finished(id, value, elapsedNs, cancelled);
+             }) {}
+
+EvalWorker::~EvalWorker() = default;
+
+quint64 EvalWorker::submit(const QString &expression,
+                           const std::vector<double> &args) {
+  return worker.submit({expression.toStdString(), args});
+}
+
+void EvalWorker::cancel() { worker.cancel(); }
+
+double EvalWorker::evaluate(const Request &request) {
+  if (!tiered || tiered->source() != request.expression)
+    tiered = std::make_unique<functionlang::TieredFunction>(request.expression);
+  return tiered->eval(request.args);
+}
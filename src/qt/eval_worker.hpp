@@ -0,0 +1,44 @@
+#pragma once
+
+#include "latest_job_thread.hpp"
+#include <QObject>
+#include <QString>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace functionlang {
+class TieredFunction;
+}
+
+// Evaluates expressions on a background thread. Only the newest request is
+// kept: submitting cancels the evaluation in flight and replaces anything
+// still queued.
+class EvalWorker : public QObject {
+  Q_OBJECT
+
+public:
+  explicit EvalWorker(QObject *parent = nullptr);
+  ~EvalWorker() override;
+
+  // Returns the id reported back by finished().
+  quint64 submit(const QString &expression, const std::vector<double> &args);
+  // Asks the evaluation in flight to stop at its next loop iteration.
+  void cancel();
+
+signals:
+  void finished(quint64 id, double value, qint64 elapsedNs, bool cancelled);
+
+private:
+  struct Request {
+    std::string expression;
+    std::vector<double> args;
+  };
+
+  double evaluate(const Request &request);
+
+  // The last expression evaluated, kept so resubmitting it climbs tiers.
+  // Only touched by the worker thread.
+  std::unique_ptr<functionlang::TieredFunction> tiered;
+  LatestJobThread<Request, double> worker;
+};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <QtGlobal>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <functionlang.hpp>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Runs jobs on a thread of its own, keeping only the newest: submitting
+// cancels the job in flight and replaces anything still queued. `compute`
+// runs with cancelToken set to the job's flag and is timed; `deliver` then
+// gets its result on the same thread. Declare it after the members the two
+// callbacks use, so it is joined before they are destroyed.
+template <typename Payload, typename Result> class LatestJobThread {
+public:
+  using Compute = std::function<Result(const Payload &)>;
+  using Deliver = std::function<void(quint64 id, Result result,
+                                     qint64 elapsedNs, bool cancelled)>;
+
+  LatestJobThread(Compute computeJob, Deliver deliverJob)
+      : compute(std::move(computeJob)), deliver(std::move(deliverJob)),
+        thread(&LatestJobThread::run, this) {}
+
+  ~LatestJobThread() {
+    {
+      std::lock_guard lock(mutex);
+      stopping = true;
+      pending.reset();
+      if (inFlight)
+        *inFlight = true;
+    }
+    wake.notify_one();
+    thread.join();
+  }
+
+  LatestJobThread(const LatestJobThread &) = delete;
+  LatestJobThread &operator=(const LatestJobThread &) = delete;
+
+  // Returns the id passed to `deliver`.
+  quint64 submit(Payload payload) {
+    std::lock_guard lock(mutex);
+    if (inFlight)
+      *inFlight = true;
+    pending = std::make_unique<Job>(
+        Job{++nextId, std::move(payload),
+            std::make_shared<std::atomic<bool>>(false)});
+    wake.notify_one();
+    return nextId;
+  }
+
+  // Asks the job in flight to stop at its next loop iteration.
+  void cancel() {
+    std::lock_guard lock(mutex);
+    if (inFlight)
+      *inFlight = true;
+  }
+
+private:
+  struct Job {
+    quint64 id;
+    Payload payload;
+    std::shared_ptr<std::atomic<bool>> cancelled;
+  };
+
+  void run() {
+    while (true) {
+      std::unique_ptr<Job> job;
+      {
+        std::unique_lock lock(mutex);
+        wake.wait(lock, [this] { return stopping || pending; });
+        if (stopping)
+          return;
+        job = std::move(pending);
+        inFlight = job->cancelled;
+      }
+
+      auto start = std::chrono::steady_clock::now();
+      functionlang::cancelToken = job->cancelled.get();
+      Result result = compute(job->payload);
+      functionlang::cancelToken = nullptr;
+      auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - start);
+
+      {
+        std::lock_guard lock(mutex);
+        inFlight.reset();
+      }
+      deliver(job->id, std::move(result), elapsed.count(),
+              job->cancelled->load());
+    }
+  }
+
+  Compute compute;
+  Deliver deliver;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::unique_ptr<Job> pending;
+  std::shared_ptr<std::atomic<bool>> inFlight;
+  quint64 nextId = 0;
+  bool stopping = false;
+  // Declared last, so it starts once the members above are built.
+  std::thread thread;
+};
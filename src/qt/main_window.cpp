@@ -13,6 +13,12 @@
 #include <limits>
 
 MyWindow::MyWindow(QWidget *parent) : QMainWindow(parent) {
+  evalWorker = new EvalWorker(this);
+  plotWorker = new PlotWorker(this);
+  debounceTimer = new QTimer(this);
+  debounceTimer->setSingleShot(true);
+  debounceTimer->setInterval(150);
+
   setupUi();
   setupConnections();
 
@@ -55,7 +61,35 @@ void MyWindow::setupUi() {
   leftLayout->addWidget(new QLabel("<b>Equation Editor</b>"));
   leftLayout->addWidget(equationInput);
   leftLayout->addLayout(buttonLayout);
-  leftLayout->addStretch(); // Pushes elements to the top
+
+  // ---  Plot Panel ---
+  auto *plotControls = new QHBoxLayout();
+  plotVariable = new QSpinBox();
+  plotVariable->setRange(0, functionlang::INTERNAL_VARIABLE_START - 1);
+  plotVariable->setPrefix("$");
+  plotMin = new QDoubleSpinBox();
+  plotMax = new QDoubleSpinBox();
+  for (QDoubleSpinBox *bound : {plotMin, plotMax}) {
+    bound->setRange(-1e12, 1e12);
+    bound->setDecimals(4);
+  }
+  plotMin->setValue(-10);
+  plotMax->setValue(10);
+  plotInfo = new QLabel();
+  plotControls->addWidget(new QLabel("Plot over"));
+  plotControls->addWidget(plotVariable);
+  plotControls->addWidget(new QLabel("from"));
+  plotControls->addWidget(plotMin);
+  plotControls->addWidget(new QLabel("to"));
+  plotControls->addWidget(plotMax);
+  plotControls->addStretch();
+  plotControls->addWidget(plotInfo);
+
+  plotWidget = new PlotWidget();
+
+  leftLayout->addWidget(new QLabel("<b>Plot</b>"));
+  leftLayout->addLayout(plotControls);
+  leftLayout->addWidget(plotWidget, 1);
 
   // ---  Variables Table ---
   varTable = new QTableWidget(functionlang::INTERNAL_VARIABLE_START, 1);
@@ -79,6 +113,17 @@ void MyWindow::setupConnections() {
   connect(liveButton, &QPushButton::toggled, this, &MyWindow::toggleLiveMode);
   connect(varTable, &QTableWidget::itemChanged, this,
           &MyWindow::handleVarTableChange);
+  connect(debounceTimer, &QTimer::timeout, this, &MyWindow::handleCalculate);
+  connect(evalWorker, &EvalWorker::finished, this, &MyWindow::onEvalFinished);
+
+  connect(plotWidget, &PlotWidget::viewChanged, this,
+          &MyWindow::onPlotViewChanged);
+  connect(plotMin, &QDoubleSpinBox::editingFinished, this,
+          &MyWindow::onPlotRangeEdited);
+  connect(plotMax, &QDoubleSpinBox::editingFinished, this,
+          &MyWindow::onPlotRangeEdited);
+  connect(plotVariable, &QSpinBox::valueChanged, this, &MyWindow::requestPlot);
+  connect(plotWorker, &PlotWorker::sampled, this, &MyWindow::onPlotSampled);
 }
 
 void MyWindow::onTextChanged(const QString &text) {
@@ -91,7 +136,10 @@ void MyWindow::onTextChanged(const QString &text) {
   }
 
   if (liveButton->isChecked()) {
-    handleCalculate();
+    // Abort the stale evaluation now; the new one starts once typing pauses.
+    evalWorker->cancel();
+    plotWorker->cancel();
+    debounceTimer->start();
   }
 }
 
@@ -100,12 +148,61 @@ void MyWindow::handleCalculate() {
   if (expression.isEmpty())
     return;
 
-  auto expr = expression.toStdString();
-  const char *expr_cstr = expr.c_str();
-  const double evaluated =
-      functionlang::parseExpression(expr_cstr)(functionlangArgs);
-  statusBar()->showMessage(QString::fromStdString(std::format("{}", evaluated)),
-                           -1);
+  debounceTimer->stop();
+  latestEvalId = evalWorker->submit(expression, functionlangArgs);
+  statusBar()->showMessage("Evaluating...", -1);
+  requestPlot();
+}
+
+void MyWindow::requestPlot() {
+  QString expression = equationInput->text();
+  if (expression.isEmpty()) {
+    plotWidget->clear();
+    return;
+  }
+  latestPlotId = plotWorker->submit(
+      expression, functionlangArgs, plotVariable->value(),
+      plotWidget->rangeMin(), plotWidget->rangeMax(),
+      std::max(1, plotWidget->width()));
+}
+
+void MyWindow::onPlotViewChanged(double xmin, double xmax) {
+  // Keep the range boxes in step with dragging and zooming.
+  QSignalBlocker blockMin(plotMin), blockMax(plotMax);
+  plotMin->setValue(xmin);
+  plotMax->setValue(xmax);
+  requestPlot();
+}
+
+void MyWindow::onPlotRangeEdited() {
+  plotWidget->setRange(plotMin->value(), plotMax->value());
+}
+
+void MyWindow::onPlotSampled(quint64 id, QPolygonF points, qint64 elapsedNs,
+                             quint64 evaluated) {
+  if (id != latestPlotId)
+    return;
+  plotWidget->setSamples(points);
+  plotInfo->setText(QString::fromStdString(
+      std::format("{} points, {} evaluated, {:.1f} ms", points.size(),
+                  evaluated, elapsedNs / 1e6)));
+}
+
+void MyWindow::onEvalFinished(quint64 id, double value, qint64 elapsedNs,
+                              bool cancelled) {
+  // Results of superseded requests are dropped.
+  if (id != latestEvalId)
+    return;
+  double ms = elapsedNs / 1e6;
+  if (cancelled) {
+    statusBar()->showMessage(
+        QString::fromStdString(std::format("Cancelled after {:.3f} ms", ms)),
+        -1);
+  } else {
+    statusBar()->showMessage(
+        QString::fromStdString(std::format("{}    ({:.3f} ms)", value, ms)),
+        -1);
+  }
 }
 
 void MyWindow::toggleLiveMode(bool checked) {
@@ -125,10 +222,5 @@ void MyWindow::handleVarTableChange(QTableWidgetItem *item) {
 
   std::cout << row << ":" << col << " " << text.toStdString() << std::endl;
   functionlangArgs[row] = text.toDouble();
-  auto expr = equationInput->text().toStdString();
-  auto expr_cstr = expr.c_str();
-  const double evaluated =
-      functionlang::parseExpression(expr_cstr)(functionlangArgs);
-  statusBar()->showMessage(QString::fromStdString(std::format("{}", evaluated)),
-                           -1);
+  handleCalculate();
 }
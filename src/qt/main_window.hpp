@@ -1,12 +1,18 @@
 #pragma once
 
+#include "eval_worker.hpp"
+#include "plot_widget.hpp"
+#include "plot_worker.hpp"
 #include "qtablewidget.h"
+#include <QDoubleSpinBox>
 #include <QLabel>
 #include <QLineEdit>
 #include <QMainWindow>
 #include <QPushButton>
+#include <QSpinBox>
 #include <QStatusBar>
 #include <QTableWidget>
+#include <QTimer>
 #include <qpushbutton.h>
 #include <vector>
 
@@ -25,6 +31,15 @@ private slots:
   // Automatic triggers
   void onTextChanged(const QString &text);
   void toggleLiveMode(bool checked);
+  void onEvalFinished(quint64 id, double value, qint64 elapsedNs,
+                      bool cancelled);
+
+  // Plot panel
+  void requestPlot();
+  void onPlotViewChanged(double xmin, double xmax);
+  void onPlotRangeEdited();
+  void onPlotSampled(quint64 id, QPolygonF points, qint64 elapsedNs,
+                     quint64 evaluated);
 
 private:
   // --- UI Setup Methods ---
@@ -39,9 +54,23 @@ private:
   // --- Data Widgets ---
   QTableWidget *varTable;
 
+  // --- Plot Widgets ---
+  PlotWidget *plotWidget;
+  QSpinBox *plotVariable;
+  QDoubleSpinBox *plotMin;
+  QDoubleSpinBox *plotMax;
+  QLabel *plotInfo;
+
   // --- Logic State ---
   bool isLiveMode = false;
 
+  // Keystrokes restart the timer, so a burst of edits is evaluated once.
+  QTimer *debounceTimer;
+  EvalWorker *evalWorker;
+  quint64 latestEvalId = 0;
+  PlotWorker *plotWorker;
+  quint64 latestPlotId = 0;
+
   // Helper to update the status bar easily
   void updateStatus(const QString &message, int timeout = 0);
 
@@ -0,0 +1,123 @@
+#include "plot_widget.hpp"
+#include <QMouseEvent>
+#include <QPainter>
+#include <QWheelEvent>
+#include <cmath>
+#include <format>
+#include <limits>
+
+PlotWidget::PlotWidget(QWidget *parent) : QWidget(parent) {
+  setMinimumHeight(200);
+  setMouseTracking(false);
+}
+
+void PlotWidget::setRange(double xmin, double xmax) {
+  if (!(xmax > xmin))
+    return;
+  viewMin = xmin;
+  viewMax = xmax;
+  update();
+  emit viewChanged(viewMin, viewMax);
+}
+
+void PlotWidget::setSamples(const QPolygonF &points) {
+  samples = points;
+  double lo = std::numeric_limits<double>::infinity(), hi = -lo;
+  for (const QPointF &p : samples) {
+    if (std::isfinite(p.y())) {
+      lo = std::min(lo, p.y());
+      hi = std::max(hi, p.y());
+    }
+  }
+  if (lo > hi) {
+    lo = -1;
+    hi = 1;
+  } else if (lo == hi) {
+    lo -= 1;
+    hi += 1;
+  }
+  double margin = (hi - lo) * 0.05;
+  yMin = lo - margin;
+  yMax = hi + margin;
+  update();
+}
+
+void PlotWidget::clear() {
+  samples.clear();
+  update();
+}
+
+QPointF PlotWidget::toPixel(const QPointF &p) const {
+  return QPointF((p.x() - viewMin) / (viewMax - viewMin) * width(),
+                 (yMax - p.y()) / (yMax - yMin) * height());
+}
+
+void PlotWidget::paintEvent(QPaintEvent *) {
+  QPainter painter(this);
+  painter.fillRect(rect(), Qt::white);
+
+  // Axes, where they are in view.
+  painter.setPen(QPen(Qt::lightGray, 1));
+  if (viewMin < 0 && viewMax > 0) {
+    double x = toPixel({0, 0}).x();
+    painter.drawLine(QPointF(x, 0), QPointF(x, height()));
+  }
+  if (yMin < 0 && yMax > 0) {
+    double y = toPixel({0, 0}).y();
+    painter.drawLine(QPointF(0, y), QPointF(width(), y));
+  }
+
+  // Samples arrive decimated to the pixel width, so this stays cheap.
+  painter.setRenderHint(QPainter::Antialiasing);
+  painter.setPen(QPen(QColor(30, 90, 200), 1.5));
+  QPolygonF run;
+  for (const QPointF &p : samples) {
+    if (std::isfinite(p.y())) {
+      run.append(toPixel(p));
+      continue;
+    }
+    painter.drawPolyline(run);
+    run.clear();
+  }
+  painter.drawPolyline(run);
+
+  painter.setPen(Qt::darkGray);
+  painter.drawText(rect().adjusted(4, 2, -4, -2), Qt::AlignLeft | Qt::AlignTop,
+                   QString::fromStdString(std::format("{:.4g}", yMax)));
+  painter.drawText(rect().adjusted(4, 2, -4, -2),
+                   Qt::AlignLeft | Qt::AlignBottom,
+                   QString::fromStdString(
+                       std::format("{:.4g}    x: {:.4g}", yMin, viewMin)));
+  painter.drawText(rect().adjusted(4, 2, -4, -2),
+                   Qt::AlignRight | Qt::AlignBottom,
+                   QString::fromStdString(std::format("{:.4g}", viewMax)));
+}
+
+void PlotWidget::mousePressEvent(QMouseEvent *event) {
+  dragOrigin = event->position();
+  dragViewMin = viewMin;
+  dragViewMax = viewMax;
+}
+
+void PlotWidget::mouseMoveEvent(QMouseEvent *event) {
+  if (!(event->buttons() & Qt::LeftButton) || width() == 0)
+    return;
+  double shift = (event->position().x() - dragOrigin.x()) / width() *
+                 (dragViewMax - dragViewMin);
+  setRange(dragViewMin - shift, dragViewMax - shift);
+}
+
+void PlotWidget::wheelEvent(QWheelEvent *event) {
+  if (width() == 0)
+    return;
+  // Zoom about the x under the cursor, 1.25x per wheel notch.
+  double factor = std::pow(1.25, -event->angleDelta().y() / 120.0);
+  double anchor =
+      viewMin + event->position().x() / width() * (viewMax - viewMin);
+  setRange(anchor - (anchor - viewMin) * factor,
+           anchor + (viewMax - anchor) * factor);
+}
+
+void PlotWidget::resizeEvent(QResizeEvent *) {
+  emit viewChanged(viewMin, viewMax);
+}
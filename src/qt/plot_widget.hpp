@@ -0,0 +1,42 @@
+#pragma once
+
+#include <QPointF>
+#include <QPolygonF>
+#include <QWidget>
+
+// Draws one curve over an x-range that the user pans by dragging and zooms
+// with the wheel. Panning and zooming repaint the current samples straight
+// away and emit viewChanged(), so the owner can fetch refined ones.
+class PlotWidget : public QWidget {
+  Q_OBJECT
+
+public:
+  explicit PlotWidget(QWidget *parent = nullptr);
+
+  void setRange(double xmin, double xmax);
+  double rangeMin() const { return viewMin; }
+  double rangeMax() const { return viewMax; }
+  // Replaces the curve; a NaN y breaks the line. The y-range follows the
+  // new curve.
+  void setSamples(const QPolygonF &points);
+  void clear();
+
+signals:
+  void viewChanged(double xmin, double xmax);
+
+protected:
+  void paintEvent(QPaintEvent *event) override;
+  void mousePressEvent(QMouseEvent *event) override;
+  void mouseMoveEvent(QMouseEvent *event) override;
+  void wheelEvent(QWheelEvent *event) override;
+  void resizeEvent(QResizeEvent *event) override;
+
+private:
+  QPointF toPixel(const QPointF &p) const;
+
+  double viewMin = -10, viewMax = 10;
+  double yMin = -1, yMax = 1;
+  QPolygonF samples;
+  QPointF dragOrigin;
+  double dragViewMin = 0, dragViewMax = 0;
+};
@@ -0,0 +1,40 @@
+#include "plot_worker.hpp"
+
+PlotWorker::PlotWorker(QObject *parent)
+    : QObject(parent),
+      worker([this](const Request &r) { return sample(r); },
+             [this](quint64 id, std::vector<functionlang::PlotPoint> points,
+                    qint64 elapsedNs, bool cancelled) {
+               deliver(id, std::move(points), elapsedNs, cancelled);
+             }) {}
+
+PlotWorker::~PlotWorker() = default;
+
+quint64 PlotWorker::submit(const QString &expression,
+                           const std::vector<double> &args, int variable,
+                           double xmin, double xmax, int columns) {
+  return worker.submit(
+      {expression.toStdString(), args, variable, xmin, xmax, columns});
+}
+
+void PlotWorker::cancel() { worker.cancel(); }
+
+std::vector<functionlang::PlotPoint>
+PlotWorker::sample(const Request &request) {
+  sampler.setExpression(request.expression, request.args, request.variable);
+  return functionlang::decimate(sampler.sample(request.xmin, request.xmax),
+                                request.xmin, request.xmax, request.columns);
+}
+
+void PlotWorker::deliver(quint64 id,
+                         std::vector<functionlang::PlotPoint> points,
+                         qint64 elapsedNs, bool cancelled) {
+  // A cancelled request has been superseded; its partial curve is dropped.
+  if (cancelled)
+    return;
+  QPolygonF polygon;
+  polygon.reserve(points.size());
+  for (const functionlang::PlotPoint &p : points)
+    polygon.append(QPointF(p.x, p.y));
+  emit sampled(id, polygon, elapsedNs, sampler.stats().evaluated);
+}
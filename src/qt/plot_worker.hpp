@@ -0,0 +1,47 @@
+#pragma once
+
+#include "latest_job_thread.hpp"
+#include <QObject>
+#include <QPolygonF>
+#include <QString>
+#include <functionlangPlot.hpp>
+#include <string>
+#include <vector>
+
+// Samples the plotted expression on a background thread. Like EvalWorker,
+// only the newest request is kept. The sampler and its cache live on the
+// worker thread, so panning and zooming reuse earlier samples.
+class PlotWorker : public QObject {
+  Q_OBJECT
+
+public:
+  explicit PlotWorker(QObject *parent = nullptr);
+  ~PlotWorker() override;
+
+  // Samples `expression` over $variable in [xmin, xmax], decimated to
+  // `columns` pixel columns. Returns the id reported back by sampled().
+  quint64 submit(const QString &expression, const std::vector<double> &args,
+                 int variable, double xmin, double xmax, int columns);
+  void cancel();
+
+signals:
+  // Points with a NaN y mark breaks in the curve.
+  void sampled(quint64 id, QPolygonF points, qint64 elapsedNs,
+               quint64 evaluated);
+
+private:
+  struct Request {
+    std::string expression;
+    std::vector<double> args;
+    int variable;
+    double xmin, xmax;
+    int columns;
+  };
+
+  std::vector<functionlang::PlotPoint> sample(const Request &request);
+  void deliver(quint64 id, std::vector<functionlang::PlotPoint> points,
+               qint64 elapsedNs, bool cancelled);
+
+  functionlang::AdaptiveSampler sampler;
+  LatestJobThread<Request, std::vector<functionlang::PlotPoint>> worker;
+};
@@ -1,5 +1,13 @@
 #include "functionlang.hpp"
+#include "functionlangDaemon.hpp"
+#include "functionlangKernel.hpp"
+#include "functionlangPlanner.hpp"
+#include "functionlangReactive.hpp"
+#include "functionlangScript.hpp"
+#include "functionlangShm.hpp"
+#include "functionlangTrace.hpp"
 
+#include <csignal>
 #include <cstring>
 #include <exception>
 #include <format>
@@ -7,6 +15,7 @@
 #include <iostream>
 #include <iterator>
 #include <string>
+#include <thread>
 #include <vector>
 
 namespace Color {
@@ -27,88 +36,323 @@ std::string raw_help{std::istreambuf_iterator<char>(file),
 std::string help_string =
     std::vformat(raw_help, std::make_format_args(functionlang::VERSION,
                                                  functionlang::VERSIONTEXT));
-int main() {
+// Serves evaluation requests on a Unix socket until SIGINT or SIGTERM.
+int runDaemon(const char *path, size_t workers) {
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  // Blocked before the workers start so only sigwait below receives them.
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+  functionlang::daemon::Server server(path, workers);
+  if (!server.start()) {
+    std::cerr << Color::Red << "Error: could not listen on " << path << ": "
+              << std::strerror(errno) << Color::Reset << std::endl;
+    return 1;
+  }
+  std::cout << "Listening on " << path << std::endl;
+
+  int sig;
+  sigwait(&signals, &sig);
+  server.stop();
+  std::cout << "Stopped after serving " << server.programs().size()
+            << " programs" << std::endl;
+  return 0;
+}
+
+// Prints a caret under the offending character of the input line, which
+// starts at column `indent`.
+void printSyntaxError(const functionlang::ParseError &error, size_t indent) {
+  std::cerr << Color::Red << std::string(indent + error.position, ' ') << "^"
+            << std::endl
+            << "Error at column " << error.position + 1 << ": "
+            << error.message << Color::Reset << std::endl;
+}
+
+// Parses expr once to find syntax errors. What only the VMs reject, such as
+// $256, runs on V1 and is not reported.
+bool checkSyntax(const std::string &expr, size_t indent) {
+  functionlang::ExprTree tree;
+  const char *ptr = expr.c_str();
+  tree.parse(ptr);
+  if (!tree.hasSyntaxError())
+    return true;
+  printSyntaxError(tree.error, indent);
+  return false;
+}
+
+// Prints what the REPL prints for a run :s, :f, :b or plain line, storing
+// the result of :s. Returns the $n that :s updated.
+std::vector<size_t>
+printStatement(const functionlang::script::Statement &st,
+               functionlang::ReactiveStore &reactive) {
+  using functionlang::script::Kind;
+  switch (st.kind) {
+  case Kind::SET:
+  case Kind::FUNCTION: {
+    bool setter = st.kind == Kind::SET;
+    if (!st.addressed)
+      break;
+    if (!st.indexError.empty()) {
+      std::cerr << Color::Red
+                << (setter ? "Error parsing setter: "
+                           : "Error parsing custom function: ")
+                << st.indexError << Color::Reset << std::endl;
+    } else if (!setter && st.exprs[0].contains('#')) {
+      std::cerr << Color::Red
+                << "Error: Custom function may not have custom function inside."
+                << Color::Reset << std::endl;
+    } else if (!st.inRange()) {
+      std::cerr << Color::Red << "Error: Index " << (setter ? "$" : "#")
+                << st.index << " out of range." << Color::Reset << std::endl;
+    } else if (setter) {
+      std::vector<size_t> updated = reactive.set(st.index, st.results[0]);
+      std::cout << Color::Yellow << "$" << st.index << " = " << st.results[0]
+                << Color::Reset << std::endl;
+      return updated;
+    } else {
+      std::cout << Color::Yellow << "#" << st.index << " = " << st.exprs[0]
+                << Color::Reset << std::endl;
+    }
+    break;
+  }
+  case Kind::BLOCK:
+    for (size_t i = 0; i < st.exprs.size(); i++)
+      std::cout << Color::Yellow << st.exprs[i] << " = " << st.results[i]
+                << Color::Reset << std::endl;
+    break;
+  case Kind::EXPRESSION:
+    // The prompt "> " precedes the input on its line.
+    if (!st.planned)
+      printSyntaxError(st.syntax, 2);
+    else
+      std::cout << st.results[0] << std::endl;
+    break;
+  default:
+    break;
+  }
+  return {};
+}
+
+int main(int argc, char **argv) {
+  if (argc >= 3 && std::strcmp(argv[1], "--daemon") == 0) {
+    try {
+      return runDaemon(argv[2], argc >= 4 ? std::stoul(argv[3]) : 0);
+    } catch (const std::exception &e) {
+      std::cerr << Color::Red << "Error parsing worker count: " << e.what()
+                << Color::Reset << std::endl;
+      return 1;
+    }
+  }
+
+  // --script runs the lines of a file as if typed, without the prompt.
+  bool scripted = argc >= 3 && std::strcmp(argv[1], "--script") == 0;
+  std::vector<std::string> script;
+  size_t next = 0;
+  size_t threads = std::max(1u, std::thread::hardware_concurrency());
+  bool bound = false;
+  if (scripted) {
+    std::ifstream in(argv[2]);
+    if (!in) {
+      std::cerr << Color::Red << "Error: could not open " << argv[2] << ": "
+                << std::strerror(errno) << Color::Reset << std::endl;
+      return 1;
+    }
+    for (std::string line; std::getline(in, line);)
+      script.push_back(line);
+    try {
+      if (argc >= 4)
+        threads = std::max<size_t>(1, std::stoul(argv[3]));
+    } catch (const std::exception &e) {
+      std::cerr << Color::Red << "Error parsing thread count: " << e.what()
+                << Color::Reset << std::endl;
+      return 1;
+    }
+  }
+
   std::string input_buffer;
-  const char *pt = nullptr;
 
   std::vector<double> values;
   values.resize(256, 0.0);
   std::vector<const char *> customFuncs;
   customFuncs.resize(256, "0.0");
+  functionlang::ReactiveStore reactive(values);
+  // When attached, expressions read $n from a producer's segment instead.
+  functionlang::shm::SharedStore feed;
+  std::vector<double> feedValues;
+
+  auto printUpdated = [&](const std::vector<size_t> &updated) {
+    for (size_t idx : updated)
+      std::cout << Color::Cyan << "$" << idx << " = " << values[idx] << " ("
+                << reactive.expression(idx) << ")" << Color::Reset
+                << std::endl;
+  };
 
-  std::cout << ":q to exit | :h for help | :s $[n] [expr] | $[0-"
-            << functionlang::INTERNAL_VARIABLE_START - 1
-            << "] to index "
-               "value store | @[0-inf] to index function runtime variables"
-            << std::endl;
+  if (!scripted)
+    std::cout << ":q to exit | :h for help | :s $[n] [expr] | "
+                 ":r $[n] [expr] | :b [expr]; [expr]... | :tiers | "
+                 ":shm [name|off] | :explain [expr] | :memo | "
+                 ":trace on|off|dump [file] | $[0-"
+              << functionlang::INTERNAL_VARIABLE_START - 1
+              << "] to index "
+                 "value store | @[0-inf] to index function runtime variables"
+              << std::endl;
 
   while (true) {
-    std::cout << Color::Bold << "> " << Color::Reset;
-    if (!std::getline(std::cin, input_buffer) || input_buffer == ":q") {
-      break;
+    if (scripted) {
+      if (next == script.size())
+        break;
+      // Bindings and feeds change the store between lines, so lines after
+      // them run one at a time.
+      if (!bound && !feed.attached() &&
+          functionlang::script::kindOf(script[next]) !=
+              functionlang::script::Kind::OTHER) {
+        size_t end = next;
+        while (end < script.size() &&
+               functionlang::script::kindOf(script[end]) !=
+                   functionlang::script::Kind::OTHER)
+          end++;
+        std::vector<functionlang::script::Statement> statements =
+            functionlang::script::runBatch(
+                {script.begin() + next, script.begin() + end}, values,
+                threads);
+        for (const functionlang::script::Statement &st : statements)
+          printStatement(st, reactive);
+        next = end;
+        continue;
+      }
+      input_buffer = script[next++];
+      if (input_buffer == ":q")
+        break;
+    } else {
+      std::cout << Color::Bold << "> " << Color::Reset;
+      if (!std::getline(std::cin, input_buffer) || input_buffer == ":q")
+        break;
     }
     if (input_buffer == ":h") {
       std::cout << help_string << std::endl;
       continue;
     }
-    if (input_buffer.starts_with(":s")) {
-      try {
-        size_t v_pos = input_buffer.find('$');
-        size_t space_pos = input_buffer.find(' ', v_pos);
-        if (v_pos != std::string::npos && space_pos != std::string::npos) {
-          int index =
-              std::stoi(input_buffer.substr(v_pos + 1, space_pos - v_pos - 1));
-          std::string expr_part = input_buffer.substr(space_pos + 1);
-          auto cs = expr_part.c_str();
-          double result = functionlang::parseExpression(cs)({10, 5});
-          if (index >= 0 && index < (int)values.size()) {
-            values[index] = result;
-            std::cout << Color::Yellow << "$" << index << " = " << result
-                      << Color::Reset << std::endl;
-          } else {
-            std::cerr << Color::Red << "Error: Index $" << index
-                      << " out of range." << Color::Reset << std::endl;
-          }
-        }
-      } catch (const std::exception &e) {
-        std::cerr << Color::Red << "Error parsing setter: " << e.what()
+    if (input_buffer == ":tiers") {
+      // Tier transitions of the expressions bound with :r so far.
+      const functionlang::TierCounters &c = functionlang::tierCounters;
+      std::cout << Color::Cyan << "handles " << c.handles
+                << " | to bytecode " << c.bytecodePromotions
+                << " | to register " << c.registerPromotions
+                << " | register rejected " << c.registerRejected
+                << " | kept on V1 " << c.closureFallbacks << Color::Reset
+                << std::endl;
+      continue;
+    }
+    if (input_buffer == ":memo") {
+      // Results reused by the cached loops of the expressions so far.
+      const functionlang::MemoCounters &c = functionlang::memoCounters;
+      std::cout << Color::Cyan << "cached loops " << c.caches << " | hits "
+                << c.hits << " | misses " << c.misses << " | evictions "
+                << c.evictions << " | hit rate " << c.hitRate() * 100 << "%"
+                << Color::Reset << std::endl;
+      continue;
+    }
+    if (input_buffer.starts_with(":trace")) {
+      std::string arg = input_buffer.substr(6);
+      arg.erase(0, arg.find_first_not_of(' '));
+      if (!functionlang::trace::COMPILED) {
+        std::cerr << Color::Red
+                  << "Error: tracing is compiled out; rebuild with make TRACE=1"
+                  << Color::Reset << std::endl;
+      } else if (arg == "on" || arg == "off") {
+        functionlang::trace::setEnabled(arg == "on");
+        std::cout << Color::Yellow << "tracing " << arg << Color::Reset
+                  << std::endl;
+      } else if (arg.starts_with("dump")) {
+        std::string path = arg.substr(4);
+        path.erase(0, path.find_first_not_of(' '));
+        if (path.empty())
+          path = "functionlang-trace.json";
+        size_t events = functionlang::trace::eventCount();
+        if (functionlang::trace::writeChrome(path))
+          std::cout << Color::Yellow << events << " spans written to " << path
+                    << Color::Reset << std::endl;
+        else
+          std::cerr << Color::Red << "Error: could not write " << path << ": "
+                    << std::strerror(errno) << Color::Reset << std::endl;
+      } else {
+        std::cerr << Color::Red << "Error: expected :trace on, off or dump"
+                  << Color::Reset << std::endl;
+      }
+      continue;
+    }
+    if (input_buffer.starts_with(":explain")) {
+      // The plan a plain expression would run with, and why.
+      std::string expr = input_buffer.substr(8);
+      size_t skipped = std::min(expr.find_first_not_of(' '), expr.size());
+      expr.erase(0, skipped);
+      if (checkSyntax(expr, 2 + 8 + skipped))
+        std::cout << Color::Cyan
+                  << functionlang::explain(functionlang::makePlan(expr))
+                  << Color::Reset << std::endl;
+      continue;
+    }
+    if (input_buffer.starts_with(":shm")) {
+      std::string name = input_buffer.substr(4);
+      name.erase(0, name.find_first_not_of(' '));
+      if (name == "off") {
+        feed.detach();
+        std::cout << Color::Yellow << "$n read from the local store"
                   << Color::Reset << std::endl;
+      } else if (!feed.open(name)) {
+        std::cerr << Color::Red << "Error: could not attach " << name << ": "
+                  << std::strerror(errno) << Color::Reset << std::endl;
+      } else {
+        std::cout << Color::Yellow << "$n read from " << name << " (version "
+                  << feed.version() << ")" << Color::Reset << std::endl;
       }
       continue;
     }
-    if (input_buffer.starts_with(":f")) {
+    if (input_buffer.starts_with(":r")) {
+      bound = true;
+      // Binds $n to an expression that is recomputed whenever a $m it reads
+      // changes.
       try {
-        size_t v_pos = input_buffer.find('#');
+        size_t v_pos = input_buffer.find('$');
         size_t space_pos = input_buffer.find(' ', v_pos);
         if (v_pos != std::string::npos && space_pos != std::string::npos) {
           int index =
               std::stoi(input_buffer.substr(v_pos + 1, space_pos - v_pos - 1));
           std::string expr_part = input_buffer.substr(space_pos + 1);
-          if (expr_part.contains('#')) {
-            std::cerr
-                << Color::Red
-                << "Error: Custom function may not have custom function inside."
-                << Color::Reset << std::endl;
+          std::vector<size_t> updated;
+          std::string error;
+          if (index < 0 || index >= (int)values.size()) {
+            std::cerr << Color::Red << "Error: Index $" << index
+                      << " out of range." << Color::Reset << std::endl;
+          } else if (!reactive.bind(index, expr_part, updated, error)) {
+            std::cerr << Color::Red << "Error: " << error << Color::Reset
+                      << std::endl;
           } else {
-            auto cs = expr_part.c_str();
-            if (index >= 0 && index < (int)customFuncs.size()) {
-              std::cout << Color::Yellow << "#" << index << " = " << cs
-                        << Color::Reset << std::endl;
-            } else {
-              std::cerr << Color::Red << "Error: Index #" << index
-                        << " out of range." << Color::Reset << std::endl;
-            }
+            printUpdated(updated);
           }
         }
       } catch (const std::exception &e) {
-        std::cerr << Color::Red << "Error parsing custom function: " << e.what()
+        std::cerr << Color::Red << "Error parsing binding: " << e.what()
                   << Color::Reset << std::endl;
       }
       continue;
     }
-    pt = input_buffer.c_str();
-
-    std::cout << functionlang::parseExpression(pt)(values) << std::endl;
+    // :s, :f, :b and plain expressions.
+    functionlang::script::Statement st =
+        functionlang::script::prepare(input_buffer);
+    // The feed is read into its own buffer, reused from line to line, so
+    // the local store and its bindings never see it.
+    bool reads = st.kind == functionlang::script::Kind::BLOCK ||
+                 st.kind == functionlang::script::Kind::EXPRESSION;
+    if (reads && feed.attached()) {
+      feed.snapshot(feedValues);
+      functionlang::script::run(st, feedValues);
+    } else {
+      functionlang::script::run(st, values);
+    }
+    printUpdated(printStatement(st, reactive));
   }
   return 0;
 }
@@ -0,0 +1,103 @@
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "functionlangRegister.hpp"
+#include "functionlangV2.hpp"
+
+const char UNARY[] = "lLgcCsSa!f";
+const char BINARY[] = "*/+_^mMG<>=\\&|%~";
+
+// Random well-formed expression of at most `depth` levels.
+std::string generate(std::mt19937 &rng, int depth) {
+  std::uniform_int_distribution<int> pick(0, 9);
+  int kind = depth == 0 ? pick(rng) % 3 : pick(rng);
+  switch (kind) {
+  case 0:
+    return "$" + std::to_string(pick(rng) % 4);
+  case 1:
+    return std::to_string(pick(rng)) + "." + std::to_string(pick(rng));
+  case 2:
+    return "p";
+  case 3:
+  case 4:
+    return std::string(1, UNARY[pick(rng)]) + generate(rng, depth - 1);
+  case 9:
+    return "?" + generate(rng, depth - 1) + "," + generate(rng, depth - 1) +
+           "," + generate(rng, depth - 1);
+  default:
+    return std::string(1, BINARY[pick(rng) + pick(rng) % 7]) +
+           generate(rng, depth - 1) + "," + generate(rng, depth - 1);
+  }
+}
+
+template <typename Compile>
+void run_case(const char *name, const std::vector<std::string> &exprs,
+              size_t bytes, Compile compile) {
+  auto start = std::chrono::high_resolution_clock::now();
+  for (const std::string &expr : exprs)
+    compile(expr.c_str());
+  auto end = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double> diff = end - start;
+
+  std::cout << std::left << std::setw(22) << name << std::right
+            << std::setw(12) << exprs.size() / diff.count() << " expr/s "
+            << std::setw(10) << bytes / diff.count() / 1e6 << " MB/s"
+            << std::endl;
+}
+
+int main() {
+  using namespace functionlang;
+  const int count = 200'000;
+  std::mt19937 rng(42);
+  std::vector<std::string> exprs;
+  size_t bytes = 0;
+  for (int i = 0; i < count; ++i) {
+    exprs.push_back(generate(rng, 6));
+    bytes += exprs.back().size();
+  }
+
+  // Every generated expression must parse cleanly.
+  int errors = 0;
+  for (const std::string &expr : exprs) {
+    ExprTree tree;
+    const char *ptr = expr.c_str();
+    tree.parse(ptr);
+    if (tree.hasError() && errors++ < 5)
+      std::cout << "Parse error in " << expr << " at " << tree.error.position
+                << ": " << tree.error.message << std::endl;
+  }
+
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << "Compiling " << count << " expressions (" << bytes / count
+            << " chars average)...\n\n";
+
+  double sink = 0;
+  run_case("V1 (closure tree)", exprs, bytes, [&](const char *eq) {
+    sink += parseExpression(eq) ? 1 : 0;
+  });
+  ExprTree tree;
+  run_case("ExprTree", exprs, bytes, [&](const char *eq) {
+    tree.clear();
+    sink += tree.parse(eq);
+  });
+  run_case("V2 (VM Stack)", exprs, bytes, [&](const char *eq) {
+    FunctionParserV2 vm(eq);
+    sink += vm.isSupported();
+  });
+  FunctionParserV2 reused("0");
+  run_case("V2 (setEq)", exprs, bytes, [&](const char *eq) {
+    reused.setEq(eq);
+    sink += reused.isSupported();
+  });
+  run_case("V2 (VM Register)", exprs, bytes, [&](const char *eq) {
+    FunctionParserReg vm(eq);
+    sink += 1;
+  });
+
+  std::cout << "\n(checksum " << sink << ")" << std::endl;
+  return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,82 @@
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "functionlangDaemon.hpp"
+
+int failures = 0;
+
+void check(const char *name, bool ok) {
+  failures += !ok;
+  std::cout << name << " : " << (ok ? "OK" : "FAILED") << std::endl;
+}
+
+int main() {
+  using namespace functionlang::daemon;
+  std::string path = "/tmp/functionlang-test-" + std::to_string(getpid());
+
+  Server server(path, 2);
+  check("server starts", server.start());
+
+  Client client;
+  check("client connects", client.connect(path));
+
+  uint32_t square = 0, sum = 0, again = 0;
+  check("register", client.registerExpression("*$0,$0", square));
+  check("register loop", client.registerExpression("A1,$0,-1,@0", sum));
+  check("register shares cache",
+        client.registerExpression("*$0,$0", again) && again == square);
+
+  double result = 0;
+  check("eval", client.eval(square, {7}, result) && result == 49);
+  check("eval loop", client.eval(sum, {100}, result) && result == 5050);
+
+  std::vector<double> results;
+  check("eval batch",
+        client.evalBatch(square, 2, {1, 0, 2, 0, 3, 0}, results) &&
+            results == std::vector<double>{1, 4, 9});
+
+  // Pipelined: queue every request, then read the answers in order.
+  const int pipelined = 1000;
+  for (int i = 0; i < pipelined; i++)
+    client.send(MessageType::EVAL, encodeEval(square, {double(i)}));
+  bool inOrder = true;
+  for (int i = 0; i < pipelined; i++) {
+    Response r;
+    inOrder &= client.receive(r) && r.status == Status::OK &&
+               get<double>(r.body.data()) == double(i) * i;
+  }
+  check("pipelined evals", inOrder);
+
+  Response r;
+  client.send(MessageType::EVAL, encodeEval(12345, {1}));
+  check("unknown handle",
+        client.receive(r) && r.status == Status::UNKNOWN_HANDLE);
+  client.send(MessageType::EVAL, "bad");
+  check("bad request", client.receive(r) && r.status == Status::BAD_REQUEST);
+
+  // A second client sees handles registered by the first.
+  Client other;
+  check("second client", other.connect(path) &&
+                             other.eval(sum, {10}, result) && result == 55);
+
+  // A full cache evicts a program; its handle says so and is not reused.
+  Server small(path + "-small", 1, {}, 2);
+  Client bounded;
+  uint32_t first = 0, second = 0, third = 0, renewed = 0;
+  check("bounded server", small.start() && bounded.connect(path + "-small") &&
+                              bounded.registerExpression("+$0,1", first) &&
+                              bounded.registerExpression("+$0,2", second) &&
+                              bounded.registerExpression("+$0,3", third));
+  bounded.send(MessageType::EVAL, encodeEval(first, {1}));
+  check("evicted handle", bounded.receive(r) && r.status == Status::EVICTED &&
+                              small.programs().size() == 2);
+  check("re-registered program",
+        bounded.registerExpression("+$0,1", renewed) && renewed != first &&
+            bounded.eval(renewed, {1}, result) && result == 2);
+  small.stop();
+
+  server.stop();
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,447 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <format>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <random>
+
+#include "functionlangKernel.hpp"
+#include "functionlangPlanner.hpp"
+
+// Differential fuzzing: random expressions over the full operator set are
+// compiled by every engine and optimization level, and each result is
+// checked against plain V1. A mismatch is reduced to a small reproducer.
+//
+// Usage: fuzztest [expressions] [depth] [loop nesting] [seed]
+
+using namespace functionlang;
+
+int failures = 0;
+
+void check(const std::string &name, bool ok) {
+  failures += !ok;
+  std::cout << name << " : " << (ok ? "OK" : "FAILED") << std::endl;
+}
+
+struct FuzzConfig {
+  size_t expressions = 3000;
+  // Operator nodes from the root to the deepest leaf.
+  int maxDepth = 6;
+  // A/P/I/Q loops inside each other.
+  int maxLoopNesting = 2;
+  uint32_t seed = 46;
+  // Argument sets each expression is evaluated with.
+  size_t argSets = 6;
+  // Relative, for values above 1 in magnitude.
+  double tolerance = 1e-9;
+};
+
+// An expression as a tree of tokens, so it can be shrunk node by node.
+struct Node {
+  std::string token;
+  std::vector<Node> children;
+
+  std::string text() const {
+    std::string s = token;
+    for (size_t i = 0; i < children.size(); i++)
+      s += (i ? "," : "") + children[i].text();
+    return s;
+  }
+};
+
+class Generator {
+private:
+  const FuzzConfig &config;
+  std::mt19937 rng;
+
+  size_t pick(size_t n) { return rng() % n; }
+
+  std::string number() {
+    // Values where the fused and special-cased paths start or stop applying.
+    static const char *edges[] = {"0", "1", "2",  "3",   "4",   "0.5",
+                                  "-1", "-2.5", "10", "1e-3", "170", "171"};
+    if (pick(2) == 0)
+      return edges[pick(std::size(edges))];
+    return std::format("{}", std::uniform_real_distribution<>(-5, 5)(rng));
+  }
+
+  // The internal slots bound by the loops around the node being generated,
+  // innermost last.
+  std::vector<int> bound;
+
+  Node leaf() {
+    switch (pick(bound.empty() ? 4 : 5)) {
+    case 0:
+    case 1:
+      return {number(), {}};
+    case 2:
+      return {std::string(1, CONSTS[pick(std::size(CONSTS))]), {}};
+    case 3:
+      return {"$" + std::to_string(pick(4)), {}};
+    default:
+      return {"@" + std::to_string(bound[pick(bound.size())]), {}};
+    }
+  }
+
+  // The slot a loop asking for slot -1 gets: the first automatic slot no
+  // loop around it holds.
+  int freeSlot() const {
+    int slot = 0;
+    while (slot < static_cast<int>(detail::AUTOMATIC_SLOTS) &&
+           std::ranges::contains(bound, slot))
+      slot++;
+    return slot;
+  }
+
+  // Bounds kept small so nested loops stay cheap to run on every engine.
+  Node loop(int depth, int loops) {
+    size_t kind = pick(4);
+    if (kind == 0)
+      return monteCarlo(depth, loops);
+    char op = kind == 1 ? PENTARY_OPS[0] : QUATERNARY_OPS[pick(2)];
+    Node n{std::string(1, op), {}};
+    if (op == PENTARY_OPS_ENUM::INTEGRAL) {
+      n.children.push_back({number(), {}});
+      n.children.push_back(pick(2) ? Node{"$" + std::to_string(pick(4)), {}}
+                                   : Node{number(), {}});
+      n.children.push_back({std::to_string(1 + pick(8)), {}});
+    } else {
+      n.children.push_back({std::to_string(pick(2)), {}});
+      n.children.push_back(pick(3) ? Node{std::to_string(1 + pick(5)), {}}
+                                   : Node{"$" + std::to_string(pick(4)), {}});
+    }
+    // The automatic slot, an explicit one, or one a loop around this one
+    // holds, which this loop then shadows.
+    int slot;
+    switch (pick(3)) {
+    case 0:
+      n.children.push_back({"-1", {}});
+      slot = freeSlot();
+      break;
+    case 1:
+      if (!bound.empty()) {
+        slot = bound[pick(bound.size())];
+        n.children.push_back({std::to_string(slot), {}});
+        break;
+      }
+      [[fallthrough]];
+    default:
+      slot = static_cast<int>(pick(detail::AUTOMATIC_SLOTS));
+      n.children.push_back({std::to_string(slot), {}});
+    }
+    bound.push_back(slot);
+    n.children.push_back(generate(depth - 1, loops + 1));
+    bound.pop_back();
+    return n;
+  }
+
+  // Q samples a Sobol net, the same points on every engine and thread count,
+  // with its coordinates in the automatic slots from the first free one.
+  Node monteCarlo(int depth, int loops) {
+    Node n{std::string(1, PENTARY_OPS_ENUM::MONTE_CARLO), {}};
+    n.children.push_back({number(), {}});
+    n.children.push_back({number(), {}});
+    n.children.push_back({std::to_string(1 + pick(16)), {}});
+    size_t dims = 1 + pick(3);
+    n.children.push_back({std::to_string(dims), {}});
+    int first = freeSlot();
+    for (size_t d = 0; d < dims; d++)
+      bound.push_back(first + static_cast<int>(d));
+    n.children.push_back(generate(depth - 1, loops + 1));
+    bound.resize(bound.size() - dims);
+    return n;
+  }
+
+public:
+  Generator(const FuzzConfig &c) : config(c), rng(c.seed) {}
+
+  Node generate(int depth, int loops = 0) {
+    if (depth == 0 || pick(5) == 0)
+      return leaf();
+    size_t kind = pick(10);
+    if (kind == 0 && loops < config.maxLoopNesting)
+      return loop(depth, loops);
+    Node n;
+    if (kind <= 3)
+      n.token = UNARY_OPS[pick(std::size(UNARY_OPS))];
+    else if (kind <= 8)
+      n.token = BINARY_OPS[pick(std::size(BINARY_OPS))];
+    else
+      n.token = TERNARY_OPS[0];
+    size_t arity = operatorInfo(n.token[0]).arity;
+    for (size_t i = 0; i < arity; i++)
+      n.children.push_back(generate(depth - 1, loops));
+    return n;
+  }
+
+  std::vector<double> arguments() {
+    std::vector<double> args(4);
+    for (double &a : args)
+      a = pick(4) == 0 ? static_cast<double>(pick(3))
+                       : std::uniform_real_distribution<>(-3, 3)(rng);
+    return args;
+  }
+};
+
+using Rows = std::vector<std::vector<double>>;
+// Evaluates an expression for every row of arguments.
+using RowsFunc = std::function<std::vector<double>(const Rows &)>;
+
+// One engine at one optimization level. `compile` returns an empty function
+// when the engine cannot run the expression.
+struct Level {
+  const char *name;
+  std::function<RowsFunc(const std::string &)> compile;
+  size_t compiled = 0;
+  uint64_t evals = 0;
+  double compileSeconds = 0;
+  double evalSeconds = 0;
+};
+
+RowsFunc eachRow(ExprFunc f) {
+  if (!f)
+    return {};
+  return [f = std::move(f)](const Rows &rows) {
+    std::vector<double> out;
+    for (const std::vector<double> &row : rows)
+      out.push_back(f(row));
+    return out;
+  };
+}
+
+ExprFunc closure(const std::string &expr, bool hoist, bool memo) {
+  hoistInvariants = hoist;
+  memoOptions.enabled = memo;
+  // Every loop that may be cached is, so hits are exercised too.
+  memoOptions.minInstructions = 0;
+  const char *ptr = expr.c_str();
+  ExprFunc func = parseExpression(ptr);
+  hoistInvariants = true;
+  memoOptions = MemoOptions{};
+  return func;
+}
+
+template <typename VM> ExprFunc vm(const std::string &expr, bool fuse) {
+  fuseInstructions = fuse;
+  auto source = std::make_shared<const std::string>(expr);
+  auto machine = std::make_shared<VM>(source->c_str());
+  fuseInstructions = true;
+  if (!machine->isSupported())
+    return {};
+  return [machine, source](ExprFuncRet args) { return machine->eval(args); };
+}
+
+// Four rows at a time, one per lane, so a lane reading another's values
+// shows up as a mismatch in its row.
+RowsFunc lanes(const std::string &expr) {
+  using LaneVM = BasicFunctionParserV2<Lanes<double, 4>>;
+  auto source = std::make_shared<const std::string>(expr);
+  auto machine = std::make_shared<LaneVM>(source->c_str());
+  if (!machine->isSupported())
+    return {};
+  return [machine, source](const Rows &rows) {
+    std::vector<double> out;
+    for (size_t r = 0; r < rows.size(); r += 4) {
+      size_t width = 0;
+      for (size_t l = 0; l < 4 && r + l < rows.size(); l++)
+        width = std::max(width, rows[r + l].size());
+      std::vector<Lanes<double, 4>> args(width,
+                                         Lanes<double, 4>(DEFAULT_RESULT));
+      for (size_t l = 0; l < 4; l++) {
+        const std::vector<double> &row = rows[std::min(r + l, rows.size() - 1)];
+        for (size_t k = 0; k < row.size(); k++)
+          args[k][l] = row[k];
+      }
+      Lanes<double, 4> values = machine->eval(args);
+      for (size_t l = 0; l < 4 && r + l < rows.size(); l++)
+        out.push_back(values[l]);
+    }
+    return out;
+  };
+}
+
+std::vector<Level> levels() {
+  return {
+      // The reference every other engine is checked against.
+      {"V1", [](auto &e) { return eachRow(closure(e, false, false)); }},
+      {"V1 hoisted", [](auto &e) { return eachRow(closure(e, true, false)); }},
+      {"V1 hoisted+memo",
+       [](auto &e) { return eachRow(closure(e, true, true)); }},
+      {"V2", [](auto &e) { return eachRow(vm<FunctionParserV2>(e, false)); }},
+      {"V2 fused",
+       [](auto &e) { return eachRow(vm<FunctionParserV2>(e, true)); }},
+      {"V2 lanes", [](auto &e) { return lanes(e); }},
+      {"register",
+       [](auto &e) { return eachRow(vm<FunctionParserReg>(e, true)); }},
+      {"kernel",
+       [](auto &e) -> RowsFunc {
+         auto kernel = std::make_shared<FunctionKernel>(
+             std::vector<std::string>{e});
+         if (!kernel->isSupported())
+           return {};
+         return eachRow(
+             [kernel](ExprFuncRet args) { return kernel->eval(args)[0]; });
+       }},
+      // Large workloads let the planner pick lanes and split loops.
+      {"planned",
+       [](auto &e) {
+         auto planned =
+             std::make_shared<PlannedFunction>(e, Workload{.rows = 1000000});
+         return eachRow(
+             [planned](ExprFuncRet args) { return planned->eval(args); });
+       }},
+  };
+}
+
+bool agree(double a, double b, double tolerance) {
+  if (std::isnan(a) || std::isnan(b))
+    return std::isnan(a) && std::isnan(b);
+  if (a == b)
+    return true;
+  return std::abs(a - b) <=
+         tolerance * std::max({1.0, std::abs(a), std::abs(b)});
+}
+
+// Results of plain V1 and of `engine` for row `row` of `rows`, when the
+// engine runs it. The other rows run alongside, as lanes do.
+std::optional<std::pair<double, double>>
+results(std::vector<Level> &all, size_t engine, const std::string &expr,
+        const Rows &rows, size_t row) {
+  RowsFunc f = all[engine].compile(expr);
+  if (!f)
+    return std::nullopt;
+  return std::make_pair(all[0].compile(expr)(rows)[row], f(rows)[row]);
+}
+
+// Every tree one step smaller than `n`: a subtree replaced by one of its
+// operands or by a literal.
+void reductions(const Node &n, const std::function<void(Node)> &emit) {
+  for (const Node &c : n.children)
+    emit(c);
+  if (!n.children.empty() || (n.token != "0" && n.token != "1")) {
+    emit({"0", {}});
+    if (n.token != "0")
+      emit({"1", {}});
+  }
+  for (size_t i = 0; i < n.children.size(); i++)
+    reductions(n.children[i], [&](Node smaller) {
+      Node copy = n;
+      copy.children[i] = std::move(smaller);
+      emit(std::move(copy));
+    });
+}
+
+// Greedily applies reductions for as long as the mismatch remains.
+Node minimize(Node n, const std::function<bool(const Node &)> &fails) {
+  for (bool progress = true; progress;) {
+    progress = false;
+    std::optional<Node> next;
+    reductions(n, [&](Node smaller) {
+      if (!next && fails(smaller))
+        next = std::move(smaller);
+    });
+    if (next) {
+      n = std::move(*next);
+      progress = true;
+    }
+  }
+  return n;
+}
+
+std::string joined(const std::vector<double> &args) {
+  std::string s;
+  for (size_t i = 0; i < args.size(); i++)
+    s += std::format("{}${} = {}", i ? ", " : "", i, args[i]);
+  return s;
+}
+
+int main(int argc, char **argv) {
+  FuzzConfig config;
+  if (argc > 1)
+    config.expressions = std::stoul(argv[1]);
+  if (argc > 2)
+    config.maxDepth = std::stoi(argv[2]);
+  if (argc > 3)
+    config.maxLoopNesting = std::stoi(argv[3]);
+  if (argc > 4)
+    config.seed = static_cast<uint32_t>(std::stoul(argv[4]));
+
+  // The minimizer reduces known cases to the expected reproducers.
+  std::vector<Level> all = levels();
+  Node planted{"+", {{"s", {{"$0", {}}}}, {"*", {{"2", {}}, {"$1", {}}}}}};
+  Node reduced = minimize(planted, [](const Node &n) {
+    return n.text().find("$1") != std::string::npos;
+  });
+  check("minimizer keeps only the failing part", reduced.text() == "$1");
+
+  Generator gen(config);
+  Rows args;
+  for (size_t i = 0; i < config.argSets; i++)
+    args.push_back(gen.arguments());
+  // Repeated arguments are answered by the memo cache.
+  args.push_back(args[0]);
+
+  size_t mismatches = 0, loops = 0;
+  for (size_t i = 0; i < config.expressions; i++) {
+    Node expr = gen.generate(config.maxDepth);
+    std::string text = expr.text();
+    loops += text.find_first_of("APIQ") != std::string::npos;
+    std::vector<double> expected;
+    for (size_t e = 0; e < all.size(); e++) {
+      Level &engine = all[e];
+      auto start = std::chrono::steady_clock::now();
+      RowsFunc f = engine.compile(text);
+      auto compiled = std::chrono::steady_clock::now();
+      engine.compileSeconds +=
+          std::chrono::duration<double>(compiled - start).count();
+      if (!f)
+        continue;
+      engine.compiled++;
+      std::vector<double> got = f(args);
+      engine.evalSeconds += std::chrono::duration<double>(
+                                std::chrono::steady_clock::now() - compiled)
+                                .count();
+      engine.evals += args.size();
+      if (e == 0) {
+        expected = got;
+        continue;
+      }
+
+      for (size_t a = 0; a < args.size(); a++) {
+        if (agree(expected[a], got[a], config.tolerance))
+          continue;
+        if (++mismatches > 5)
+          break;
+        Node small = minimize(expr, [&](const Node &n) {
+          auto r = results(all, e, n.text(), args, a);
+          return r && !agree(r->first, r->second, config.tolerance);
+        });
+        auto r = results(all, e, small.text(), args, a);
+        std::cout << "mismatch on " << engine.name << ": " << text << "\n"
+                  << "  reduced to " << small.text() << " with "
+                  << joined(args[a]) << "\n  V1 " << std::setprecision(17)
+                  << r->first << ", " << engine.name << " " << r->second
+                  << std::endl;
+        break;
+      }
+    }
+  }
+  if (mismatches > 5)
+    std::cout << mismatches << " mismatches, the first 5 shown" << std::endl;
+  check(std::format("{} expressions, {} with loops, agree on every engine",
+                    config.expressions, loops),
+        mismatches == 0);
+
+  std::cout << std::fixed << std::setprecision(2);
+  for (const Level &e : all)
+    std::cout << std::left << std::setw(16) << e.name << std::right
+              << std::setw(6) << e.compiled << " compiled "
+              << std::setw(9) << e.compileSeconds / config.expressions * 1e6
+              << " us/compile " << std::setw(9)
+              << (e.evalSeconds > 0 ? e.evals / e.evalSeconds / 1e6 : 0.0)
+              << " M evals/s" << std::endl;
+  return failures == 0 ? 0 : 1;
+}
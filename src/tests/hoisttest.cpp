@@ -0,0 +1,95 @@
+#include "functionlang.hpp"
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+using namespace functionlang;
+
+int failures = 0;
+
+void check(const std::string &name, bool ok) {
+  failures += !ok;
+  std::cout << name << " : " << (ok ? "OK" : "FAILED") << std::endl;
+}
+
+ExprFunc compile(const std::string &expr, bool hoist) {
+  hoistInvariants = hoist;
+  const char *ptr = expr.c_str();
+  ExprFunc func = parseExpression(ptr);
+  hoistInvariants = true;
+  return func;
+}
+
+// Compares `expr` compiled with and without hoisting.
+bool sameResult(const std::string &expr, const std::vector<double> &args) {
+  double plain = compile(expr, false)(args);
+  double hoisted = compile(expr, true)(args);
+  bool ok = plain == hoisted || (std::isnan(plain) && std::isnan(hoisted));
+  if (!ok)
+    std::cout << expr << ": " << plain << " vs " << hoisted << std::endl;
+  return ok;
+}
+
+double timeOf(const ExprFunc &func, const std::vector<double> &args,
+              double &result) {
+  auto start = std::chrono::steady_clock::now();
+  result = func(args);
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+int main() {
+  std::vector<double> args = {0.7, 1.3, 2.0};
+  const char *cases[] = {
+      // Invariant operands, whole invariant bodies and empty loops.
+      "A1,100,-1,*@0,*$0,s$1", "P1,20,-1,+1,/@0,+$0,S$1",
+      "A1,50,-1,*$0,s$1", "A5,1,-1,s$0", "I0,1,100,-1,*@0,l+$0,$1",
+      // Nested loops: the inner loop is invariant in the outer one, and
+      // parts of the inner body are invariant in the inner loop only.
+      "A1,30,-1,A1,30,-1,*@1,s$0", "A1,30,-1,A1,30,-1,*@0,*@1,s$0",
+      "A1,30,-1,A1,@0,-1,+*@1,S$1,*@0,s$0",
+      "A1,10,-1,P1,3,-1,+@0,A1,4,-1,*@2,s@0",
+      // Explicit slots, shared slots and $n reaching into internal slots.
+      "A1,10,3,*@3,+@0,s$1", "A1,10,0,A1,5,0,*@0,s$0",
+      "A1,10,-1,*$256,S$0",
+      // Conditions and branches; V1 evaluates both branches.
+      "A1,40,-1,?>@0,20,*s$0,@0,c$1", "A1,10,-1,?>$0,0,A1,5,-1,@1,@0",
+      "A1,40,-1,?>@0,20,*@0,s$0,+@0,l$1",
+      // Automatic slots inside hoisted loops see the outer slot in use.
+      "A1,5,-1,+A1,3,-1,@1,@0", "A1,5,-1,*@0,A1,3,-1,*@1,@1",
+      "A1,4,-1,Q0,1,256,2,*@1,+@2,$0"};
+  for (const char *expr : cases)
+    check(std::string("hoisting keeps ") + expr, sameResult(expr, args));
+
+  // Internal slots already set by the caller move the automatic slots.
+  std::vector<double> preset(INTERNAL_VARIABLE_START + 2, DEFAULT_RESULT);
+  preset[0] = 1.5;
+  preset[INTERNAL_VARIABLE_START] = 4;
+  check("hoisting with preset slots",
+        sameResult("A1,20,-1,A1,20,-1,+*@1,@0,*@2,s$0", preset));
+
+  // Cancellation still stops a loop whose body was hoisted.
+  std::atomic<bool> cancelled{true};
+  cancelToken = &cancelled;
+  double stopped = compile("A1,1e9,-1,*$0,s$1", true)(args);
+  cancelToken = nullptr;
+  check("cancelled hoisted loop", stopped == DEFAULT_RESULT);
+
+  // The hoisted loop body of the request, and a nested one, against the
+  // plain closures.
+  const char *timed[] = {"A1,1e6,-1,*@0,*$0,s$1",
+                         "A1,1e6,-1,?>@0,5e5,*@0,s$0,*@0,c$1",
+                         "A1,1000,-1,A1,1000,-1,*@1,+@0,l+$0,S$1"};
+  for (const char *expr : timed) {
+    double plain, hoisted;
+    double plainTime = timeOf(compile(expr, false), args, plain);
+    double hoistedTime = timeOf(compile(expr, true), args, hoisted);
+    std::cout << expr << ": plain " << plainTime * 1e3 << " ms, hoisted "
+              << hoistedTime * 1e3 << " ms (" << plainTime / hoistedTime
+              << "x)" << std::endl;
+    check(std::string("hoisted ") + expr + " agrees",
+          std::abs(plain - hoisted) <= 1e-12 * std::abs(plain));
+  }
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,146 @@
+#include "functionlangMonteCarlo.hpp"
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+using namespace functionlang;
+
+int failures = 0;
+
+void check(const std::string &name, bool ok) {
+  failures += !ok;
+  std::cout << name << " : " << (ok ? "OK" : "FAILED") << std::endl;
+}
+
+double eval(const std::string &expr) {
+  const char *ptr = expr.c_str();
+  return parseExpression(ptr)({});
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+// e^(@0 + ... + @(d-1)), whose integral over [0, 1]^d is (e - 1)^d.
+std::string expSum(int dims) {
+  std::string sum = "@" + std::to_string(dims - 1);
+  for (int d = dims - 2; d >= 0; d--)
+    sum = "+@" + std::to_string(d) + "," + sum;
+  return "^e," + sum;
+}
+
+void report(const char *name, const IntegrationResult &r, double exact) {
+  std::cout << name << ": " << r.value << " +- " << r.error << " (exact "
+            << exact << ", " << r.samples << " samples, " << r.threads
+            << " threads)" << std::endl;
+}
+
+int main() {
+  // The first Sobol points of coordinate 0 are 0, 1/2, 3/4, 1/4 in Gray
+  // order, and every coordinate of the first 2^k points is a permutation of
+  // the multiples of 2^-k.
+  SobolSequence sobol(SOBOL_MAX_DIMENSIONS);
+  const double first[] = {0, 0.5, 0.75, 0.25};
+  bool ok = true;
+  std::vector<std::vector<bool>> seen(SOBOL_MAX_DIMENSIONS,
+                                      std::vector<bool>(256, false));
+  sobol.seek(0);
+  for (int i = 0; i < 256; i++) {
+    if (i < 4)
+      ok &= sobol[0] * 0x1p-32 == first[i];
+    for (size_t d = 0; d < SOBOL_MAX_DIMENSIONS; d++)
+      seen[d][sobol[d] >> 24] = true;
+    sobol.next();
+  }
+  for (const auto &dim : seen)
+    for (bool s : dim)
+      ok &= s;
+  check("Sobol points are stratified", ok);
+  sobol.seek(1000);
+  uint32_t jumped = sobol[5];
+  sobol.seek(999);
+  sobol.next();
+  check("seek agrees with stepping", sobol[5] == jumped);
+
+  check("counter RNG is a pure function",
+        counterRandom(1, 7) == counterRandom(1, 7) &&
+            counterRandom(1, 7) != counterRandom(2, 7));
+
+  // One dimension through the operator: x^2 over [0, 1].
+  double q = eval("Q0,1,65536,1,^@0,2");
+  check("Q integrates x^2", std::abs(q - 1.0 / 3) < 1e-4);
+  check("Q takes the first free slots",
+        std::abs(eval("A1,2,0,Q0,1,4096,1,*@0,@1") - 1.5) < 1e-3);
+  check("Q with no samples is 0", eval("Q0,1,0,2,1") == 0);
+
+  // A 3-dimensional nested midpoint rule against Q on the same integrand.
+  auto start = std::chrono::steady_clock::now();
+  double nested = eval("I0,1,60,0,I0,1,60,1,I0,1,60,2,^e,+@0,+@1,@2");
+  double nestedTime = secondsSince(start);
+  start = std::chrono::steady_clock::now();
+  double sampled = eval("Q0,1,262144,3,^e,+@0,+@1,@2");
+  double sampledTime = secondsSince(start);
+  double exact3 = std::pow(M_E - 1, 3);
+  std::cout << "3-d nested I: " << nested - exact3 << " error in "
+            << nestedTime << " s; Q: " << sampled - exact3 << " error in "
+            << sampledTime << " s" << std::endl;
+  check("Q matches nested I", std::abs(sampled - exact3) < 1e-4);
+
+  // Error estimates, reproducibility and method choice in 6 dimensions.
+  double exact6 = std::pow(M_E - 1, 6);
+  MonteCarloIntegrator six(expSum(6));
+  check("integrand uses the lane VM", six.usesVM());
+  std::vector<double> lo(6, 0.0), hi(6, 1.0);
+  IntegrationResult qmc = six.integrate(lo, hi, 1 << 18);
+  report("6-d Sobol", qmc, exact6);
+  check("Sobol within 4 standard errors",
+        std::abs(qmc.value - exact6) < 4 * qmc.error);
+  IntegrationResult mc = six.integrate(
+      lo, hi, 1 << 18, {}, {.method = SampleMethod::PSEUDO_RANDOM});
+  report("6-d pseudo-random", mc, exact6);
+  check("pseudo-random within 4 standard errors",
+        std::abs(mc.value - exact6) < 4 * mc.error);
+  check("Sobol beats pseudo-random", qmc.error < mc.error);
+
+  IntegrationResult one = six.integrate(lo, hi, 1 << 16, {}, {.threads = 1});
+  IntegrationResult many = six.integrate(lo, hi, 1 << 16, {}, {.threads = 5});
+  check("same result on any thread count",
+        one.value == many.value && one.error == many.error);
+  IntegrationResult reseeded =
+      six.integrate(lo, hi, 1 << 16, {}, {.seed = 99, .threads = 1});
+  check("seed changes the shifts", reseeded.value != one.value);
+
+  // Per-coordinate bounds and $n: $0 * (x + y) over [0, 2] x [1, 3] is
+  // 12 * $0.
+  MonteCarloIntegrator box("*$0,+@0,@1");
+  IntegrationResult r = box.integrate({0, 1}, {2, 3}, 1 << 14, {1.5});
+  check("per-coordinate bounds", std::abs(r.value - 18) < 4 * r.error);
+
+  // Loop bodies fall back to V1; the inner A takes the slot after @0.
+  MonteCarloIntegrator loop("A1,3,-1,*@0,@1");
+  IntegrationResult l = loop.integrate({0}, {1}, 1 << 12);
+  check("loop body falls back to V1", !loop.usesVM());
+  check("loop body integrates", std::abs(l.value - 3) < 4 * l.error);
+
+  // Eight dimensions, a million samples, through the operator and the VM.
+  double exact8 = std::pow(M_E - 1, 8);
+  start = std::chrono::steady_clock::now();
+  double q8 = eval("Q0,1,1000000,8," + expSum(8));
+  double q8Time = secondsSince(start);
+  MonteCarloIntegrator eight(expSum(8));
+  start = std::chrono::steady_clock::now();
+  IntegrationResult vm8 = eight.integrate(std::vector<double>(8, 0.0),
+                                          std::vector<double>(8, 1.0),
+                                          1000000);
+  double vm8Time = secondsSince(start);
+  report("8-d Sobol", vm8, exact8);
+  std::cout << "8-d Q operator " << q8Time << " s, lane VM " << vm8Time
+            << " s" << std::endl;
+  check("8-d integral within 1e-4 relative",
+        std::abs(q8 - exact8) < 1e-4 * exact8 &&
+            std::abs(vm8.value - exact8) < 1e-4 * exact8);
+  check("8-d integral in seconds", q8Time < 10 && vm8Time < 10);
+  return failures == 0 ? 0 : 1;
+}
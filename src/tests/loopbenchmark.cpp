@@ -0,0 +1,64 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <vector>
+
+#include "functionlang.hpp"
+
+// Every allocation made by the process, to show what one evaluation costs
+// beyond its arithmetic.
+std::atomic<uint64_t> allocations{0};
+
+// The replacements are kept out of line: inlined, GCC would see std::free
+// called on a pointer from operator new, or operator delete on one from
+// std::malloc, and warn of a mismatched pair.
+[[gnu::noinline]] void *operator new(std::size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void *p = std::malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+[[gnu::noinline]] void operator delete(void *p) noexcept { std::free(p); }
+[[gnu::noinline]] void operator delete(void *p, std::size_t) noexcept {
+  std::free(p);
+}
+
+void run_case(const char *name, const char *equation, int repeats) {
+  using namespace functionlang;
+  // Repeated evaluations would otherwise be answered by the memo cache.
+  memoOptions.enabled = false;
+  const char *ptr = equation;
+  ExprFunc func = parseExpression(ptr);
+  memoOptions.enabled = true;
+  std::vector<double> args = {0.7, 1.3, 2.0};
+
+  double sum = func(args);
+  uint64_t before = allocations;
+  auto start = std::chrono::high_resolution_clock::now();
+  for (int i = 0; i < repeats; ++i)
+    sum += func(args);
+  auto end = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double> diff = end - start;
+  double allocs = static_cast<double>(allocations - before) / repeats;
+
+  std::cout << std::left << std::setw(26) << name << std::right
+            << std::setw(12) << diff.count() / repeats * 1e6 << " us/eval "
+            << std::setw(10) << allocs << " allocs/eval   (" << sum << ")"
+            << std::endl;
+}
+
+int main() {
+  std::cout << std::fixed << std::setprecision(3);
+  run_case("A, 1000 trips", "A1,1000,-1,*@0,$0", 2000);
+  run_case("P, 1000 trips", "P1,1000,-1,+1,/$0,*@0,@0", 2000);
+  run_case("I, 1000 steps", "I0,1,1000,-1,^@0,2", 2000);
+  run_case("A in A, 100 x 100", "A1,100,-1,A1,100,-1,*@0,@1", 200);
+  run_case("I in A, 100 x 100", "A1,100,-1,I0,@0,100,-1,*@1,$1", 200);
+  run_case("A in A in A, 20^3", "A1,20,-1,A1,20,-1,A1,20,-1,+@0,*@1,@2", 200);
+  run_case("A in A, 1000 x 2", "A1,1000,-1,A1,2,-1,*@0,@1", 2000);
+  return 0;
+}
@@ -0,0 +1,140 @@
+#include "functionlang.hpp"
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <thread>
+
+using namespace functionlang;
+
+int failures = 0;
+
+void check(const std::string &name, bool ok) {
+  failures += !ok;
+  std::cout << name << " : " << (ok ? "OK" : "FAILED") << std::endl;
+}
+
+ExprFunc compile(const std::string &expr, bool memo = true) {
+  memoOptions.enabled = memo;
+  const char *ptr = expr.c_str();
+  ExprFunc func = parseExpression(ptr);
+  memoOptions.enabled = true;
+  return func;
+}
+
+std::vector<double> inputs(double x, double lo, double hi) {
+  std::vector<double> args(8, 0.0);
+  args[0] = x;
+  args[1] = 1.5;
+  args[3] = lo;
+  args[4] = hi;
+  return args;
+}
+
+int main() {
+  // The integral over [$3, $4] is cached; $0 outside it is not part of the
+  // key.
+  const std::string expr = "+$0,I$3,$4,2000,-1,*s*@0,$1,l+@0,2";
+  ExprFunc memo = compile(expr), plain = compile(expr, false);
+  uint64_t hits = memoCounters.hits, misses = memoCounters.misses;
+  bool same = true;
+  for (int i = 0; i < 100; i++) {
+    std::vector<double> args = inputs(i * 0.1, 0, 1 + i % 4);
+    same &= memo(args) == plain(args);
+  }
+  check("cached results match", same);
+  check("only new keys miss", memoCounters.misses - misses == 4 &&
+                                  memoCounters.hits - hits == 96);
+  std::cout << "hit rate " << memoCounters.hitRate() << std::endl;
+
+  // Cheap and nested loops keep no cache.
+  uint64_t caches = memoCounters.caches;
+  compile("A1,3,-1,@0");
+  compile("A1,1000,-1,A1,1000,-1,*@0,@1");
+  check("cheap loops are not cached", memoCounters.caches == caches + 1);
+  // Input-dependent bounds are assumed to run a minimum of trips.
+  compile("A0,$0,-1,@0");
+  check("cheap input-dependent loops are not cached",
+        memoCounters.caches == caches + 1);
+  check("costly input-dependent loops are cached",
+        (compile("A1,$0,-1,s*@0,+$1,l+@0,c$1"),
+         memoCounters.caches == caches + 2));
+  memoOptions.minInstructions = 1e9;
+  compile(expr);
+  memoOptions.minInstructions = MemoOptions{}.minInstructions;
+  check("threshold is configurable", memoCounters.caches == caches + 2);
+
+  // CLOCK keeps the entry that is used between misses.
+  memoOptions.capacity = 4;
+  ExprFunc small = compile("A1,$3,-1,s*@0,+$1,l+@0,c$1");
+  memoOptions.capacity = MemoOptions{}.capacity;
+  uint64_t evictions = memoCounters.evictions;
+  for (int lo = 1000; lo < 1012; lo++) {
+    small(inputs(0, lo, 0));
+    small(inputs(0, 999, 0));
+  }
+  hits = memoCounters.hits;
+  small(inputs(0, 999, 0));
+  check("hot entry survives eviction", memoCounters.hits == hits + 1);
+  check("evictions are counted", memoCounters.evictions > evictions);
+
+  // The automatic slot of a loop depends on the internal slots set by the
+  // caller, which are part of the key.
+  ExprFunc slot = compile("A1,500,-1,+@0,@1");
+  ExprFunc slotPlain = compile("A1,500,-1,+@0,@1", false);
+  std::vector<double> preset(INTERNAL_VARIABLE_START + 2, DEFAULT_RESULT);
+  std::vector<double> free = preset;
+  preset[INTERNAL_VARIABLE_START] = 7;
+  slot(free);
+  check("preset slots change the key",
+        slot(preset) == slotPlain(preset) && slot(free) == slotPlain(free));
+
+  // A hit charges the usage of the evaluation it replaces, so limits still
+  // apply; cancelled evaluations are not cached.
+  ExprFunc limited = compile("A1,5000,-1,s@0");
+  double first, second, third;
+  EvalStatus ok = evaluateBounded(limited, {}, {}, first);
+  EvalStatus again = evaluateBounded(limited, {}, {}, second);
+  EvalStatus over = evaluateBounded(limited, {}, {.maxIterations = 100}, third);
+  check("hits keep limits", ok == EvalStatus::OK && again == EvalStatus::OK &&
+                                first == second &&
+                                over == EvalStatus::ITERATION_LIMIT);
+  ExprFunc cancelled = compile("A1,5000,-1,S@0");
+  std::atomic<bool> flag{true};
+  cancelToken = &flag;
+  double stopped = cancelled({});
+  cancelToken = nullptr;
+  check("cancelled results are not cached",
+        stopped == DEFAULT_RESULT && cancelled({}) != DEFAULT_RESULT);
+
+  // Threads share one cache.
+  std::vector<std::jthread> threads;
+  std::atomic<int> wrong{0};
+  for (int t = 0; t < 4; t++)
+    threads.emplace_back([&, t] {
+      for (int i = 0; i < 200; i++) {
+        std::vector<double> args = inputs(t, 0, 1 + (i + t) % 8);
+        wrong += memo(args) != plain(args);
+      }
+    });
+  threads.clear();
+  check("threads share the cache", wrong == 0);
+
+  // An evaluation loop where only $0 changes.
+  auto time = [&](const ExprFunc &f) {
+    auto start = std::chrono::steady_clock::now();
+    double sum = 0;
+    for (int i = 0; i < 2000; i++)
+      sum += f(inputs(i, 0, 1));
+    return std::make_pair(std::chrono::duration<double>(
+                              std::chrono::steady_clock::now() - start)
+                              .count(),
+                          sum);
+  };
+  auto [plainTime, plainSum] = time(plain);
+  auto [memoTime, memoSum] = time(memo);
+  std::cout << "2000 evaluations: plain " << plainTime * 1e3 << " ms, cached "
+            << memoTime * 1e3 << " ms (" << plainTime / memoTime << "x)"
+            << std::endl;
+  check("cached evaluation loop agrees", plainSum == memoSum);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,191 @@
+#include "functionlangPlanner.hpp"
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+using namespace functionlang;
+
+int failures = 0;
+
+void check(const std::string &name, bool ok) {
+  failures += !ok;
+  std::cout << name << " : " << (ok ? "OK" : "FAILED") << std::endl;
+}
+
+double closureResult(const std::string &expr,
+                     const std::vector<double> &args) {
+  const char *ptr = expr.c_str();
+  return parseExpression(ptr)(args);
+}
+
+std::vector<std::vector<double>> makeRows(size_t count) {
+  std::vector<std::vector<double>> rows(count);
+  for (size_t r = 0; r < count; r++)
+    rows[r] = {0.5 + r * 1e-3, 1.3 - r * 1e-4, 2.1};
+  return rows;
+}
+
+// Best of five timings of `f`, in seconds.
+template <typename F> double bestOf(F &&f) {
+  double best = 1e300;
+  for (int i = 0; i < 5; i++) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    best = std::min(best, std::chrono::duration<double>(
+                              std::chrono::steady_clock::now() - start)
+                              .count());
+  }
+  return best;
+}
+
+// Seconds to compile `expr` for `engine` and evaluate `rows` with it.
+double measure(const std::string &expr, Engine engine,
+               const std::vector<std::vector<double>> &rows) {
+  const char *eq = expr.c_str();
+  double compile = bestOf([&] {
+    switch (engine) {
+    case Engine::CLOSURE: {
+      const char *ptr = eq;
+      parseExpression(ptr);
+      break;
+    }
+    case Engine::BYTECODE:
+      FunctionParserV2{eq};
+      break;
+    case Engine::REGISTER:
+      FunctionParserReg{eq};
+      break;
+    case Engine::LANES:
+      PlannedFunction::LaneVM{eq};
+      break;
+    }
+  });
+  PlannedFunction f(expr, {rows.size(), 1}, engineOnlyModel(engine));
+  return compile + bestOf([&] { f.evalRows(rows); });
+}
+
+int main() {
+  // Plans follow the workload: one row is not worth batching, a million
+  // rows are.
+  const std::string poly = "+*$0,*$0,$0,+*3,*$0,$1,s$2";
+  Plan once = makePlan(poly, {1, 1});
+  Plan many = makePlan(poly, {1'000'000, 1});
+  std::cout << explain(once) << "\n" << explain(many) << std::endl;
+  check("one row is not batched", once.chosen.engine != Engine::LANES);
+  check("many rows are batched", many.chosen.engine == Engine::LANES);
+  check("loops are planned on V1",
+        makePlan("A1,$0,-1,*@0,$1", {1000, 1}).chosen.engine ==
+            Engine::CLOSURE);
+  check("options are sorted", std::is_sorted(
+                                  many.options.begin(), many.options.end(),
+                                  [](const PlanOption &a, const PlanOption &b) {
+                                    return a.seconds() < b.seconds();
+                                  }));
+  check("parse errors fall back to V1",
+        makePlan("+$0").chosen.engine == Engine::CLOSURE &&
+            explain(makePlan("+$0")).find("parse error") != std::string::npos);
+
+  ExpressionProfile loop = profileExpression("A1,1e5,-1,s*@0,$0");
+  check("root loop is splittable", loop.splittable && loop.trips == 1e5 &&
+                                       loop.bodyLoopFree);
+  check("input-dependent loops are not",
+        !profileExpression("A1,$0,-1,@0").splittable);
+  bool registers = true;
+  for (const char *expr : {"+$0,1", "? > $0 0 + $0 * $1 $2 _ $0 1",
+                           "A1,3,-1,@0", "*$256,2", "+$0"})
+    registers &= profileExpression(expr).registers ==
+                 FunctionParserReg(expr).isSupported();
+  check("register support is read from the tree", registers);
+  check("libm calls are counted",
+        estimateCost("A1,10,-1,s*@0,$0").mathCalls == 10);
+
+  // Every engine gives V1's results, one row and many.
+  auto rows = makeRows(1001);
+  const char *exprs[] = {"? > $0 0 + $0 * $1 $2 _ $0 1", poly.c_str(),
+                         "^+$0,1,2.5", "A1,20,-1,*@0,$0"};
+  for (const char *expr : exprs) {
+    for (size_t e = 0; e < ENGINE_COUNT; e++) {
+      PlanOption option{static_cast<Engine>(e), e == 3 ? 3u : 1u};
+      if (profileExpression(expr).loops && option.engine != Engine::CLOSURE)
+        continue;
+      PlannedFunction f(expr, {rows.size(), option.threads},
+                        engineOnlyModel(option.engine));
+      std::vector<double> out = f.evalRows(rows);
+      bool ok = f.plan().chosen.engine == option.engine &&
+                f.eval(rows[7]) == closureResult(expr, rows[7]);
+      for (size_t r = 0; r < rows.size(); r++)
+        ok &= std::abs(out[r] - closureResult(expr, rows[r])) <=
+              1e-12 * std::abs(out[r]);
+      check(std::string(engineName(option.engine)) + " runs " + expr, ok);
+    }
+  }
+
+  // Split loops agree with V1 and do not depend on the thread count.
+  const char *loops[] = {"A1,100000,-1,s*@0,$0", "P1,9000,-1,+1,/$0,*@0,@0",
+                         "I0,2,50000,-1,^@0,2", "A1,20000,-1,A1,3,-1,*@0,@1",
+                         "A1,20000,3,+A1,3,3,*@3,$0,@3",
+                         "A1,100000,7,s*@7,$0"};
+  for (const char *expr : loops) {
+    std::vector<double> args = {0.3};
+    double serial = closureResult(expr, args);
+    PlannedFunction one(expr, {1, 1}), four(expr, {1, 4});
+    double a = one.eval(args), b = four.eval(args);
+    std::cout << expr << ": " << detail::describe(four.plan().chosen)
+              << std::endl;
+    check(std::string("split ") + expr,
+          four.plan().chosen.splitLoop &&
+              (!one.plan().chosen.splitLoop || a == b) &&
+              std::abs(a - serial) <= 1e-9 * std::abs(serial) &&
+              std::abs(b - serial) <= 1e-9 * std::abs(serial));
+  }
+  std::atomic<bool> cancelled{true};
+  cancelToken = &cancelled;
+  check("split loops stop when cancelled",
+        PlannedFunction("A1,1e7,-1,s@0", {1, 4}).eval({}) == DEFAULT_RESULT);
+  cancelToken = nullptr;
+
+  // Calibrate on the suite, then compare estimates with measurements on
+  // expressions outside it.
+  auto start = std::chrono::steady_clock::now();
+  CostModel model = calibrate();
+  std::chrono::duration<double> calibration =
+      std::chrono::steady_clock::now() - start;
+  std::cout << "calibrated in " << calibration.count() << " s:\n{{{";
+  for (size_t e = 0; e < ENGINE_COUNT; e++) {
+    const EngineCost &c = model.engines[e];
+    std::cout << (e ? ",\n   " : "") << "{" << c.compilePerNode << ", "
+              << c.perCall << ", " << c.perInstruction << ", "
+              << c.perMathCall << ", " << c.perIteration << "}";
+  }
+  std::cout << "}},\n " << model.threadStart << "}" << std::endl;
+
+  const char *heldOut[] = {"*+$0,$1,_$2,$0", "+s$0,+S$1,l+$2,1",
+                           "m*$0,$1,M$2,^$0,2",
+                           "+*+$0,1,+$1,2,*+$2,3,+*$0,$1,+$2,*$0,$0"};
+  int good = 0, total = 0;
+  for (const char *expr : heldOut) {
+    for (uint64_t count : {1ul, 100ul, 100'000ul}) {
+      auto sample = makeRows(count);
+      Plan plan = makePlan(expr, {count, 1}, model);
+      double best = 1e300, chosen = 0;
+      for (const PlanOption &o : plan.options) {
+        if (o.threads != 1)
+          continue;
+        double t = measure(expr, o.engine, sample);
+        best = std::min(best, t);
+        if (o.engine == plan.chosen.engine)
+          chosen = t;
+        std::cout << "  " << expr << " x" << count << " "
+                  << engineName(o.engine) << ": estimated "
+                  << detail::formatSeconds(o.seconds()) << ", measured "
+                  << detail::formatSeconds(t) << std::endl;
+      }
+      total++;
+      good += chosen <= 1.5 * best;
+    }
+  }
+  std::cout << good << "/" << total
+            << " plans within 1.5x of the fastest engine" << std::endl;
+  check("plans are mostly near the fastest engine", good * 4 >= total * 3);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,115 @@
+#include "functionlangPlot.hpp"
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+using namespace functionlang;
+
+int failures = 0;
+
+void check(const char *name, bool ok) {
+  failures += !ok;
+  std::cout << name << " : " << (ok ? "OK" : "FAILED") << std::endl;
+}
+
+double millisSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+// Largest gap between the sampled polyline and the exact curve, checked
+// between every pair of samples.
+template <typename F>
+double maxLinearError(const std::vector<PlotPoint> &points, F exact) {
+  double worst = 0;
+  for (size_t i = 0; i + 1 < points.size(); i++) {
+    double x = (points[i].x + points[i + 1].x) / 2;
+    double y = (points[i].y + points[i + 1].y) / 2;
+    worst = std::max(worst, std::abs(y - exact(x)));
+  }
+  return worst;
+}
+
+int main() {
+  const std::vector<double> args(256, 0.0);
+  const double frameMs = 1000.0 / 60;
+
+  // A narrow peak at 0 on a flat baseline: samples should gather at the peak.
+  AdaptiveSampler peak;
+  peak.setExpression("/1,+^$0,2,1e-4", args, 0);
+  std::vector<PlotPoint> points = peak.sample(-10, 10);
+  size_t nearPeak = 0, farFromPeak = 0;
+  for (const PlotPoint &p : points) {
+    nearPeak += std::abs(p.x) < 0.5;
+    farFromPeak += std::abs(p.x) > 9.5;
+  }
+  std::cout << points.size() << " samples, " << nearPeak << " within 0.5 of "
+            << "the peak, " << farFromPeak << " near the edges" << std::endl;
+  check("uses the lane VM", peak.usesVM());
+  check("refines at the peak", nearPeak > 4 * farFromPeak);
+  double error = maxLinearError(
+      points, [](double x) { return 1 / (x * x + 1e-4); });
+  check("polyline within 2% of the peak height", error < 0.02 * 1e4);
+
+  // Panning by a fraction of the view reuses the overlapping samples.
+  peak.sample(-9, 11);
+  const SampleStats &pan = peak.stats();
+  std::cout << "pan: " << pan.evaluated << " evaluated, " << pan.reused
+            << " reused" << std::endl;
+  check("pan reuses samples", pan.reused > 4 * pan.evaluated);
+
+  // Zooming in by two keeps the old lattice points.
+  peak.sample(-5, 5);
+  check("zoom reuses samples", peak.stats().reused > 0);
+
+  // Loops fall back to V1.
+  AdaptiveSampler loops;
+  loops.setExpression("A1,3,-1,*@0,$0", args, 0);
+  std::vector<PlotPoint> line = loops.sample(0, 1);
+  check("loop expression falls back to V1",
+        !loops.usesVM() && !line.empty() &&
+            std::abs(line.back().y - 6 * line.back().x) < 1e-9);
+
+  // An oscillation dense enough to need about 1e5 samples. The initial grid
+  // must resolve every period, or refinement cannot see the curve bend.
+  AdaptiveSampler dense({.initialIntervals = 1 << 14});
+  dense.setExpression("s*$0,100", args, 0);
+  auto start = std::chrono::steady_clock::now();
+  points = dense.sample(0, 100);
+  double firstMs = millisSince(start);
+  std::cout << points.size() << " samples in " << firstMs << " ms, depth "
+            << dense.stats().depth << std::endl;
+  check("dense curve needs 1e5 samples", points.size() >= 100'000);
+
+  // A redraw of the same view is served from the cache and decimated to
+  // the window width.
+  start = std::chrono::steady_clock::now();
+  points = dense.sample(0, 100);
+  std::vector<PlotPoint> drawn = decimate(points, 0, 100, 1920);
+  double redrawMs = millisSince(start);
+  std::cout << "cached redraw: " << redrawMs << " ms, " << drawn.size()
+            << " points drawn" << std::endl;
+  check("cached redraw within one frame", redrawMs < frameMs);
+  check("cached redraw evaluates nothing", dense.stats().evaluated == 0);
+  check("decimated to four points per column", drawn.size() <= 4 * 1920);
+
+  // Decimation keeps the extremes of every column.
+  std::vector<PlotPoint> saw;
+  for (int i = 0; i < 1000; i++)
+    saw.push_back({i / 1000.0, i % 2 ? 1.0 : -1.0});
+  drawn = decimate(saw, 0, 1, 10);
+  bool extremes = true;
+  for (int c = 0; c < 10; c++) {
+    bool lo = false, hi = false;
+    for (const PlotPoint &p : drawn) {
+      if (std::floor(p.x * 10) == c) {
+        lo |= p.y == -1.0;
+        hi |= p.y == 1.0;
+      }
+    }
+    extremes &= lo && hi;
+  }
+  check("decimation keeps column extremes", extremes);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,85 @@
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "functionlangRegister.hpp"
+#include "functionlangV2.hpp"
+
+// Builds "+$0,*$1,+$2,..." nested `depth` times to the right.
+std::string rightDeep(int depth) {
+  std::string eq;
+  for (int i = 0; i < depth; ++i)
+    eq += (i % 2 ? "*$" : "+$") + std::to_string(i % 3) + ",";
+  return eq + "1";
+}
+
+// Builds "+++...$0,1,1,..." nested `depth` times to the left.
+std::string leftDeep(int depth) {
+  std::string eq(depth, '+');
+  eq += "$0";
+  for (int i = 0; i < depth; ++i)
+    eq += ",s$" + std::to_string(i % 3);
+  return eq;
+}
+
+// Builds a full binary tree of `depth` levels.
+std::string balanced(int depth) {
+  if (depth == 0)
+    return "$1";
+  std::string sub = balanced(depth - 1);
+  return (depth % 2 ? "+" : "*") + sub + "," + sub;
+}
+
+bool run_case(const char *name, const std::string &equation, int iterations) {
+  using namespace functionlang;
+  std::vector<double> args = {0.5, 1.0000001, 0.25};
+
+  FunctionParserV2 stack_vm(equation.c_str());
+  auto start_stack = std::chrono::high_resolution_clock::now();
+  double sum_stack = 0;
+  for (int i = 0; i < iterations; ++i)
+    sum_stack += stack_vm.eval(args);
+  auto end_stack = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double> diff_stack = end_stack - start_stack;
+
+  FunctionParserReg reg_vm(equation.c_str());
+  auto start_reg = std::chrono::high_resolution_clock::now();
+  double sum_reg = 0;
+  for (int i = 0; i < iterations; ++i)
+    sum_reg += reg_vm.eval(args);
+  auto end_reg = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double> diff_reg = end_reg - start_reg;
+
+  std::cout << "--- " << name << " (" << equation.size() << " chars) ---"
+            << std::endl;
+  std::cout << "V2 (VM Stack) Time:    " << diff_stack.count() << "s"
+            << std::endl;
+  std::cout << "V2 (VM Register) Time: " << diff_reg.count() << "s"
+            << std::endl;
+  std::cout << "Register VM is " << diff_stack.count() / diff_reg.count()
+            << "x faster than the stack VM." << std::endl;
+
+  if (std::abs(sum_stack - sum_reg) <= 1e-9 * std::abs(sum_stack)) {
+    std::cout << "Verification: SUCCESS (Both results match).\n" << std::endl;
+    return true;
+  }
+  std::cout << "Verification: FAILED! Stack Sum: " << sum_stack
+            << " | Register Sum: " << sum_reg << "\n"
+            << std::endl;
+  return false;
+}
+
+int main() {
+  const int iterations = 1'000'000;
+  std::cout << std::fixed << std::setprecision(6);
+  std::cout << "Benchmarking " << iterations << " iterations per case...\n\n";
+
+  bool ok = true;
+  ok &= run_case("Shallow", "? > $0 0 + $0 * $1 $2 _ $0 1", iterations);
+  ok &= run_case("Right-deep 64", rightDeep(64), iterations);
+  ok &= run_case("Left-deep 64", leftDeep(64), iterations);
+  ok &= run_case("Balanced 8", balanced(8), iterations / 4);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,127 @@
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <thread>
+
+#include "functionlangScript.hpp"
+
+using namespace functionlang;
+
+int failures = 0;
+
+void check(const std::string &name, bool ok) {
+  failures += !ok;
+  std::cout << name << " : " << (ok ? "OK" : "FAILED") << std::endl;
+}
+
+// A recalculation job: setters, custom functions, blocks and expressions
+// over the store, a few of them with loops.
+std::vector<std::string> makeScript(size_t lines) {
+  std::mt19937 rng(45);
+  auto slot = [&] { return std::to_string(rng() % 64); };
+  std::vector<std::string> script;
+  for (size_t i = 0; i < lines; i++) {
+    switch (rng() % 10) {
+    case 0:
+    case 1:
+      script.push_back(":s $" + slot() + " +*$0," + std::to_string(i % 97) +
+                       ",$1");
+      break;
+    case 2:
+      script.push_back(":f #" + slot() + " *$0,$" + slot());
+      break;
+    case 3:
+      script.push_back(":b +$" + slot() + ",$" + slot() + "; *$" + slot() +
+                       ",2");
+      break;
+    case 4:
+      script.push_back("A1,20,-1,*@0,$" + slot());
+      break;
+    default:
+      script.push_back("+*$" + slot() + ",$" + slot() + ",s$" + slot());
+    }
+  }
+  return script;
+}
+
+// Each line prepared, run and stored in order, as the REPL does.
+std::vector<script::Statement> runSequential(
+    const std::vector<std::string> &lines, std::vector<double> values) {
+  std::vector<script::Statement> statements;
+  for (const std::string &line : lines) {
+    script::Statement st = script::prepare(line);
+    script::run(st, values);
+    if (st.writes())
+      values[st.index] = st.results[0];
+    statements.push_back(std::move(st));
+  }
+  return statements;
+}
+
+bool sameResults(const std::vector<script::Statement> &a,
+                 const std::vector<script::Statement> &b) {
+  if (a.size() != b.size())
+    return false;
+  for (size_t i = 0; i < a.size(); i++)
+    if (a[i].results.size() != b[i].results.size() ||
+        std::memcmp(a[i].results.data(), b[i].results.data(),
+                    a[i].results.size() * sizeof(double)) != 0)
+      return false;
+  return true;
+}
+
+int main() {
+  std::vector<double> values(INTERNAL_VARIABLE_START, 0.0);
+  for (size_t i = 0; i < values.size(); i++)
+    values[i] = 0.25 * i;
+
+  // A reader sees the last :s of its slot before it, not later ones.
+  std::vector<std::string> small = {":s $0 3", "+$0,1", ":s $0 *$0,2",
+                                    ":b $0; $1", ":s $x 1", "+$0,"};
+  std::vector<script::Statement> ordered = script::runBatch(small, values, 4);
+  check("readers see earlier setters",
+        ordered[1].results[0] == 4 && ordered[3].results[0] == 20 &&
+            ordered[3].results[1] == 0.25);
+  check("bad lines are not run",
+        !ordered[4].indexError.empty() && !ordered[5].planned);
+  check("small script matches sequential",
+        sameResults(ordered, runSequential(small, values)));
+
+  // Lines only the VMs reject, and blank ones, run on V1, in a batch as one
+  // by one.
+  std::vector<std::string> v1Only = {"*$256,2", "A1,3,300,@300", "+1,2 3",
+                                     "", "  "};
+  std::vector<script::Statement> fallback = script::runBatch(v1Only, values, 4);
+  check("V1-only lines run",
+        fallback[0].planned && fallback[1].results == std::vector<double>{6} &&
+            fallback[2].results == std::vector<double>{3} &&
+            fallback[3].results == std::vector<double>{0} &&
+            fallback[4].planned);
+  check("V1-only lines match sequential",
+        sameResults(fallback, runSequential(v1Only, values)));
+
+  const size_t LINES = 100000;
+  std::vector<std::string> script = makeScript(LINES);
+  auto time = [](auto &&f) {
+    auto start = std::chrono::steady_clock::now();
+    auto result = f();
+    return std::make_pair(std::chrono::duration<double>(
+                              std::chrono::steady_clock::now() - start)
+                              .count(),
+                          std::move(result));
+  };
+  auto [sequentialTime, sequential] =
+      time([&] { return runSequential(script, values); });
+  size_t threads = std::max(1u, std::thread::hardware_concurrency());
+  auto [batchTime, batch] =
+      time([&] { return script::runBatch(script, values, threads); });
+  check("100k-line script matches sequential", sameResults(sequential, batch));
+
+  std::cout << std::fixed << std::setprecision(1) << LINES
+            << " lines: sequential " << sequentialTime * 1e3 << " ms, batch on "
+            << threads << " threads " << batchTime * 1e3 << " ms ("
+            << sequentialTime / batchTime << "x)" << std::endl;
+  return failures == 0 ? 0 : 1;
+}
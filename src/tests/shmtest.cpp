@@ -0,0 +1,115 @@
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/wait.h>
+
+#include "functionlangShm.hpp"
+#include "functionlangV2.hpp"
+
+// Producer harness for the shared-memory store. Without arguments it forks a
+// producer and checks that readers in this process only ever see complete
+// updates. With `--produce NAME` it just feeds NAME until interrupted, for
+// trying `:shm NAME` in the REPL:
+//   $0 counts updates, $1 is seconds since start, $2 = sin($1).
+using namespace functionlang;
+
+const size_t WIDTH = 64;
+
+int failures = 0;
+
+void check(const char *name, bool ok) {
+  failures += !ok;
+  std::cout << name << " : " << (ok ? "OK" : "FAILED") << std::endl;
+}
+
+// Writes generation g as $i = g + i for every i < WIDTH, in one update.
+void produce(shm::SharedStore &store, std::chrono::seconds duration) {
+  std::vector<double> row(WIDTH);
+  auto end = std::chrono::steady_clock::now() + duration;
+  for (uint64_t g = 1; std::chrono::steady_clock::now() < end; g++) {
+    for (size_t i = 0; i < WIDTH; i++)
+      row[i] = static_cast<double>(g + i);
+    store.set(0, row);
+  }
+}
+
+int feed(const std::string &name) {
+  shm::SharedStore store;
+  if (!store.create(name)) {
+    std::cerr << "could not create " << name << ": " << std::strerror(errno)
+              << std::endl;
+    return 1;
+  }
+  std::cout << "Feeding " << name << ", Ctrl-C to stop" << std::endl;
+  auto start = std::chrono::steady_clock::now();
+  for (double n = 0;; n++) {
+    double t = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                             start)
+                   .count();
+    double row[] = {n, t, std::sin(t)};
+    store.set(0, row);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc >= 3 && std::strcmp(argv[1], "--produce") == 0)
+    return feed(argv[2]);
+
+  std::string name = "/functionlang-test-" + std::to_string(getpid());
+  shm::SharedStore store;
+  check("segment created", store.create(name));
+  check("starts zeroed", store.get(0) == 0 && store.get(shm::SLOTS - 1) == 0);
+  store.set(5, 2.5);
+  check("set and get", store.get(5) == 2.5);
+
+  shm::SharedStore reader;
+  check("segment opened", reader.open(name));
+  check("reader sees writes", reader.get(5) == 2.5);
+  shm::SharedStore missing;
+  check("missing segment fails", !missing.open(name + "-missing"));
+
+  pid_t producer = fork();
+  if (producer == 0) {
+    // A fresh mapping, as an unrelated producer process would have.
+    shm::SharedStore child;
+    if (!child.open(name))
+      _exit(1);
+    produce(child, std::chrono::seconds(1));
+    _exit(0);
+  }
+
+  // Every snapshot must hold one generation: $i - $0 == i for every i.
+  FunctionParserV2 last(("_$" + std::to_string(WIDTH - 1) + ",$0").c_str());
+  std::vector<double> values;
+  uint64_t reads = 0, torn = 0, versions = 0, lastVersion = 0;
+  auto start = std::chrono::steady_clock::now();
+  while (waitpid(producer, nullptr, WNOHANG) == 0) {
+    uint64_t version = reader.snapshot(values);
+    versions += version != lastVersion;
+    lastVersion = version;
+    reads++;
+    bool consistent = last.eval(values) == static_cast<double>(WIDTH - 1);
+    for (size_t i = 1; i < WIDTH && consistent; i++)
+      consistent = values[i] - values[0] == static_cast<double>(i);
+    torn += !consistent && values[0] != 0;
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  std::cout << reads << " snapshots (" << reads / elapsed.count()
+            << "/s), " << versions << " distinct versions, "
+            << reader.version() << " updates written" << std::endl;
+  check("producer updated the store", versions > 1);
+  check("no torn snapshots", torn == 0);
+
+  reader.detach();
+  store.detach();
+  check("segment removed by its creator", !reader.open(name));
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,170 @@
+#include "functionlangSolve.hpp"
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+
+using namespace functionlang;
+
+int failures = 0;
+
+void check(const std::string &name, bool ok) {
+  failures += !ok;
+  std::cout << name << " : " << (ok ? "OK" : "FAILED") << std::endl;
+}
+
+void report(const char *name, const Solver &solver) {
+  const SolveStats &s = solver.stats();
+  std::cout << name << ": " << s.converged << "/" << s.problems
+            << " converged, " << s.iterations << " iterations (max "
+            << s.maxIterations << "), " << s.evaluations << " evaluations in "
+            << s.batches << " batches" << std::endl;
+}
+
+// Compares the symbolic derivative with central differences at random $0.
+bool derivativeMatches(const char *expr) {
+  std::string source;
+  if (!Differentiator::differentiate(expr, 0, source))
+    return false;
+  FunctionParserV2 f(expr), df(source.c_str());
+  std::mt19937 rng(3);
+  std::uniform_real_distribution<double> dist(0.2, 3.0);
+  std::vector<double> args = {0, 1.7};
+  for (int i = 0; i < 100; i++) {
+    double x = dist(rng), h = 1e-6;
+    args[0] = x + h;
+    double up = f.eval(args);
+    args[0] = x - h;
+    double down = f.eval(args);
+    args[0] = x;
+    double exact = df.eval(args), estimate = (up - down) / (2 * h);
+    if (std::abs(exact - estimate) > 1e-5 * std::max(1.0, std::abs(exact))) {
+      std::cout << expr << " -> " << source << " at " << x << ": " << exact
+                << " vs " << estimate << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+int main() {
+  const char *smooth[] = {"*$0,$0",        "^$0,3",         "^$1,$0",
+                          "^$0,$0",        "/s$0,+$0,1",    "S*$0,$1",
+                          "l+*$0,$0,1",    "L$0",           "g+$0,2",
+                          "c*$0,3",        "C$0",           "G2,$0",
+                          "G$0,10",        "m$0,*$0,$0",    "M$0,1",
+                          "?>$0,1,$0,^$0,2", "a_$0,1",      "%*$0,3,1.5",
+                          "_$0,~$0,1"};
+  for (const char *expr : smooth)
+    check(std::string("d/d$0 ") + expr, derivativeMatches(expr));
+  std::string source;
+  check("factorial has no rule", !Differentiator::differentiate("f$0", 0,
+                                                                source));
+  check("loops are not differentiated",
+        !Differentiator::differentiate("A1,3,-1,*@0,$0", 0, source));
+
+  // sqrt(2) by Newton from several starts.
+  Solver sqrt2("_*$0,$0,2", 0);
+  check("Newton uses the derivative", sqrt2.hasDerivative());
+  auto roots = sqrt2.newton({1, 2, 5, 100, -3});
+  bool ok = true;
+  for (size_t i = 0; i < roots.size(); i++)
+    ok &= roots[i].converged &&
+          std::abs(std::abs(roots[i].x) - std::sqrt(2.0)) < 1e-14;
+  report("newton sqrt(2)", sqrt2);
+  check("Newton converges to sqrt(2)", ok);
+  check("Newton from -3 finds -sqrt(2)", roots[4].x < 0);
+
+  // cos x = x on [0, 1].
+  Solver dottie("_S$0,$0", 0);
+  auto brent = dottie.brent({{0, 1}, {2, 3}});
+  report("brent cos x = x", dottie);
+  check("Brent finds the fixed point of cos",
+        brent[0].converged &&
+            std::abs(brent[0].x - 0.7390851332151607) < 1e-12);
+  check("Brent rejects a non-bracket", !brent[1].converged);
+
+  // Minimum of (x - $1)^2 + 1, with $1 fixed at 3.
+  Solver parabola("+^_$0,$1,2,1", 0, {0, 3});
+  auto minima = parabola.goldenSection({{0, 10}, {-50, 4}});
+  report("golden (x - 3)^2 + 1", parabola);
+  ok = true;
+  for (const SolveResult &r : minima)
+    ok &= r.converged && std::abs(r.x - 3) < 1e-6 && r.value == 1;
+  check("golden section finds the minimum", ok);
+
+  // Factorial has no rule, so the slope comes from central differences.
+  Solver gamma("_f$0,6", 0);
+  auto g = gamma.newton({2.5});
+  check("factorial uses central differences", !gamma.hasDerivative());
+  check("Newton without a derivative", g[0].converged &&
+                                           std::abs(g[0].x - 3) < 1e-9);
+
+  // Loops run on V1.
+  Solver loop("_A1,3,-1,*@0,$0,3", 0);
+  auto l = loop.newton({10});
+  check("loop expression falls back to V1", !loop.usesVM());
+  check("Newton on V1", l[0].converged && std::abs(l[0].x - 0.5) < 1e-9);
+
+  // Every root of sin on [0, 1000], from a bracket per period, batched,
+  // against one Newton solve at a time through the scalar VM.
+  const int count = 100'000;
+  std::vector<Bracket> brackets;
+  std::vector<double> starts;
+  for (int k = 1; k <= count; k++) {
+    double root = k * M_PI;
+    brackets.push_back({root - 1, root + 1.3});
+    starts.push_back(root + 0.3);
+  }
+  Solver sine("s$0", 0);
+  auto start = std::chrono::steady_clock::now();
+  auto batched = sine.newton(starts);
+  std::chrono::duration<double> batchedTime =
+      std::chrono::steady_clock::now() - start;
+  report("newton sin, batched", sine);
+  double evalsPerSecond = sine.stats().evaluations / batchedTime.count();
+
+  start = std::chrono::steady_clock::now();
+  auto bracketed = sine.brent(brackets);
+  std::chrono::duration<double> brentTime =
+      std::chrono::steady_clock::now() - start;
+  report("brent sin, batched", sine);
+
+  FunctionParserV2 f("s$0"), df("S$0");
+  std::vector<double> args(1);
+  size_t scalarEvals = 0;
+  start = std::chrono::steady_clock::now();
+  double sink = 0;
+  for (double x : starts) {
+    for (int i = 0; i < 100; i++) {
+      args[0] = x;
+      double fx = f.eval(args), dfx = df.eval(args);
+      scalarEvals += 2;
+      double dx = fx / dfx;
+      x -= dx;
+      if (std::abs(dx) <= 1e-12 * (1 + std::abs(x)))
+        break;
+    }
+    sink += x;
+  }
+  std::chrono::duration<double> scalarTime =
+      std::chrono::steady_clock::now() - start;
+
+  std::cout << "batched Newton " << evalsPerSecond << " evals/s ("
+            << batchedTime.count() * 1e3 << " ms), Brent "
+            << brentTime.count() * 1e3 << " ms, hand-written scalar loop "
+            << scalarEvals / scalarTime.count() << " evals/s ("
+            << scalarTime.count() * 1e3 << " ms, checksum " << sink << ")"
+            << std::endl;
+
+  ok = true;
+  for (int k = 0; k < count; k++) {
+    double root = (k + 1) * M_PI;
+    ok &= batched[k].converged &&
+          std::abs(batched[k].x - root) < 1e-9 * root &&
+          bracketed[k].converged &&
+          std::abs(bracketed[k].x - root) < 1e-9 * root;
+  }
+  check("batched solves find every root", ok);
+  return failures == 0 ? 0 : 1;
+}
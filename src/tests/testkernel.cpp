@@ -0,0 +1,41 @@
+#include "functionlangKernel.hpp"
+#include "functionlangV2.hpp"
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Related expressions over one input row, sharing s$0, *$0,$1 and +$1,$2.
+std::vector<std::string> equations{
+    "s$0",           "+s$0,*$0,$1",         "*+$1,$2,s$0",
+    "^+$1,$2,2",     "?>$0,$1,*$0,$1,+$1,$2", "~/*$0,$1,+$1,$2,3",
+    "G2,+s$0,*$0,$1", "p"};
+
+int main() {
+  using namespace functionlang;
+  std::vector<double> args = {0.75, 2.5, -1.25};
+
+  FunctionKernel kernel(equations);
+  std::vector<double> out = kernel.eval(args);
+
+  int failures = 0;
+  for (size_t i = 0; i < equations.size(); i++) {
+    FunctionParserV2 single(equations[i].c_str());
+    double expected = single.eval(args);
+    bool ok = out[i] == expected;
+    failures += !ok;
+    std::cout << equations[i] << " -> " << expected << " : " << out[i]
+              << (ok ? "" : " FAILED") << std::endl;
+  }
+  std::cout << kernel.parsedNodeCount() << " parsed nodes, "
+            << kernel.sharedNodeCount() << " after sharing, "
+            << kernel.instructionCount() << " instructions" << std::endl;
+
+  FunctionKernel loops({"A1,3,-1,@0", "+$0,1"});
+  bool flagged = !loops.isSupported() &&
+                 loops.eval(args) == std::vector<double>(2, DEFAULT_RESULT);
+  failures += !flagged;
+  std::cout << "Loop expression flagged unsupported : "
+            << (flagged ? "OK" : "FAILED") << std::endl;
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,66 @@
+#include "functionlangV2.hpp"
+#include <chrono>
+#include <iostream>
+
+using namespace functionlang;
+
+int failures = 0;
+
+void check(const char *name, EvalStatus got, EvalStatus expected) {
+  bool ok = got == expected;
+  failures += !ok;
+  std::cout << name << " : " << static_cast<int>(got)
+            << (ok ? "" : " FAILED") << std::endl;
+}
+
+int main() {
+  EvalLimits iterations{0, 1'000'000, {}};
+  EvalLimits instructions{5'000, 0, {}};
+  EvalLimits deadline{0, 0, std::chrono::milliseconds(50)};
+  double result;
+
+  // Static estimates reject before running.
+  CostEstimate huge = estimateCost("A1,1e12,-1,@0");
+  std::cout << "A1,1e12,-1,@0 estimate: " << huge.iterations
+            << " iterations, bounded " << huge.bounded << std::endl;
+  check("1e12 sum rejected",
+        evaluateBounded("A1,1e12,-1,@0", {}, iterations, result),
+        EvalStatus::REJECTED);
+  check("nested 1e4 x 1e4 rejected",
+        evaluateBounded("A1,^10,4,-1,A1,1e4,-1,*@0,@1", {}, iterations,
+                        result),
+        EvalStatus::REJECTED);
+  check("integral rejected",
+        evaluateBounded("I0,1,1e8,-1,@0", {}, iterations, result),
+        EvalStatus::REJECTED);
+
+  // Input-dependent bounds are stopped at runtime.
+  check("runtime iteration limit",
+        evaluateBounded("A1,$0,-1,@0", {1e12}, iterations, result),
+        EvalStatus::ITERATION_LIMIT);
+  check("runtime instruction limit",
+        evaluateBounded("A1,$0,-1,+*@0,@0,1", {1e12}, instructions, result),
+        EvalStatus::INSTRUCTION_LIMIT);
+  auto start = std::chrono::steady_clock::now();
+  EvalStatus timedOut =
+      evaluateBounded("A1,$0,-1,A1,$0,-1,@1", {1e12}, deadline, result);
+  auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start);
+  check("deadline", timedOut, EvalStatus::DEADLINE);
+  std::cout << "  stopped after " << elapsed.count() << " ms" << std::endl;
+
+  // Within the limits the result is unchanged.
+  check("within limits",
+        evaluateBounded("A1,100,-1,@0", {}, iterations, result),
+        EvalStatus::OK);
+  failures += result != 5050;
+
+  FunctionParserV2 vm("+*$0,$1,$2");
+  check("V2 within limits", vm.eval({2, 3, 4}, instructions, result),
+        EvalStatus::OK);
+  failures += result != 10;
+  check("V2 over instruction limit",
+        vm.eval({2, 3, 4}, EvalLimits{2, 0, {}}, result),
+        EvalStatus::REJECTED);
+  return failures == 0 ? 0 : 1;
+}
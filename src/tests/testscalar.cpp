@@ -0,0 +1,133 @@
+#include "functionlangV2.hpp"
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+using namespace functionlang;
+
+// Smooth over the sampled inputs, so float error stays near rounding level.
+const char *smooth[] = {"+*$0,$1,s$2", "^+$0,1,2.5", "l+*$0,$0,1",
+                        "/c+$0,$1,+$2,0.3", "*S$0,+^$1,3,0.1"};
+// Branches and rounding, where float and double may legitimately disagree.
+const char *discrete[] = {"?>$0,1,*$0,$1,_$1,$0", "m~$0,3,S$1",
+                          "f*$0,10"};
+
+const size_t ROWS = 1 << 16;
+const size_t FLOAT_LANES = 8;
+const size_t DOUBLE_LANES = 4;
+
+int failures = 0;
+
+void check(const std::string &name, bool ok) {
+  failures += !ok;
+  std::cout << name << " : " << (ok ? "OK" : "FAILED") << std::endl;
+}
+
+// Evaluates every row one at a time and returns rows per second.
+template <typename T>
+double runScalar(const char *eq, const std::vector<std::vector<T>> &rows,
+                 std::vector<T> &out) {
+  BasicFunctionParserV2<T> vm(eq);
+  out.resize(rows.size());
+  auto start = std::chrono::high_resolution_clock::now();
+  for (size_t r = 0; r < rows.size(); r++)
+    out[r] = vm.eval(rows[r]);
+  std::chrono::duration<double> diff =
+      std::chrono::high_resolution_clock::now() - start;
+  return rows.size() / diff.count();
+}
+
+// Packs N rows per evaluation and returns rows per second.
+template <typename T, size_t N>
+double runLanes(const char *eq, const std::vector<std::vector<T>> &rows,
+                std::vector<T> &out) {
+  BasicFunctionParserV2<Lanes<T, N>> vm(eq);
+  size_t width = rows[0].size();
+  std::vector<std::vector<Lanes<T, N>>> packed(
+      rows.size() / N, std::vector<Lanes<T, N>>(width));
+  for (size_t r = 0; r < rows.size(); r++)
+    for (size_t v = 0; v < width; v++)
+      packed[r / N][v][r % N] = rows[r][v];
+
+  out.resize(rows.size());
+  auto start = std::chrono::high_resolution_clock::now();
+  for (size_t g = 0; g < packed.size(); g++) {
+    Lanes<T, N> result = vm.eval(packed[g]);
+    for (size_t i = 0; i < N; i++)
+      out[g * N + i] = result[i];
+  }
+  std::chrono::duration<double> diff =
+      std::chrono::high_resolution_clock::now() - start;
+  return rows.size() / diff.count();
+}
+
+template <typename T>
+bool sameBits(const std::vector<T> &a, const std::vector<T> &b) {
+  for (size_t i = 0; i < a.size(); i++)
+    if (a[i] != b[i] && !(std::isnan(a[i]) && std::isnan(b[i])))
+      return false;
+  return true;
+}
+
+double maxRelativeError(const std::vector<double> &exact,
+                        const std::vector<float> &approx) {
+  double worst = 0;
+  for (size_t i = 0; i < exact.size(); i++)
+    worst = std::max(worst, std::abs(approx[i] - exact[i]) /
+                                std::max(std::abs(exact[i]), 1e-30));
+  return worst;
+}
+
+void runCase(const char *eq, bool checkPrecision,
+             const std::vector<std::vector<double>> &rowsD,
+             const std::vector<std::vector<float>> &rowsF) {
+  std::vector<double> outD, outDL;
+  std::vector<float> outF, outFL;
+  double rateD = runScalar(eq, rowsD, outD);
+  double rateF = runScalar(eq, rowsF, outF);
+  double rateDL = runLanes<double, DOUBLE_LANES>(eq, rowsD, outDL);
+  double rateFL = runLanes<float, FLOAT_LANES>(eq, rowsF, outFL);
+  double error = maxRelativeError(outD, outF);
+
+  std::cout << "--- " << eq << " ---" << std::endl;
+  std::cout << "rows/s  double " << rateD << "  float " << rateF
+            << "  double x" << DOUBLE_LANES << " " << rateDL << "  float x"
+            << FLOAT_LANES << " " << rateFL << std::endl;
+  std::cout << "float max relative error " << error << std::endl;
+
+  check("double lanes match double", sameBits(outD, outDL));
+  check("float lanes match float", sameBits(outF, outFL));
+  if (checkPrecision)
+    check("float within 1e-4", error < 1e-4);
+}
+
+int main() {
+  std::cout << std::scientific << std::setprecision(3);
+
+  // V1 and V2 keep literals at double precision.
+  const char *literal = "0.1";
+  check("V1 literal is exact", parseExpression(literal)({}) == 0.1);
+  check("V2 literal is exact", FunctionParserV2("0.1").eval({}) == 0.1);
+  check("float literal is rounded once",
+        BasicFunctionParserV2<float>("0.1").eval({}) == 0.1f);
+
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<double> dist(0.1, 2.0);
+  std::vector<std::vector<double>> rowsD(ROWS, std::vector<double>(3));
+  std::vector<std::vector<float>> rowsF(ROWS, std::vector<float>(3));
+  for (size_t r = 0; r < ROWS; r++) {
+    for (size_t v = 0; v < 3; v++) {
+      // Inputs exactly representable in both types.
+      rowsF[r][v] = static_cast<float>(dist(rng));
+      rowsD[r][v] = rowsF[r][v];
+    }
+  }
+
+  for (const char *eq : smooth)
+    runCase(eq, true, rowsD, rowsF);
+  for (const char *eq : discrete)
+    runCase(eq, false, rowsD, rowsF);
+  return failures == 0 ? 0 : 1;
+}
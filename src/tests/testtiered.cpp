@@ -0,0 +1,80 @@
+#include "functionlangTiered.hpp"
+#include <cmath>
+#include <iostream>
+
+using namespace functionlang;
+
+int failures = 0;
+
+void check(const char *name, bool ok) {
+  failures += !ok;
+  std::cout << name << " : " << (ok ? "OK" : "FAILED") << std::endl;
+}
+
+bool same(double a, double b) {
+  return a == b || (std::isnan(a) && std::isnan(b));
+}
+
+// Evaluates `expr` through every tier, comparing each result with V1.
+bool matchesV1(const char *expr, TierPolicy policy, Tier &reached) {
+  TieredFunction tiered(expr, policy);
+  const char *ptr = expr;
+  ExprFunc v1 = parseExpression(ptr);
+  std::vector<double> args(4);
+  bool ok = true;
+  for (int i = 0; i < 400; i++) {
+    args[0] = i * 0.37 - 20;
+    args[1] = i % 7 + 0.5;
+    ok &= same(tiered.eval(args), v1(args));
+    // Deterministic: let each background compile land before continuing.
+    tiered.waitForCompile();
+  }
+  reached = tiered.tier();
+  return ok;
+}
+
+int main() {
+  TierPolicy fast{.bytecodeAfter = 10, .registerAfter = 100, .trialRuns = 200};
+  std::vector<double> args = {1.5, 2.0};
+
+  TieredFunction f("+*$0,$1,s$0", fast);
+  check("starts on V1", f.tier() == Tier::CLOSURE);
+  for (int i = 0; i < 9; i++)
+    f.eval(args);
+  check("stays on V1 below the threshold", f.tier() == Tier::CLOSURE);
+  f.eval(args);
+  f.waitForCompile();
+  f.eval(args);
+  check("promoted to bytecode", f.tier() == Tier::BYTECODE);
+  check("bytecode promotion counted", tierCounters.bytecodePromotions == 1);
+
+  while (f.evaluationCount() < fast.registerAfter)
+    f.eval(args);
+  f.waitForCompile();
+  f.eval(args);
+  uint64_t decided =
+      tierCounters.registerPromotions + tierCounters.registerRejected;
+  std::cout << "register VM " << tierName(f.tier()) << " after timing"
+            << std::endl;
+  check("register VM promoted or rejected", decided == 1);
+
+  const char *exprs[] = {"?>$0,1,*$0,$1,_$1,$0", "^+$0,1,2.5", "f*$0,10",
+                         "/1,$0", "m~$0,3,S$1", "l+*$0,$0,1",
+                         // Powers V2 once expanded into rounded products.
+                         "^$0,3", "^*$0,$1,4"};
+  for (const char *expr : exprs) {
+    Tier reached;
+    bool ok = matchesV1(expr, fast, reached);
+    std::cout << expr << " -> " << tierName(reached) << std::endl;
+    check("every tier matches V1", ok && reached != Tier::CLOSURE);
+  }
+
+  uint64_t fallbacks = tierCounters.closureFallbacks;
+  Tier reached;
+  check("loop expression matches V1",
+        matchesV1("A1,3,-1,*@0,$0", fast, reached));
+  check("loop expression stays on V1", reached == Tier::CLOSURE);
+  check("fallback counted", tierCounters.closureFallbacks == fallbacks + 1);
+  check("every handle counted", tierCounters.handles == 1 + 8 + 1);
+  return failures == 0 ? 0 : 1;
+}
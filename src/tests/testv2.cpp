@@ -5,15 +5,94 @@
 #include <map>
 #include <ostream>
 
-std::map<std::string, double> testcases{{"+1,1", 2},  {"_10,5", 5},
-                                        {"/10,2", 5}, {"^2,3", 8.0},
-                                        {"e", M_E},   {"p", M_PI}};
+std::map<std::string, double> testcases{
+    {"+1,1", 2},
+    {"_10,5", 5},
+    {"/10,2", 5},
+    {"^2,3", 8.0},
+    {"e", M_E},
+    {"p", M_PI},
+    // Superinstruction patterns, $0 = 3 and $1 = 4
+    {"^$0,2", 9},
+    {"^$1,0.5", 2},
+    {"^-0,0.5", 0},
+    {"^$0,3", 27},
+    {"^$0,0", 1},
+    {"^$0,2.5", std::pow(3.0, 2.5)},
+    {"*$0,+$1,2", 18},
+    {"+*$0,$1,2", 14},
+    {"+2,$1", 6},
+    {"+$1,2", 6},
+    {"*s$0,$1", std::sin(3.0) * 4},
+    {"*$1,s$0", std::sin(3.0) * 4},
+    {"+*s$0,c$1,s$1", std::sin(3.0) * 2 + std::sin(4.0)},
+    {"*s$0,+c$1,s$0", std::sin(3.0) * (2 + std::sin(3.0))},
+    {"_$0,0.5", 2.5},
+    {"*$0,0.5", 1.5},
+    {"~/$0,7,2", 0.43},
+    {"~$0,$1", 3}};
+
+// The program each pattern compiles to; a variable read or POW_INT is
+// followed by its index or exponent.
+using functionlang::Op;
+using enum Op;
+std::map<std::string, std::vector<functionlang::Op>> programs{
+    {"^$0,2", {GET_V, Op{0}, SQUARE}},
+    {"^$1,0.5", {GET_V, Op{1}, POW_HALF}},
+    {"^$0,0", {GET_V, Op{0}, POW_INT, Op{0}}},
+    {"^$0,1", {GET_V, Op{0}, POW_INT, Op{1}}},
+    // Repeated multiplication would round differently from std::pow.
+    {"^$0,3", {GET_V, Op{0}, PUSH_V, POW}},
+    {"^$0,4", {GET_V, Op{0}, PUSH_V, POW}},
+    {"+*s$0,c$1,s$1",
+     {GET_V, Op{0}, SIN, GET_V, Op{1}, SQRT, GET_V, Op{1}, SIN, MUL_ADD}},
+    {"*s$0,+c$1,s$0",
+     {GET_V, Op{0}, SIN, GET_V, Op{1}, SQRT, GET_V, Op{0}, SIN, ADD_MUL}},
+    {"+2,$1", {PUSH_V, ADD_VAR, Op{1}}},
+    {"*$1,s$0", {GET_V, Op{0}, SIN, MUL_VAR, Op{1}}},
+    {"+$1,2", {GET_V, Op{1}, ADD_CONST}},
+    {"_$0,0.5", {GET_V, Op{0}, ADD_CONST}},
+    {"*$0,0.5", {GET_V, Op{0}, MUL_CONST}},
+    {"~/$0,7,2", {GET_V, Op{0}, PUSH_V, DIV, ROUND_CONST}}};
 
 int main() {
   functionlang::FunctionParserV2 t("");
+  int failures = 0;
   for (auto [eq, ex] : testcases) {
     t.setEq(eq.c_str());
-    std::cout << eq << " -> " << ex << " : " << t.eval({}) << std::endl;
+    double got = t.eval({3, 4});
+    bool ok = std::abs(got - ex) <= 1e-12 * std::max(1.0, std::abs(ex));
+    failures += !ok;
+    std::cout << eq << " -> " << ex << " : " << got << (ok ? "" : " FAILED")
+              << std::endl;
+  }
+
+  for (auto [eq, expected] : programs) {
+    t.setEq(eq.c_str());
+    bool ok = t.instructions() == expected;
+    failures += !ok;
+    std::cout << eq << " -> " << expected.size() << " opcodes"
+              << (ok ? "" : " FAILED") << std::endl;
+  }
+
+  // V1 reads any variable index and ignores trailing input, so the VMs
+  // decline these without them being syntax errors; a later real error
+  // still is one.
+  std::map<std::string, bool> syntaxErrors{{"*$256,2", false},
+                                           {"A1,3,300,@300", false},
+                                           {"+1,2 3", false},
+                                           {"+$300,?1", true},
+                                           {"+1,", true}};
+  for (auto [eq, expected] : syntaxErrors) {
+    functionlang::ExprTree tree;
+    const char *ptr = eq.c_str();
+    tree.parse(ptr);
+    t.setEq(eq.c_str());
+    bool ok = tree.hasError() && tree.hasSyntaxError() == expected &&
+              !t.isSupported();
+    failures += !ok;
+    std::cout << eq << " -> " << (expected ? "syntax error" : "VMs only")
+              << (ok ? "" : " FAILED") << std::endl;
   }
-  return 0;
+  return failures == 0 ? 0 : 1;
 }
@@ -0,0 +1,111 @@
+// Spans are compiled out unless this is defined before the headers.
+#define FUNCTIONLANG_TRACE
+#include "functionlangPlanner.hpp"
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <thread>
+
+using namespace functionlang;
+
+int failures = 0;
+
+void check(const std::string &name, bool ok) {
+  failures += !ok;
+  std::cout << name << " : " << (ok ? "OK" : "FAILED") << std::endl;
+}
+
+// Recorded spans by name, and the argument of the last one of each.
+struct Recorded {
+  std::map<std::string, int> count;
+  std::map<std::string, uint64_t> arg;
+  std::map<uint32_t, int> threads;
+};
+
+Recorded recorded() {
+  Recorded r;
+  trace::forEachEvent([&](const char *name, const char *, const char *argName,
+                          uint64_t arg, uint64_t, uint64_t, uint32_t thread) {
+    r.count[name]++;
+    if (argName != nullptr)
+      r.arg[name] = arg;
+    r.threads[thread]++;
+  });
+  return r;
+}
+
+double run(const char *expr, std::vector<double> args = {}) {
+  memoOptions.enabled = false;
+  ExprFunc func = parseExpression(expr);
+  memoOptions.enabled = true;
+  return func(args);
+}
+
+int main() {
+  check("compiled in", trace::COMPILED);
+  run("A1,10,-1,@0");
+  check("nothing recorded while off", trace::eventCount() == 0);
+
+  trace::setEnabled(true);
+  run("+A1,10,-1,*@0,A1,3,-1,*@0,@1,I0,1,8,-1,@0");
+  FunctionParserV2 v2("+*$0,$1,s$2");
+  FunctionParserReg reg("+*$0,$1,s$2");
+  Recorded r = recorded();
+  check("one span per parse", r.count["parseExpression"] == 1);
+  check("one span per loop run",
+        r.count["A"] == 11 && r.count["I"] == 1 && r.arg["I"] == 8);
+  check("loop trips recorded", r.arg["A"] == 10);
+  check("compiler passes recorded",
+        r.count["V2::compile"] == 1 && r.count["ExprTree::parse"] == 2 &&
+            r.count["computeNeeds"] == 1 && r.count["emitNode"] == 1 &&
+            r.arg["V2::compile"] > 0);
+  double value;
+  evaluateBounded("A1,100,-1,@0", {}, {}, value);
+  check("bounded evaluation recorded",
+        recorded().count["evaluateBounded"] == 1);
+
+  // Threads write their own rings.
+  trace::clear();
+  std::vector<std::jthread> threads;
+  for (int t = 0; t < 3; t++)
+    threads.emplace_back([] { run("A1,5,-1,@0"); });
+  threads.clear();
+  r = recorded();
+  check("spans from every thread",
+        r.threads.size() == 3 && r.count["A"] == 3);
+  PlannedFunction split("A1,100000,-1,s*@0,$0", {1, 4});
+  split.eval({0.5});
+  check("planner spans", recorded().count["split loop"] == 1 &&
+                             recorded().count["makePlan"] == 1);
+
+  // A ring keeps the latest events only.
+  trace::clear();
+  run("A1,30000,-1,A1,1,-1,*@0,@1");
+  r = recorded();
+  check("ring keeps the latest events",
+        r.count["A"] == static_cast<int>(trace::RING_EVENTS));
+
+  std::string json = trace::exportChrome();
+  check("Chrome trace JSON",
+        json.starts_with("{\"traceEvents\":[") &&
+            json.ends_with("],\"displayTimeUnit\":\"ns\"}\n") &&
+            json.find("\"ph\":\"X\"") != std::string::npos &&
+            json.find("\"args\":{\"trips\":1}") != std::string::npos);
+
+  // The cost of spans on a loop-heavy evaluation, on and off.
+  auto time = [](const char *expr) {
+    auto start = std::chrono::steady_clock::now();
+    run(expr);
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start)
+        .count();
+  };
+  const char *nested = "A1,100000,-1,A1,3,-1,*@0,@1";
+  double on = time(nested);
+  trace::setEnabled(false);
+  double off = time(nested);
+  std::cout << "100000 inner loops: tracing on " << on * 1e3
+            << " ms, off " << off * 1e3 << " ms" << std::endl;
+  trace::clear();
+  return failures == 0 ? 0 : 1;
+}